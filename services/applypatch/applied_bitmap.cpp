@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "applied_bitmap.h"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "log/log.h"
+#include "securec.h"
+#include "utils.h"
+#include "zlib.h"
+
+namespace Updater {
+constexpr uint32_t BITMAP_MAGIC = 0x50414D42;
+
+struct BitmapHead {
+    uint32_t magic;
+    uint32_t crc;
+    uint64_t count;
+    uint64_t horizon;
+};
+
+static uint32_t BitmapCrc(const BitmapHead &head, const std::vector<uint8_t> &bits)
+{
+    uLong crc = crc32(0, reinterpret_cast<const Bytef *>(&head.count), sizeof(head.count) + sizeof(head.horizon));
+    return static_cast<uint32_t>(crc32(crc, bits.data(), bits.size()));
+}
+
+bool AppliedBitmap::Load()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int fd = open(path_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG(INFO) << "No applied bitmap " << path_;
+        return false;
+    }
+    std::string content = "";
+    bool ret = Utils::ReadFileToString(fd, content);
+    close(fd);
+    BitmapHead head {};
+    if (!ret || content.size() != sizeof(head) + bits_.size() ||
+        memcpy_s(&head, sizeof(head), content.data(), sizeof(head)) != EOK) {
+        LOG(WARNING) << "Invalid applied bitmap " << path_;
+        return false;
+    }
+    std::vector<uint8_t> bits(content.begin() + sizeof(head), content.end());
+    if (head.magic != BITMAP_MAGIC || head.count != count_ || head.horizon > count_ ||
+        head.crc != BitmapCrc(head, bits)) {
+        LOG(WARNING) << "Applied bitmap does not match transfer list";
+        return false;
+    }
+    bits_ = bits;
+    snapshot_ = bits;
+    syncedBits_ = bits;
+    horizon_ = static_cast<size_t>(head.horizon);
+    loadedHorizon_ = horizon_;
+    isResumed_ = true;
+    LOG(INFO) << "Applied bitmap loaded, horizon " << horizon_ << " of " << count_;
+    return true;
+}
+
+bool AppliedBitmap::IsApplied(size_t index) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index < count_ && (syncedBits_[index / 8] & (1 << (index % 8))) != 0;
+}
+
+bool AppliedBitmap::IsUntouched(size_t index) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return isResumed_ && isValid_ && index >= loadedHorizon_ && index < count_;
+}
+
+bool AppliedBitmap::Start(size_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index < horizon_ || index >= count_) {
+        return true;
+    }
+    horizon_ = std::min(index + HORIZON_STEP, count_);
+    return WriteLocked();
+}
+
+void AppliedBitmap::SetApplied(size_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index < count_) {
+        bits_[index / 8] |= static_cast<uint8_t>(1 << (index % 8));
+    }
+}
+
+void AppliedBitmap::Snapshot()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    snapshot_ = bits_;
+}
+
+bool AppliedBitmap::Persist()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    syncedBits_ = snapshot_;
+    return WriteLocked();
+}
+
+bool AppliedBitmap::WriteLocked()
+{
+    if (!isValid_) {
+        return false;
+    }
+    BitmapHead head { BITMAP_MAGIC, 0, count_, horizon_ };
+    head.crc = BitmapCrc(head, syncedBits_);
+    std::string tmpPath = path_ + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    bool ret = fd >= 0 && Utils::WriteFully(fd, reinterpret_cast<const uint8_t *>(&head), sizeof(head)) &&
+        Utils::WriteFully(fd, syncedBits_.data(), syncedBits_.size()) && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    // the rename is durable only once the directory is synced
+    if (ret && rename(tmpPath.c_str(), path_.c_str()) == 0 && Utils::SyncParentDirectory(path_)) {
+        return true;
+    }
+    // A stale horizon could hide a started command, never leave one behind.
+    LOG(ERROR) << "Failed to write applied bitmap, errno " << errno;
+    isValid_ = false;
+    unlink(tmpPath.c_str());
+    unlink(path_.c_str());
+    return false;
+}
+} // namespace Updater
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef UPDATER_APPLIED_BITMAP_H
+#define UPDATER_APPLIED_BITMAP_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Updater {
+/*
+ * Persistent record of a block update, indexed by transfer.list line. A bit
+ * is set for each command whose target blocks were synced after it completed,
+ * and the horizon bounds the commands that may have been started. A resumed
+ * update skips applied commands and only needs to hash the target of started
+ * ones to find out whether they completed.
+ */
+class AppliedBitmap {
+public:
+    static constexpr size_t HORIZON_STEP = 256;
+
+    AppliedBitmap(const std::string &path, size_t count)
+        : path_(path), count_(count), bits_((count + 7) / 8, 0), snapshot_(bits_), syncedBits_(bits_) {}
+    ~AppliedBitmap() = default;
+
+    // Load the record of an interrupted update, false if there is none for this transfer.list
+    bool Load();
+    bool IsApplied(size_t index) const;
+    // True if the command was never started by an earlier attempt, so its target was not touched
+    bool IsUntouched(size_t index) const;
+    // Called before a command is started, the horizon is synced before it moves past index
+    bool Start(size_t index);
+    void SetApplied(size_t index);
+    // Called before and after the target blocks are synced
+    void Snapshot();
+    bool Persist();
+
+private:
+    AppliedBitmap(const AppliedBitmap&) = delete;
+    const AppliedBitmap& operator=(const AppliedBitmap&) = delete;
+
+    bool WriteLocked();
+
+    std::string path_ {};
+    size_t count_ { 0 };
+    mutable std::mutex mutex_ {};
+    std::vector<uint8_t> bits_ {};
+    // bits set before the last sync of the target blocks
+    std::vector<uint8_t> snapshot_ {};
+    std::vector<uint8_t> syncedBits_ {};
+    size_t horizon_ { 0 };
+    // horizon of the earlier attempts when resumed
+    size_t loadedHorizon_ { 0 };
+    bool isResumed_ { false };
+    // false once a write failed, the file is removed so that it is never trusted
+    bool isValid_ { true };
+};
+} // namespace Updater
+#endif // UPDATER_APPLIED_BITMAP_H
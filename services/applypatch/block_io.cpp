@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "block_io.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <unistd.h>
+#include "log/log.h"
+
+namespace Updater {
+static void LogIoError(const char *op, off64_t offset)
+{
+    // Keep errno, callers check it for EIO.
+    int err = errno;
+    LOG(ERROR) << op << " failed at " << offset << " : " << strerror(err);
+    errno = err;
+}
+
+bool BlockIo::ReadAt(int fd, uint8_t *data, size_t size, off64_t offset)
+{
+    while (size > 0) {
+        ssize_t ret = pread64(fd, data, size, offset);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            LogIoError("pread", offset);
+            return false;
+        }
+        if (ret == 0) {
+            LOG(ERROR) << "pread reached unexpected EOF at " << offset;
+            return false;
+        }
+        data += ret;
+        size -= static_cast<size_t>(ret);
+        offset += ret;
+    }
+    return true;
+}
+
+bool BlockIo::WriteAt(int fd, const uint8_t *data, size_t size, off64_t offset)
+{
+    while (size > 0) {
+        ssize_t ret = pwrite64(fd, data, size, offset);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            LogIoError("pwrite", offset);
+            return false;
+        }
+        data += ret;
+        size -= static_cast<size_t>(ret);
+        offset += ret;
+    }
+    return true;
+}
+
+bool BlockIo::WriteVectorAt(int fd, std::vector<struct iovec> &iov, off64_t offset)
+{
+    size_t index = 0;
+    while (index < iov.size()) {
+        int count = static_cast<int>(std::min(iov.size() - index, static_cast<size_t>(IOV_MAX)));
+        ssize_t ret = pwritev64(fd, iov.data() + index, count, offset);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            LogIoError("pwritev", offset);
+            return false;
+        }
+        offset += ret;
+        // Skip the written buffers, a partly written one is resumed from where it stopped.
+        size_t written = static_cast<size_t>(ret);
+        while (index < iov.size() && written >= iov[index].iov_len) {
+            written -= iov[index].iov_len;
+            index++;
+        }
+        if (written > 0) {
+            iov[index].iov_base = static_cast<uint8_t *>(iov[index].iov_base) + written;
+            iov[index].iov_len -= written;
+        }
+    }
+    return true;
+}
+} // namespace Updater
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef UPDATER_BLOCK_IO_H
+#define UPDATER_BLOCK_IO_H
+
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+namespace Updater {
+/*
+ * Positional block I/O. The file offset of fd is neither used nor changed,
+ * so one fd can be shared by threads writing different blocks.
+ */
+class BlockIo {
+public:
+    static bool ReadAt(int fd, uint8_t *data, size_t size, off64_t offset);
+    static bool WriteAt(int fd, const uint8_t *data, size_t size, off64_t offset);
+    // Write the buffers one after another from offset, at most IOV_MAX buffers per call
+    static bool WriteVectorAt(int fd, std::vector<struct iovec> &iov, off64_t offset);
+};
+} // namespace Updater
+#endif // UPDATER_BLOCK_IO_H
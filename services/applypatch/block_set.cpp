@@ -14,8 +14,8 @@
  */
 
 #include "applypatch/block_set.h"
-#include <linux/fs.h>
-#include <sys/ioctl.h>
+#include <algorithm>
+#include <iterator>
 #include <openssl/sha.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -23,11 +23,15 @@
 #include "applypatch/command.h"
 #include "applypatch/store.h"
 #include "applypatch/transfer_manager.h"
+#include "block_io.h"
 #include "log/dump.h"
 #include "log/log.h"
 #include "patch/update_patch.h"
+#include "patch_checkpoint_file.h"
 #include "securec.h"
 #include "utils.h"
+#include "write_behind_queue.h"
+#include "zero_engine.h"
 
 using namespace Updater;
 using namespace Updater::Utils;
@@ -43,10 +47,11 @@ BlockSet::BlockSet(std::vector<BlockPair> &&pairs)
 
     for (const auto &pair : pairs) {
         if (!CheckReliablePair(pair)) {
-            return;
+            break;
         }
         PushBack(pair);
     }
+    BuildIndex();
 }
 
 bool BlockSet::CheckReliablePair(BlockPair pair)
@@ -73,6 +78,134 @@ void BlockSet::ClearBlocks()
 {
     blockSize_ = 0;
     blocks_.clear();
+    index_.clear();
+}
+
+void BlockSet::BuildIndex()
+{
+    index_.assign(blocks_.begin(), blocks_.end());
+    std::sort(index_.begin(), index_.end());
+    CoalesceIndex(index_);
+}
+
+// Merge adjacent or overlapped ranges of index sorted by start and drop empty ones
+void BlockSet::CoalesceIndex(std::vector<BlockPair> &index)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < index.size(); i++) {
+        BlockPair range = index[i];
+        if (range.first >= range.second) {
+            continue;
+        }
+        if (count > 0 && range.first <= index[count - 1].second) {
+            index[count - 1].second = std::max(index[count - 1].second, range.second);
+            continue;
+        }
+        index[count++] = range;
+    }
+    index.resize(count);
+}
+
+BlockSet BlockSet::FromIndex(std::vector<BlockPair> &&index)
+{
+    BlockSet result;
+    for (const auto &range : index) {
+        result.blockSize_ += range.second - range.first;
+    }
+    result.blocks_ = index;
+    result.index_ = std::move(index);
+    return result;
+}
+
+// First indexed range that ends after the block, CEnd of index_ if none
+std::vector<BlockPair>::const_iterator BlockSet::FindIndex(size_t block) const
+{
+    return std::upper_bound(index_.cbegin(), index_.cend(), block,
+        [](size_t value, const BlockPair &range) { return value < range.second; });
+}
+
+bool BlockSet::IsOverlap(const BlockSet &other) const
+{
+    // Look up the ranges of the smaller set in the larger one.
+    if (other.index_.size() > index_.size()) {
+        return other.IsOverlap(*this);
+    }
+    for (const auto &range : other.index_) {
+        auto it = FindIndex(range.first);
+        if (it != index_.cend() && it->first < range.second) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BlockSet::IsContain(size_t block) const
+{
+    auto it = FindIndex(block);
+    return it != index_.cend() && it->first <= block;
+}
+
+bool BlockSet::IsContain(const BlockSet &other) const
+{
+    for (const auto &range : other.index_) {
+        auto it = FindIndex(range.first);
+        if (it == index_.cend() || it->first > range.first || it->second < range.second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BlockSet BlockSet::Intersect(const BlockSet &other) const
+{
+    std::vector<BlockPair> result;
+    auto first = index_.cbegin();
+    auto second = other.index_.cbegin();
+    while (first != index_.cend() && second != other.index_.cend()) {
+        size_t start = std::max(first->first, second->first);
+        size_t end = std::min(first->second, second->second);
+        if (start < end) {
+            result.push_back(BlockPair { start, end });
+        }
+        if (first->second < second->second) {
+            ++first;
+        } else {
+            ++second;
+        }
+    }
+    return FromIndex(std::move(result));
+}
+
+BlockSet BlockSet::Subtract(const BlockSet &other) const
+{
+    std::vector<BlockPair> result;
+    auto second = other.index_.cbegin();
+    for (const auto &range : index_) {
+        size_t start = range.first;
+        while (second != other.index_.cend() && second->second <= start) {
+            ++second;
+        }
+        for (auto it = second; it != other.index_.cend() && it->first < range.second; ++it) {
+            if (it->first > start) {
+                result.push_back(BlockPair { start, it->first });
+            }
+            start = std::max(start, it->second);
+        }
+        if (start < range.second) {
+            result.push_back(BlockPair { start, range.second });
+        }
+    }
+    return FromIndex(std::move(result));
+}
+
+BlockSet BlockSet::Union(const BlockSet &other) const
+{
+    std::vector<BlockPair> result;
+    result.reserve(index_.size() + other.index_.size());
+    std::merge(index_.cbegin(), index_.cend(), other.index_.cbegin(), other.index_.cend(),
+        std::back_inserter(result));
+    CoalesceIndex(result);
+    return FromIndex(std::move(result));
 }
 
 bool BlockSet::ParserAndInsert(const std::string &blockStr)
@@ -115,6 +248,7 @@ bool BlockSet::ParserAndInsert(const std::vector<std::string> &blockToken)
         });
         blockSize_ += (second - first);
     }
+    BuildIndex();
     return true;
 }
 
@@ -148,19 +282,32 @@ std::vector<BlockPair>::const_reverse_iterator BlockSet::CrEnd() const
     return blocks_.crend();
 }
 
+// Ranges that follow each other on the device are read or written in one call,
+// ranges is set to the count of them, at least one even if they hold no block
+static size_t GetContinuousRanges(std::vector<BlockPair>::const_iterator it,
+    std::vector<BlockPair>::const_iterator end, size_t &ranges)
+{
+    size_t blocks = it->second - it->first;
+    ranges = 1;
+    for (auto next = it + 1; next != end && next->first == it->second; it = next++) {
+        blocks += next->second - next->first;
+        ranges++;
+    }
+    return blocks;
+}
+
 size_t BlockSet::ReadDataFromBlock(int fd, std::vector<uint8_t> &buffer)
 {
     size_t pos = 0;
-    std::vector<BlockPair>::iterator it = blocks_.begin();
-    int ret;
-    for (; it != blocks_.end(); ++it) {
-        ret = lseek64(fd, static_cast<off64_t>(it->first * H_BLOCK_SIZE), SEEK_SET);
-        if (ret == -1) {
-            LOG(ERROR) << "Fail to seek";
+    size_t ranges = 0;
+    for (auto it = blocks_.cbegin(); it != blocks_.cend(); it += static_cast<std::ptrdiff_t>(ranges)) {
+        size_t blocks = GetContinuousRanges(it, blocks_.cend(), ranges);
+        size_t size = blocks * H_BLOCK_SIZE;
+        if (pos + size > buffer.size()) {
+            LOG(ERROR) << "Buffer is too small to read blocks";
             return 0;
         }
-        size_t size = (it->second - it->first) * H_BLOCK_SIZE;
-        if (!Utils::ReadFully(fd, buffer.data() + pos, size)) {
+        if (!BlockIo::ReadAt(fd, buffer.data() + pos, size, static_cast<off64_t>(it->first) * H_BLOCK_SIZE)) {
             LOG(ERROR) << "Fail to read";
             return 0;
         }
@@ -169,27 +316,27 @@ size_t BlockSet::ReadDataFromBlock(int fd, std::vector<uint8_t> &buffer)
     return pos;
 }
 
-size_t BlockSet::WriteDataToBlock(int fd, std::vector<uint8_t> &buffer)
+size_t BlockSet::WriteDataToBlock(int fd, std::vector<uint8_t> &buffer, WriteBehindQueue *queue)
 {
     size_t pos = 0;
-    std::vector<BlockPair>::iterator it = blocks_.begin();
-    int ret = 0;
-    for (; it != blocks_.end(); ++it) {
-        off64_t offset = static_cast<off64_t>(it->first * H_BLOCK_SIZE);
-        size_t writeSize = (it->second - it->first) * H_BLOCK_SIZE;
-
-        ret = lseek64(fd, offset, SEEK_SET);
-        if (ret == -1) {
-            LOG(ERROR) << "BlockSet::WriteDataToBlock Fail to seek";
+    size_t ranges = 0;
+    for (auto it = blocks_.cbegin(); it != blocks_.cend(); it += static_cast<std::ptrdiff_t>(ranges)) {
+        size_t blocks = GetContinuousRanges(it, blocks_.cend(), ranges);
+        size_t writeSize = blocks * H_BLOCK_SIZE;
+        if (pos + writeSize > buffer.size()) {
+            LOG(ERROR) << "Buffer is too small to write blocks";
             return 0;
         }
-        if (Utils::WriteFully(fd, buffer.data() + pos, writeSize) == false) {
+        off64_t offset = static_cast<off64_t>(it->first) * H_BLOCK_SIZE;
+        bool ret = queue != nullptr ? queue->Submit(buffer.data() + pos, writeSize, offset) :
+            BlockIo::WriteAt(fd, buffer.data() + pos, writeSize, offset);
+        if (!ret) {
             LOG(ERROR) << "Write data to block error, errno : " << errno;
             return 0;
         }
         pos += writeSize;
     }
-    if (fsync(fd) == -1) {
+    if (queue == nullptr && fsync(fd) == -1) {
         LOG(ERROR) << "Failed to fsync" << strerror(errno);
         return 0;
     }
@@ -220,17 +367,7 @@ int32_t BlockSet::VerifySha256(const std::vector<uint8_t> &buffer, const size_t
 
 bool BlockSet::IsTwoBlocksOverlap(const BlockSet &source, BlockSet &target)
 {
-    auto firstIter = source.CBegin();
-    for (; firstIter != source.CEnd(); ++firstIter) {
-        std::vector<BlockPair>::iterator secondIter = target.Begin();
-        for (; secondIter != target.End(); ++secondIter) {
-            if (!(secondIter->first >= firstIter->second ||
-                firstIter->first >= secondIter->second)) {
-                return true;
-            }
-        }
-    }
-    return false;
+    return source.IsOverlap(target);
 }
 
 void BlockSet::MoveBlock(std::vector<uint8_t> &target, const BlockSet& locations,
@@ -254,7 +391,6 @@ int32_t BlockSet::LoadSourceBuffer(const Command &cmd, size_t &pos, std::vector<
     bool &isOverlap, size_t &srcBlockSize)
 {
     std::string targetCmd = cmd.GetArgumentByPos(pos++);
-    std::string storeBase = cmd.GetTransferParams()->storeBase;
     if (targetCmd != "-") {
         BlockSet srcBlk;
         srcBlk.ParserAndInsert(targetCmd);
@@ -283,7 +419,7 @@ int32_t BlockSet::LoadSourceBuffer(const Command &cmd, size_t &pos, std::vector<
             return -1;
         }
         std::vector<uint8_t> stash;
-        auto ret = Store::LoadDataFromStore(storeBase, tokens[H_ZERO_NUMBER], stash);
+        auto ret = Store::LoadStash(*cmd.GetTransferParams(), tokens[H_ZERO_NUMBER], stash);
         if (ret == -1) {
             LOG(ERROR) << "Failed to load tokens";
             return -1;
@@ -327,8 +463,8 @@ int32_t BlockSet::LoadTargetBuffer(const Command &cmd, std::vector<uint8_t> &buf
     }
     if (verifyRes == 0) {
         if (isOverlap && res != 0) {
-            cmd.GetTransferParams()->freeStash = srcHash;
-            ret = Store::WriteDataToStore(storeBase, srcHash, buffer, blockSize * H_BLOCK_SIZE);
+            cmd.SetFreeStash(srcHash);
+            ret = Store::WriteStashToStore(storeBase, srcHash, buffer, cmd.GetTransferParams()->compressStash);
             if (ret != 0) {
                 LOG(ERROR) << "failed to stash overlapping source blocks";
                 return -1;
@@ -336,99 +472,150 @@ int32_t BlockSet::LoadTargetBuffer(const Command &cmd, std::vector<uint8_t> &buf
         }
         return 0;
     }
-    if (Store::LoadDataFromStore(storeBase, srcHash, buffer) == 0) {
+    if (Store::LoadStash(*cmd.GetTransferParams(), srcHash, buffer) == 0) {
         return 0;
     }
     return -1;
 }
 
-int32_t BlockSet::WriteZeroToBlock(int fd, bool isErase)
+int32_t BlockSet::WriteZeroToBlock(int fd, bool isErase, ZeroEngine *engine)
 {
-    std::vector<uint8_t> buffer;
-    buffer.resize(H_BLOCK_SIZE);
-    if (memset_s(buffer.data(), H_BLOCK_SIZE, 0, H_BLOCK_SIZE) != EOK) {
-        LOG(ERROR) << "memset_s failed";
-        return -1;
+    std::unique_ptr<ZeroEngine> fdEngine = nullptr;
+    if (engine == nullptr) {
+        fdEngine = std::make_unique<ZeroEngine>(fd);
+        engine = fdEngine.get();
     }
+    for (const auto &range : blocks_) {
+        size_t count = range.second - range.first;
+        int32_t ret = (isErase && Utils::IsUpdaterMode()) ? engine->Discard(range.first, count) :
+            engine->Zero(range.first, count);
+        if (ret != 0) {
+            LOG(ERROR) << "BlockSet::WriteZeroToBlock Write 0 to block error";
+            return ret;
+        }
+    }
+    return 0;
+}
 
-    auto iter = blocks_.begin();
-    while (iter != blocks_.end()) {
-        off64_t offset = static_cast<off64_t>(iter->first * H_BLOCK_SIZE);
-        int ret = 0;
+// Checkpoints of the patch of a diff command, kept in the store
+struct DiffCheckpoint {
+    std::unique_ptr<PatchCheckpointFile> file {};
+    UpdatePatch::PatchCheckpoint resume {};
+    // target before the resumed checkpoint
+    std::vector<uint8_t> written {};
+    UpdatePatch::PatchCheckpointParam param {};
+};
 
-        if (isErase && Utils::IsUpdaterMode()) {
-#ifndef UPDATER_UT
-            size_t writeSize = (iter->second - iter->first) * H_BLOCK_SIZE;
-            uint64_t arguments[2] = {static_cast<uint64_t>(offset), writeSize};
-            ret = ioctl(fd, BLKDISCARD, &arguments);
-            if (ret == -1 && errno != EOPNOTSUPP) {
-                LOG(ERROR) << "Error to write block set to memory";
-                return -1;
-            }
-#endif
-            iter++;
-            continue;
+static bool ReadTargetPrefix(int fd, const BlockSet &target, std::vector<uint8_t> &buffer)
+{
+    size_t pos = 0;
+    for (size_t i = 0; i < target.CountOfRanges() && pos < buffer.size(); i++) {
+        const BlockPair &bp = target[i];
+        size_t size = std::min((bp.second - bp.first) * H_BLOCK_SIZE, buffer.size() - pos);
+        if (!BlockIo::ReadAt(fd, buffer.data() + pos, size, static_cast<off64_t>(bp.first) * H_BLOCK_SIZE)) {
+            return false;
         }
-        ret = lseek64(fd, offset, SEEK_SET);
-        if (ret == -1) {
-            LOG(ERROR) << "BlockSet::WriteZeroToBlock Fail to seek";
+        pos += size;
+    }
+    return pos == buffer.size();
+}
+
+// Only a target larger than patchCheckpointSize is checkpointed
+static void InitDiffCheckpoint(const Command &cmd, const BlockSet &target, size_t patchLength,
+    DiffCheckpoint &checkpoint)
+{
+    TransferParams *params = cmd.GetTransferParams();
+    size_t targetSize = target.TotalBlockSize() * H_BLOCK_SIZE;
+    if (params->patchCheckpointSize == 0 || targetSize <= params->patchCheckpointSize || params->storeBase.empty()) {
+        return;
+    }
+    std::string tgtHash = cmd.GetArgumentByPos(H_DIFF_CMD_ARGS_START + 1);
+    // commands with the same target hash may run at the same time, each has its own file
+    std::string path = params->storeBase + "/" + tgtHash + "_" + std::to_string(cmd.GetIndex()) + ".checkpoint";
+    checkpoint.file = std::make_unique<PatchCheckpointFile>(path, tgtHash, patchLength);
+    int fd = cmd.GetTargetFileDescriptor();
+    checkpoint.param.interval = params->patchCheckpointSize;
+    checkpoint.param.save = [fd, params, &checkpoint](const UpdatePatch::PatchCheckpoint &point) -> int32_t {
+        WriteBehindQueue *queue = params->writeQueue.get();
+        if (queue != nullptr ? !queue->Flush() : fsync(fd) == -1) {
+            LOG(ERROR) << "Failed to sync target before patch checkpoint";
             return -1;
         }
-        for (size_t pos = iter->first; pos < iter->second; pos++) {
-            if (Utils::WriteFully(fd, buffer.data(), H_BLOCK_SIZE)) {
-                continue;
-            }
-            if (errno == EIO) {
-                return 1;
-            }
-            LOG(ERROR) << "BlockSet::WriteZeroToBlock Write 0 to block error";
-            return -1;
+        // the update goes on without this checkpoint if it is not written
+        if (!checkpoint.file->Save(point)) {
+            LOG(ERROR) << "Failed to save patch checkpoint";
         }
-        iter++;
+        return 0;
+    };
+    if (!checkpoint.file->Load(checkpoint.resume) || checkpoint.resume.newOffset == 0 ||
+        checkpoint.resume.newOffset >= targetSize) {
+        return;
     }
-    return 0;
+    checkpoint.written.resize(static_cast<size_t>(checkpoint.resume.newOffset));
+    if (!ReadTargetPrefix(fd, target, checkpoint.written)) {
+        LOG(WARNING) << "Failed to read target before patch checkpoint, apply the whole patch";
+        checkpoint.written.clear();
+        return;
+    }
+    checkpoint.param.resume = &checkpoint.resume;
+    checkpoint.param.written = {checkpoint.written.data(), checkpoint.written.size()};
 }
 
 int32_t BlockSet::WriteDiffToBlock(const Command &cmd, std::vector<uint8_t> &sourceBuffer, uint8_t *patchBuffer,
                                    size_t patchLength, bool isImgDiff)
 {
     size_t srcBuffSize =  sourceBuffer.size();
-    if (isImgDiff) {
-        std::vector<uint8_t> empty;
-        UpdatePatch::PatchParam patchParam = {sourceBuffer.data(), srcBuffSize, patchBuffer, patchLength};
+    WriteBehindQueue *queue = cmd.GetTransferParams()->writeQueue.get();
+    DiffCheckpoint checkpoint {};
+    InitDiffCheckpoint(cmd, *this, patchLength, checkpoint);
+    auto applyPatch = [&](const UpdatePatch::PatchCheckpointParam &param) -> int32_t {
         std::unique_ptr<BlockWriter> writer = std::make_unique<BlockWriter>(cmd.GetTargetFileDescriptor(), *this);
         if (writer.get() == nullptr) {
             LOG(ERROR) << "Cannot create block writer, pkgdiff patch abort!";
             return -1;
         }
-        int32_t ret = UpdatePatch::UpdateApplyPatch::ApplyImagePatch(patchParam, empty,
-            [&](size_t start, const UpdatePatch::BlockBuffer &data, size_t size) -> int {
-                return (writer->Write(data.buffer, size, nullptr)) ? 0 : -1;
-            }, cmd.GetArgumentByPos(H_DIFF_CMD_ARGS_START + 1));
-        writer.reset();
-        if (ret != 0) {
-            LOG(ERROR) << "Fail to ApplyImagePatch";
+        writer->SetWriteQueue(queue);
+        // the target before the checkpoint is already written
+        if (param.resume != nullptr && !writer->Skip(param.written.length)) {
             return -1;
         }
-    } else {
+        auto processor = [&](size_t start, const UpdatePatch::BlockBuffer &data, size_t size) -> int {
+            return (writer->Write(data.buffer, size, nullptr)) ? 0 : -1;
+        };
+        if (isImgDiff) {
+            std::vector<uint8_t> empty;
+            UpdatePatch::PatchParam patchParam = {sourceBuffer.data(), srcBuffSize, patchBuffer, patchLength};
+            int32_t ret = UpdatePatch::UpdateApplyPatch::ApplyImagePatch(patchParam, empty, processor,
+                cmd.GetArgumentByPos(H_DIFF_CMD_ARGS_START + 1), param);
+            if (ret != 0) {
+                LOG(ERROR) << "Fail to ApplyImagePatch";
+            }
+            return ret;
+        }
         LOG(DEBUG) << "Run bsdiff patch.";
         UpdatePatch::PatchBuffer patchInfo = {patchBuffer, 0, patchLength};
-        std::unique_ptr<BlockWriter> writer = std::make_unique<BlockWriter>(cmd.GetTargetFileDescriptor(), *this);
-        if (writer.get() == nullptr) {
-            LOG(ERROR) << "Cannot create block writer, pkgdiff patch abort!";
-            return -1;
-        }
-        auto ret = UpdatePatch::UpdateApplyPatch::ApplyBlockPatch(patchInfo, {sourceBuffer.data(), srcBuffSize},
-            [&](size_t start, const UpdatePatch::BlockBuffer &data, size_t size) -> int {
-                return (writer->Write(data.buffer, size, nullptr)) ? 0 : -1;
-            }, cmd.GetArgumentByPos(H_DIFF_CMD_ARGS_START + 1));
-        writer.reset();
+        int32_t ret = UpdatePatch::UpdateApplyPatch::ApplyBlockPatch(patchInfo, {sourceBuffer.data(), srcBuffSize},
+            processor, cmd.GetArgumentByPos(H_DIFF_CMD_ARGS_START + 1), param);
         if (ret != 0) {
             LOG(ERROR) << "Fail to ApplyBlockPatch";
-            return -1;
         }
+        return ret;
+    };
+    int32_t ret = applyPatch(checkpoint.param);
+    if (ret != 0 && checkpoint.param.resume != nullptr) {
+        // The source is in memory, so the whole patch can always be applied again.
+        LOG(WARNING) << "Failed to resume patch at checkpoint, apply the whole patch";
+        checkpoint.param.resume = nullptr;
+        checkpoint.param.written = {};
+        ret = applyPatch(checkpoint.param);
+    }
+    if (ret != 0) {
+        return -1;
+    }
+    if (checkpoint.file != nullptr) {
+        checkpoint.file->Remove();
     }
-    if (fsync(cmd.GetTargetFileDescriptor()) == -1) {
+    if (queue == nullptr && fsync(cmd.GetTargetFileDescriptor()) == -1) {
         LOG(ERROR) << "Failed to sync restored data";
         return -1;
     }
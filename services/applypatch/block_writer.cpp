@@ -16,8 +16,10 @@
 #include "applypatch/block_writer.h"
 #include <sys/types.h>
 #include "applypatch/block_set.h"
+#include "block_io.h"
 #include "log/log.h"
 #include "utils.h"
+#include "write_behind_queue.h"
 
 namespace Updater {
 bool BlockWriter::IsWriteDone() const
@@ -35,6 +37,28 @@ size_t BlockWriter::GetTotalWritten() const
     return totalWritten_;
 }
 
+void BlockWriter::EnableDigest()
+{
+    shaCtx_ = std::make_unique<SHA256_CTX>();
+    SHA256_Init(shaCtx_.get());
+}
+
+std::string BlockWriter::GetDigest()
+{
+    if (shaCtx_ == nullptr || !IsWriteDone()) {
+        return "";
+    }
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256_Final(digest, shaCtx_.get());
+    shaCtx_.reset();
+    return Utils::ConvertSha256Hex(digest, SHA256_DIGEST_LENGTH);
+}
+
+void BlockWriter::SetWriteQueue(WriteBehindQueue *queue)
+{
+    queue_ = queue;
+}
+
 bool BlockWriter::Write(const uint8_t *addr, size_t len, [[maybe_unused]] const void *context)
 {
     if (IsWriteDone()) {
@@ -42,6 +66,24 @@ bool BlockWriter::Write(const uint8_t *addr, size_t len, [[maybe_unused]] const
         return false;
     }
     LOG(DEBUG) << "BlockWriter: try to write " << len << " byte(s)";
+    if (addr == nullptr && len > 0) {
+        LOG(ERROR) << "BlockWriter: no data to write";
+        return false;
+    }
+    return Advance(addr, len);
+}
+
+bool BlockWriter::Skip(size_t len)
+{
+    if (len > GetBlocksSize() - totalWritten_) {
+        LOG(ERROR) << "BlockWriter: cannot skip " << len << " byte(s)";
+        return false;
+    }
+    return Advance(nullptr, len);
+}
+
+bool BlockWriter::Advance(const uint8_t *addr, size_t len)
+{
     while (len > 0) {
         // Check if blocks can be written.
         // All blocks are written.
@@ -56,15 +98,10 @@ bool BlockWriter::Write(const uint8_t *addr, size_t len, [[maybe_unused]] const
             // Get next block pair to write.
             const BlockPair &bp = bs_[blockIndex_];
             // where do we start to write.
-            off_t offset = static_cast<off_t>(bp.first) * H_BLOCK_SIZE;
+            currentOffset_ = static_cast<off64_t>(bp.first) * H_BLOCK_SIZE;
             currentBlockLeft_ = (bp.second - bp.first) * H_BLOCK_SIZE;
             LOG(DEBUG) << "Init currentBlockLeft_ = " << currentBlockLeft_;
             blockIndex_++;
-            // Move to right place to write.
-            if (lseek(fd_, offset, SEEK_SET) < 0) {
-                LOG(ERROR) << "BlockWriter: Cannot seek to offset: " << offset << " Block index: " << blockIndex_;
-                return false;
-            }
         } else {
             LOG(DEBUG) << "Current block " << blockIndex_ << " left " << currentBlockLeft_ << " to written.";
         }
@@ -72,12 +109,20 @@ bool BlockWriter::Write(const uint8_t *addr, size_t len, [[maybe_unused]] const
         if (currentBlockLeft_ < len) {
             written = currentBlockLeft_;
         }
-        if (Updater::Utils::WriteFully(fd_, addr, written) == false) {
-            LOG(ERROR) << "BlockWriter: failed to write " << written << " byte(s).";
-            return false;
+        if (addr != nullptr) {
+            bool ret = queue_ != nullptr ? queue_->Submit(addr, written, currentOffset_) :
+                BlockIo::WriteAt(fd_, addr, written, currentOffset_);
+            if (!ret) {
+                LOG(ERROR) << "BlockWriter: failed to write " << written << " byte(s).";
+                return false;
+            }
+            if (shaCtx_ != nullptr) {
+                SHA256_Update(shaCtx_.get(), addr, written);
+            }
+            addr += written;
         }
+        currentOffset_ += static_cast<off64_t>(written);
         len -= written;
-        addr += written;
         currentBlockLeft_ -= written;
         totalWritten_ += written;
     }
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "checkpoint_journal.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "log/log.h"
+#include "securec.h"
+#include "utils.h"
+#include "zlib.h"
+
+namespace Updater {
+// The first byte is not printable, so a retry file holding a plain command line never matches.
+constexpr uint32_t JOURNAL_MAGIC = 0x4C4E52C7;
+constexpr off_t JOURNAL_COMPACT_SIZE = 64 * 1024;
+
+struct JournalRecordHead {
+    uint32_t magic;
+    uint32_t length;
+    uint32_t crc;
+};
+
+CheckpointJournal::~CheckpointJournal()
+{
+    Close();
+}
+
+std::string CheckpointJournal::EncodeRecord(const std::string &cmdLine)
+{
+    JournalRecordHead head {};
+    head.magic = JOURNAL_MAGIC;
+    head.length = static_cast<uint32_t>(cmdLine.size());
+    head.crc = static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef *>(cmdLine.data()), cmdLine.size()));
+    std::string record(reinterpret_cast<const char *>(&head), sizeof(head));
+    record += cmdLine;
+    return record;
+}
+
+std::string CheckpointJournal::ParseRecords(const std::string &content, size_t &validLength, bool &isJournal)
+{
+    JournalRecordHead head {};
+    validLength = 0;
+    isJournal = content.size() >= sizeof(head) &&
+        memcpy_s(&head, sizeof(head), content.data(), sizeof(head)) == EOK && head.magic == JOURNAL_MAGIC;
+    if (!isJournal) {
+        return content;
+    }
+    std::string cmdLine = "";
+    while (content.size() - validLength >= sizeof(head)) {
+        if (memcpy_s(&head, sizeof(head), content.data() + validLength, sizeof(head)) != EOK ||
+            head.magic != JOURNAL_MAGIC || head.length > content.size() - validLength - sizeof(head)) {
+            break;
+        }
+        const char *payload = content.data() + validLength + sizeof(head);
+        if (crc32(0, reinterpret_cast<const Bytef *>(payload), head.length) != head.crc) {
+            break;
+        }
+        cmdLine.assign(payload, head.length);
+        validLength += sizeof(head) + head.length;
+    }
+    if (validLength != content.size()) {
+        LOG(WARNING) << "Drop torn journal record at " << validLength;
+    }
+    return cmdLine;
+}
+
+std::string CheckpointJournal::LoadLastCommand(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG(ERROR) << "Failed to open";
+        return "";
+    }
+    std::string content = "";
+    if (!Utils::ReadFileToString(fd, content)) {
+        LOG(ERROR) << "Error to read retry flag";
+    }
+    close(fd);
+    size_t validLength = 0;
+    bool isJournal = false;
+    return ParseRecords(content, validLength, isJournal);
+}
+
+// Write content to a temporary file and rename it over path, path is intact on failure.
+// The caller syncs the directory to make the rename durable.
+bool CheckpointJournal::ReplaceFile(const std::string &path, const std::string &content)
+{
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        LOG(ERROR) << "Failed to create " << tmpPath;
+        return false;
+    }
+    bool ret = Utils::WriteFully(fd, reinterpret_cast<const uint8_t *>(content.data()), content.size()) &&
+        fsync(fd) == 0;
+    close(fd);
+    if (!ret || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        LOG(ERROR) << "Failed to replace " << path;
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CheckpointJournal::Recover()
+{
+    int fd = open(path_.c_str(), O_RDWR);
+    if (fd < 0) {
+        return errno == ENOENT;
+    }
+    std::string content = "";
+    if (!Utils::ReadFileToString(fd, content)) {
+        LOG(ERROR) << "Error to read retry flag";
+        close(fd);
+        return false;
+    }
+    size_t validLength = 0;
+    bool isJournal = false;
+    std::string cmdLine = ParseRecords(content, validLength, isJournal);
+    if (isJournal) {
+        // Drop a torn tail so that new records stay reachable.
+        bool ret = validLength == content.size() || (ftruncate(fd, validLength) == 0 && fsync(fd) == 0);
+        close(fd);
+        return ret;
+    }
+    close(fd);
+    if (cmdLine.empty()) {
+        return true;
+    }
+    // Convert the single command retry file without ever losing the resume point.
+    if (!ReplaceFile(path_, EncodeRecord(cmdLine)) || !Utils::SyncParentDirectory(path_)) {
+        LOG(ERROR) << "Failed to convert retry flag";
+        return false;
+    }
+    return true;
+}
+
+bool CheckpointJournal::Open(int dataFd, bool isRetry)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    dataFd_ = dataFd;
+    int flags = O_WRONLY | O_CREAT | O_APPEND;
+    if (isRetry) {
+        if (!Recover()) {
+            LOG(ERROR) << "Failed to recover journal " << path_;
+            return false;
+        }
+    } else {
+        flags |= O_TRUNC;
+    }
+    fd_ = open(path_.c_str(), flags, S_IRUSR | S_IWUSR);
+    if (fd_ < 0) {
+        LOG(ERROR) << "Failed to create";
+        return false;
+    }
+    // a journal lost with its directory entry would resume the update from the first command
+    if (!Utils::SyncParentDirectory(path_)) {
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    struct stat st {};
+    journalSize_ = fstat(fd_, &st) == 0 ? st.st_size : 0;
+    return true;
+}
+
+void CheckpointJournal::Close()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) {
+        return;
+    }
+    SyncLocked();
+    LOG(INFO) << "Checkpoint journal " << records_ << " records, " << syncs_ << " syncs";
+    close(fd_);
+    fd_ = -1;
+}
+
+bool CheckpointJournal::Barrier(const CommandNode &node)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pendingCommands_ == 0) {
+        return true;
+    }
+    CommandType type = node.cmd->GetCommandType();
+    if (type == CommandType::FREE || !node.isResolved || pendingBlocks_.IsOverlap(node.tgtBlocks)) {
+        return SyncLocked();
+    }
+    return true;
+}
+
+bool CheckpointJournal::Append(const CommandNode &node)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) {
+        LOG(ERROR) << "Journal is not opened";
+        return false;
+    }
+    lastRecord_ = EncodeRecord(node.cmd->GetCommandLine());
+    buffer_ += lastRecord_;
+    pendingBlocks_ = pendingBlocks_.Union(node.srcBlocks).Union(node.tgtBlocks);
+    pendingCommands_++;
+    pendingWritten_ += node.tgtBlocks.TotalBlockSize();
+    records_++;
+    if (pendingCommands_ >= maxCommands_ || pendingWritten_ >= maxBlocks_) {
+        return SyncLocked();
+    }
+    return true;
+}
+
+bool CheckpointJournal::Sync()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return SyncLocked();
+}
+
+void CheckpointJournal::SetSyncHooks(SyncHook beforeSync, SyncHook afterSync)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    beforeSync_ = beforeSync;
+    afterSync_ = afterSync;
+}
+
+void CheckpointJournal::SetDataSync(DataSync dataSync)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    dataSync_ = dataSync;
+}
+
+bool CheckpointJournal::SyncLocked()
+{
+    if (fd_ < 0 || buffer_.empty()) {
+        return true;
+    }
+    if (beforeSync_ != nullptr) {
+        beforeSync_();
+    }
+    // Blocks written by the recorded commands must be durable before the records.
+    if (dataSync_ != nullptr) {
+        if (!dataSync_()) {
+            LOG(ERROR) << "Failed to sync target, records are not written";
+            return false;
+        }
+    } else if (dataFd_ >= 0 && fsync(dataFd_) != 0) {
+        LOG(ERROR) << "Failed to sync target, records are not written, errno " << errno;
+        return false;
+    }
+    if (afterSync_ != nullptr) {
+        afterSync_();
+    }
+    if (!Utils::WriteFully(fd_, reinterpret_cast<const uint8_t *>(buffer_.data()), buffer_.size()) ||
+        fsync(fd_) != 0) {
+        int err = errno;
+        LOG(ERROR) << "Write retry flag error, errno " << err;
+        // Keep the records pending and drop what may have reached the journal.
+        (void)ftruncate(fd_, journalSize_);
+        errno = err;
+        return false;
+    }
+    journalSize_ += static_cast<off_t>(buffer_.size());
+    syncs_++;
+    buffer_.clear();
+    pendingBlocks_ = BlockSet();
+    pendingCommands_ = 0;
+    pendingWritten_ = 0;
+    return journalSize_ < JOURNAL_COMPACT_SIZE || Compact();
+}
+
+// Rewrite the journal to its last record, only that one is read on retry
+bool CheckpointJournal::Compact()
+{
+    if (!ReplaceFile(path_, lastRecord_)) {
+        // The journal that was synced is still in place
+        LOG(WARNING) << "Failed to compact journal " << path_;
+        return true;
+    }
+    close(fd_);
+    fd_ = open(path_.c_str(), O_WRONLY | O_APPEND);
+    if (fd_ < 0) {
+        LOG(ERROR) << "Failed to reopen journal " << path_;
+        return false;
+    }
+    journalSize_ = static_cast<off_t>(lastRecord_.size());
+    // records appended from now on must not be lost to the old journal coming back
+    return Utils::SyncParentDirectory(path_);
+}
+} // namespace Updater
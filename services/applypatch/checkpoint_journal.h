@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef UPDATER_CHECKPOINT_JOURNAL_H
+#define UPDATER_CHECKPOINT_JOURNAL_H
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include "applypatch/block_set.h"
+#include "command_scheduler.h"
+
+namespace Updater {
+/*
+ * Append-only journal of completed transfer.list commands, used as the retry
+ * checkpoint. Records are synced in groups: after maxCommands records or
+ * maxBlocks written blocks, and before a command that would overwrite blocks
+ * read or written by a command whose record is not synced yet, or free a
+ * stash it may need when it is run again after a reboot. Once the journal is
+ * large, it is rewritten to the last synced record.
+ */
+class CheckpointJournal {
+public:
+    using SyncHook = std::function<void()>;
+    using DataSync = std::function<bool()>;
+
+    CheckpointJournal(const std::string &path, size_t maxCommands, size_t maxBlocks)
+        : path_(path), maxCommands_(maxCommands), maxBlocks_(maxBlocks) {}
+    ~CheckpointJournal();
+
+    // Last completed command in the journal, or in a retry file of the single command format
+    static std::string LoadLastCommand(const std::string &path);
+
+    bool Open(int dataFd, bool isRetry);
+    void Close();
+    // Called before a command is executed
+    bool Barrier(const CommandNode &node);
+    // Called when a command is committed in list order
+    bool Append(const CommandNode &node);
+    bool Sync();
+    // Run around the sync of the target blocks that precedes each group of records
+    void SetSyncHooks(SyncHook beforeSync, SyncHook afterSync);
+    // Replace the fsync of the target blocks, the records are not written when it fails
+    void SetDataSync(DataSync dataSync);
+
+private:
+    CheckpointJournal(const CheckpointJournal&) = delete;
+    const CheckpointJournal& operator=(const CheckpointJournal&) = delete;
+
+    static std::string ParseRecords(const std::string &content, size_t &validLength, bool &isJournal);
+    static std::string EncodeRecord(const std::string &cmdLine);
+    static bool ReplaceFile(const std::string &path, const std::string &content);
+    bool Recover();
+    bool Compact();
+    bool SyncLocked();
+
+    std::string path_ {};
+    size_t maxCommands_ { 0 };
+    size_t maxBlocks_ { 0 };
+    int fd_ { -1 };
+    int dataFd_ { -1 };
+    std::mutex mutex_ {};
+    std::string buffer_ {};
+    std::string lastRecord_ {};
+    off_t journalSize_ { 0 };
+    // blocks touched by commands whose records are not synced yet
+    BlockSet pendingBlocks_ {};
+    size_t pendingCommands_ { 0 };
+    size_t pendingWritten_ { 0 };
+    size_t records_ { 0 };
+    size_t syncs_ { 0 };
+    SyncHook beforeSync_ {};
+    SyncHook afterSync_ {};
+    DataSync dataSync_ {};
+};
+} // namespace Updater
+#endif // UPDATER_CHECKPOINT_JOURNAL_H
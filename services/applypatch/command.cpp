@@ -90,6 +90,26 @@ bool Command::IsStreamCmd() const
     return isStreamCmd_;
 }
 
+void Command::SetFreeStash(const std::string &stash) const
+{
+    freeStash_ = stash;
+}
+
+std::string Command::GetFreeStash() const
+{
+    return freeStash_;
+}
+
+void Command::SetIndex(size_t index)
+{
+    index_ = index;
+}
+
+size_t Command::GetIndex() const
+{
+    return index_;
+}
+
 TransferParams* Command::GetTransferParams() const
 {
     return transferParams_;
@@ -28,9 +28,12 @@
 #include "applypatch/data_writer.h"
 #include "applypatch/store.h"
 #include "applypatch/transfer_manager.h"
+#include "applied_bitmap.h"
 #include "log/log.h"
 #include "securec.h"
 #include "utils.h"
+#include "write_behind_queue.h"
+#include "zero_engine.h"
 
 using namespace Hpackage;
 using namespace Updater::Utils;
@@ -52,6 +55,7 @@ CommandResult NewCommandFn::Execute(const Command &params)
     auto writerThreadInfo = params.GetTransferParams()->writerThreadInfo.get();
     pthread_mutex_lock(&writerThreadInfo->mutex);
     writerThreadInfo->writer = std::make_unique<BlockWriter>(params.GetTargetFileDescriptor(), bs);
+    writerThreadInfo->writer->SetWriteQueue(params.GetTransferParams()->writeQueue.get());
     pthread_cond_broadcast(&writerThreadInfo->cond);
     while (writerThreadInfo->writer != nullptr) {
         LOG(DEBUG) << "wait for new data write done...";
@@ -83,7 +87,12 @@ int32_t NewCommandFn::StreamExecute(const Command &params)
     LOG(INFO) << "StreamExecute size:" << size << " cmd:" << params.GetCommandLine();
     BlockSet bs;
     bs.ParserAndInsert(params.GetArgumentByPos(pos++));
+    WriteBehindQueue *queue = params.GetTransferParams()->writeQueue.get();
     std::unique_ptr<BlockWriter> writer = std::make_unique<BlockWriter>(params.GetTargetFileDescriptor(), bs);
+    writer->SetWriteQueue(queue);
+    if (!params.GetTransferParams()->isParanoidVerify) {
+        writer->EnableDigest();
+    }
     while (size > 0) {
         size_t toWrite = std::min(size, writer->GetBlocksSize() - writer->GetTotalWritten());
         LOG(INFO) << "StreamExecute toWrite:" << toWrite;
@@ -98,18 +107,25 @@ int32_t NewCommandFn::StreamExecute(const Command &params)
         size -= toWrite;
         addr += toWrite;
     }
-    size_t tgtBlockSize = bs.TotalBlockSize() * H_BLOCK_SIZE;
-    std::vector<uint8_t> tgtBuffer(tgtBlockSize);
-
-    if (bs.ReadDataFromBlock(params.GetTargetFileDescriptor(), tgtBuffer) == 0) {
-        LOG(ERROR) << "Read data from block error, TotalBlockSize: " << bs.TotalBlockSize();
-        return -1;
+    std::string digest = writer->GetDigest();
+    bool isSameHash = digest == tgtHash;
+    if (digest.empty()) {
+        // Paranoid mode, or the data did not cover every block: hash what the device returns.
+        size_t tgtBlockSize = bs.TotalBlockSize() * H_BLOCK_SIZE;
+        std::vector<uint8_t> tgtBuffer(tgtBlockSize);
+        if (queue != nullptr && !queue->Wait(bs)) {
+            return -1;
+        }
+        if (bs.ReadDataFromBlock(params.GetTargetFileDescriptor(), tgtBuffer) == 0) {
+            LOG(ERROR) << "Read data from block error, TotalBlockSize: " << bs.TotalBlockSize();
+            return -1;
+        }
+        isSameHash = bs.VerifySha256(tgtBuffer, bs.TotalBlockSize(), tgtHash) == 0;
     }
-    if (bs.VerifySha256(tgtBuffer, bs.TotalBlockSize(), tgtHash) == 0) {
+    if (isSameHash) {
         LOG(ERROR) << "Will write same sha256 blocks to target, no need to write";
         return -1;
     }
-    std::vector<uint8_t>().swap(tgtBuffer);
     return 0;
 }
 
@@ -137,13 +153,21 @@ CommandResult ZeroAndEraseCommandFn::Execute(const Command &params)
     BlockSet blk;
     blk.ParserAndInsert(params.GetArgumentByPos(1));
     LOG(INFO) << "Parser params to block set";
-    auto ret = CommandResult(blk.WriteZeroToBlock(params.GetTargetFileDescriptor(), isErase));
+    auto ret = CommandResult(blk.WriteZeroToBlock(params.GetTargetFileDescriptor(), isErase,
+        params.GetTransferParams()->zeroEngine.get()));
     if (ret == SUCCESS && !isErase) {
         params.GetTransferParams()->written += blk.TotalBlockSize();
     }
     return ret;
 }
 
+// A command never started by an earlier attempt cannot have written its target yet.
+static bool IsTargetUntouched(const Command &params)
+{
+    std::shared_ptr<AppliedBitmap> bitmap = params.GetTransferParams()->appliedBitmap;
+    return bitmap != nullptr && bitmap->IsUntouched(params.GetIndex());
+}
+
 bool LoadTarget(const Command &params, size_t &pos, std::vector<uint8_t> &buffer,
     BlockSet &targetBlock, CommandResult &result)
 {
@@ -162,7 +186,7 @@ bool LoadTarget(const Command &params, size_t &pos, std::vector<uint8_t> &buffer
     // Read the target's buffer to determine whether it needs to be written
     std::string cmdTmp = params.GetArgumentByPos(pos++);
     targetBlock.ParserAndInsert(cmdTmp);
-    if (type != CommandType::COPY) {
+    if (type != CommandType::COPY && !IsTargetUntouched(params)) {
         size_t tgtBlockSize = targetBlock.TotalBlockSize() * H_BLOCK_SIZE;
         std::vector<uint8_t> tgtBuffer(tgtBlockSize);
 
@@ -244,26 +268,33 @@ CommandResult DiffAndMoveCommandFn::Execute(const Command &params)
             offset = Utils::String2Int<size_t>(params.GetArgumentByPos(pos++), Utils::N_DEC);
         }
         size_t patchLength = Utils::String2Int<size_t>(params.GetArgumentByPos(pos++), Utils::N_DEC);
-        if (Utils::IsUpdaterMode() || params.IsStreamCmd()) {
+        // patch.dat is only extracted to a file outside updater mode when it is compressed
+        if (Utils::IsUpdaterMode() || params.IsStreamCmd() || params.GetTransferParams()->patchDatFile.empty()) {
             uint8_t *patchBuffer = params.GetTransferParams()->dataBuffer + offset;
             ret = WriteDiffToBlock(params, buffer, patchBuffer, patchLength, targetBlock);
         } else {
             ret = WriteFileToBlock(params, buffer, offset, patchLength, targetBlock);
         }
     } else {
-        ret = targetBlock.WriteDataToBlock(params.GetTargetFileDescriptor(), buffer) == 0 ? -1 : 0;
+        ret = targetBlock.WriteDataToBlock(params.GetTargetFileDescriptor(), buffer,
+            params.GetTransferParams()->writeQueue.get()) == 0 ? -1 : 0;
     }
     if (ret != 0) {
         LOG(ERROR) << "fail to write block data.";
         return errno == EIO ? NEED_RETRY : FAILED;
     }
-    std::string storeBase = params.GetTransferParams()->storeBase;
-    std::string freeStash = params.GetTransferParams()->freeStash;
+    std::string freeStash = params.GetFreeStash();
+    WriteBehindQueue *queue = params.GetTransferParams()->writeQueue.get();
+    if (!freeStash.empty() && queue != nullptr && !queue->Flush()) {
+        // The stash holds the overwritten source until the target is durable.
+        LOG(ERROR) << "fail to sync block data.";
+        return errno == EIO ? NEED_RETRY : FAILED;
+    }
     if (!freeStash.empty()) {
-        if (Store::FreeStore(storeBase, freeStash) != 0) {
+        if (Store::FreeStash(*params.GetTransferParams(), freeStash) != 0) {
             LOG(WARNING) << "fail to delete file: " << freeStash;
         }
-        params.GetTransferParams()->freeStash.clear();
+        params.SetFreeStash("");
     }
     params.GetTransferParams()->written += targetBlock.TotalBlockSize();
     return SUCCESS;
@@ -272,9 +303,8 @@ CommandResult DiffAndMoveCommandFn::Execute(const Command &params)
 CommandResult FreeCommandFn::Execute(const Command &params)
 {
     std::string shaStr = params.GetArgumentByPos(1);
-    std::string storeBase = params.GetTransferParams()->storeBase;
     if (params.GetTransferParams()->storeCreated == 0) {
-        return CommandResult(Store::FreeStore(storeBase, shaStr));
+        return CommandResult(Store::FreeStash(*params.GetTransferParams(), shaStr));
     }
     return SUCCESS;
 }
@@ -291,7 +321,7 @@ CommandResult StashCommandFn::Execute(const Command &params)
     buffer.resize(srcBlockSize * H_BLOCK_SIZE);
     std::string storeBase = params.GetTransferParams()->storeBase;
     LOG(DEBUG) << "Confirm whether the block is stored";
-    if (Store::LoadDataFromStore(storeBase, shaStr, buffer) == 0) {
+    if (Store::LoadStash(*params.GetTransferParams(), shaStr, buffer) == 0) {
         LOG(INFO) << "The stash has been stored, skipped";
         return SUCCESS;
     }
@@ -309,7 +339,7 @@ CommandResult StashCommandFn::Execute(const Command &params)
         return SUCCESS;
     }
     LOG(INFO) << "store " << srcBlockSize << " blocks to " << storeBase << "/" << shaStr;
-    int ret = Store::WriteDataToStore(storeBase, shaStr, buffer, srcBlockSize * H_BLOCK_SIZE);
+    int ret = Store::SaveStash(*params.GetTransferParams(), shaStr, buffer, srcBlk);
     return CommandResult(ret);
 }
 } // namespace Updater
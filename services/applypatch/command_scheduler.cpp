@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "command_scheduler.h"
+#include <algorithm>
+#include "log/log.h"
+#include "utils.h"
+
+namespace Updater {
+constexpr size_t MOVE_SRC_HASH_POS = 1;
+constexpr size_t MOVE_TGT_POS = 2;
+constexpr size_t MOVE_SRC_POS = 4;
+constexpr size_t DIFF_SRC_HASH_POS = 3;
+constexpr size_t DIFF_TGT_POS = 5;
+constexpr size_t DIFF_SRC_POS = 7;
+constexpr size_t COPY_TGT_POS = 1;
+constexpr size_t COPY_SRC_POS = 3;
+constexpr size_t BLOCKS_TGT_POS = 1;
+
+CommandScheduler::~CommandScheduler()
+{
+    StopWorkers();
+}
+
+bool CommandScheduler::IsParallelCommand(CommandType type)
+{
+    return type == CommandType::MOVE || type == CommandType::BSDIFF ||
+        type == CommandType::IMGDIFF || type == CommandType::ZERO;
+}
+
+static bool HasStash(const std::vector<std::string> &stashes, const std::string &id)
+{
+    return std::find(stashes.begin(), stashes.end(), id) != stashes.end();
+}
+
+bool CommandScheduler::IsConflict(CommandNode &first, CommandNode &second)
+{
+    if (first.isBarrier || second.isBarrier) {
+        return true;
+    }
+    if (first.tgtBlocks.IsOverlap(second.tgtBlocks) || first.tgtBlocks.IsOverlap(second.srcBlocks) ||
+        first.srcBlocks.IsOverlap(second.tgtBlocks)) {
+        return true;
+    }
+    for (const auto &id : first.stashWrites) {
+        if (HasStash(second.stashReads, id) || HasStash(second.stashWrites, id)) {
+            return true;
+        }
+    }
+    for (const auto &id : second.stashWrites) {
+        if (HasStash(first.stashReads, id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CommandScheduler::CollectSourceResources(const Command &cmd, size_t pos, CommandNode &node)
+{
+    std::string srcArg = cmd.GetArgumentByPos(pos++);
+    if (srcArg.empty()) {
+        return false;
+    }
+    if (srcArg != "-") {
+        if (!node.srcBlocks.ParserAndInsert(srcArg)) {
+            return false;
+        }
+        if (cmd.GetArgumentByPos(pos).empty()) {
+            return true;
+        }
+        // skip the locations of source blocks in the buffer
+        pos++;
+    }
+    for (std::string arg = cmd.GetArgumentByPos(pos++); !arg.empty(); arg = cmd.GetArgumentByPos(pos++)) {
+        std::vector<std::string> tokens = Utils::SplitString(arg, ":");
+        if (tokens.size() != H_CMD_ARGS_LIMIT) {
+            return false;
+        }
+        node.stashReads.push_back(tokens[H_ZERO_NUMBER]);
+    }
+    return true;
+}
+
+void CommandScheduler::CollectResources(CommandNode &node)
+{
+    const Command &cmd = *node.cmd;
+    CommandType type = cmd.GetCommandType();
+    std::string srcHash = "";
+    bool ret = true;
+    switch (type) {
+        case CommandType::NEW:
+        case CommandType::ZERO:
+        case CommandType::ERASE:
+            ret = node.tgtBlocks.ParserAndInsert(cmd.GetArgumentByPos(BLOCKS_TGT_POS));
+            break;
+        case CommandType::COPY:
+            ret = node.tgtBlocks.ParserAndInsert(cmd.GetArgumentByPos(COPY_TGT_POS)) &&
+                CollectSourceResources(cmd, COPY_SRC_POS, node);
+            break;
+        case CommandType::MOVE:
+            srcHash = cmd.GetArgumentByPos(MOVE_SRC_HASH_POS);
+            ret = node.tgtBlocks.ParserAndInsert(cmd.GetArgumentByPos(MOVE_TGT_POS)) &&
+                CollectSourceResources(cmd, MOVE_SRC_POS, node);
+            break;
+        case CommandType::BSDIFF:
+        case CommandType::IMGDIFF:
+            srcHash = cmd.GetArgumentByPos(DIFF_SRC_HASH_POS);
+            ret = node.tgtBlocks.ParserAndInsert(cmd.GetArgumentByPos(DIFF_TGT_POS)) &&
+                CollectSourceResources(cmd, DIFF_SRC_POS, node);
+            break;
+        default:
+            break;
+    }
+    node.isResolved = ret;
+    node.isBarrier = !IsParallelCommand(type);
+    if (!ret) {
+        // Let a malformed command run alone and report its own error.
+        LOG(WARNING) << "Cannot resolve resources of " << cmd.GetCommandHead() << ", run it serially";
+        node.isBarrier = true;
+        return;
+    }
+    if (!srcHash.empty()) {
+        // The source may be loaded from, or stashed under, its own hash.
+        node.stashReads.push_back(srcHash);
+        if (node.srcBlocks.IsOverlap(node.tgtBlocks)) {
+            node.stashWrites.push_back(srcHash);
+        }
+    }
+}
+
+void CommandScheduler::ComputeDependency(size_t index)
+{
+    CommandNode &node = *nodes_[index];
+    if (node.isBarrier) {
+        node.lastDependency = index;
+        return;
+    }
+    // Commands before the window are committed by the time this one can be dispatched.
+    size_t begin = index > MAX_SCHEDULE_WINDOW ? index - MAX_SCHEDULE_WINDOW : 0;
+    for (size_t i = index; i > begin; i--) {
+        if (IsConflict(*nodes_[i - 1], node)) {
+            node.lastDependency = i;
+            return;
+        }
+    }
+    node.lastDependency = 0;
+}
+
+void CommandScheduler::AddCommand(std::unique_ptr<Command> cmd)
+{
+    std::unique_ptr<CommandNode> node = std::make_unique<CommandNode>();
+    node->cmd = std::move(cmd);
+    CollectResources(*node);
+    nodes_.push_back(std::move(node));
+    ComputeDependency(nodes_.size() - 1);
+}
+
+void CommandScheduler::Dispatch(std::unique_lock<std::mutex> &lock)
+{
+    size_t end = std::min({ nodes_.size(), cursor_ + MAX_SCHEDULE_WINDOW, failedIndex_ });
+    for (size_t i = cursor_; i < end; i++) {
+        CommandNode &node = *nodes_[i];
+        if (node.started || node.lastDependency > cursor_) {
+            continue;
+        }
+        node.started = true;
+        if (node.isBarrier) {
+            // Every earlier command is committed and no later one can start.
+            lock.unlock();
+            CommandResult result = execute_(node);
+            lock.lock();
+            node.result = result;
+            node.done = true;
+            if (result != SUCCESS) {
+                failedIndex_ = std::min(failedIndex_, i);
+            }
+            return;
+        }
+        inFlight_++;
+        readyQueue_.push_back(i);
+        workerCond_.notify_one();
+    }
+}
+
+bool CommandScheduler::Commit(std::unique_lock<std::mutex> &lock)
+{
+    while (cursor_ < nodes_.size() && nodes_[cursor_]->done) {
+        CommandNode &node = *nodes_[cursor_];
+        lock.unlock();
+        bool ret = commit_(node, node.result);
+        lock.lock();
+        if (!ret) {
+            return false;
+        }
+        cursor_++;
+    }
+    return true;
+}
+
+void CommandScheduler::WorkerRun()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        workerCond_.wait(lock, [this] { return stop_ || !readyQueue_.empty(); });
+        if (readyQueue_.empty()) {
+            return;
+        }
+        size_t index = readyQueue_.front();
+        readyQueue_.pop_front();
+        CommandNode &node = *nodes_[index];
+        lock.unlock();
+        CommandResult result = execute_(node);
+        lock.lock();
+        node.result = result;
+        node.done = true;
+        if (result != SUCCESS) {
+            failedIndex_ = std::min(failedIndex_, index);
+        }
+        inFlight_--;
+        doneCond_.notify_all();
+    }
+}
+
+void CommandScheduler::StopWorkers()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+        workerCond_.notify_all();
+        doneCond_.wait(lock, [this] { return inFlight_ == 0; });
+    }
+    for (auto &worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+}
+
+bool CommandScheduler::Run()
+{
+    if (nodes_.empty()) {
+        return true;
+    }
+    cursor_ = 0;
+    inFlight_ = 0;
+    failedIndex_ = nodes_.size();
+    stop_ = false;
+    size_t workerCount = std::max(std::min(workerCount_, nodes_.size()), static_cast<size_t>(1));
+    LOG(INFO) << "Schedule " << nodes_.size() << " commands on " << workerCount << " workers";
+    for (size_t i = 0; i < workerCount; i++) {
+        workers_.emplace_back([this] { WorkerRun(); });
+    }
+
+    bool ret = true;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (cursor_ < nodes_.size()) {
+            Dispatch(lock);
+            if (!Commit(lock)) {
+                ret = false;
+                break;
+            }
+            // Only wait for a running command, otherwise dispatch again with the new cursor.
+            if (cursor_ < nodes_.size() && nodes_[cursor_]->started && !nodes_[cursor_]->done) {
+                doneCond_.wait(lock);
+            }
+        }
+    }
+    StopWorkers();
+    return ret;
+}
+} // namespace Updater
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef UPDATER_COMMAND_SCHEDULER_H
+#define UPDATER_COMMAND_SCHEDULER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "applypatch/block_set.h"
+#include "applypatch/command.h"
+#include "applypatch/command_const.h"
+
+namespace Updater {
+// A parsed transfer.list command together with the resources it touches.
+struct CommandNode {
+    std::unique_ptr<Command> cmd {};
+    BlockSet srcBlocks {};
+    BlockSet tgtBlocks {};
+    std::vector<std::string> stashReads {};
+    std::vector<std::string> stashWrites {};
+    // false if the blocks of the command could not be parsed
+    bool isResolved { false };
+    // barrier commands run alone, after every earlier command is committed
+    bool isBarrier { true };
+    // index + 1 of the latest earlier command this one conflicts with, 0 if none
+    size_t lastDependency { 0 };
+    bool started { false };
+    bool done { false };
+    CommandResult result { SUCCESS };
+};
+
+/*
+ * Runs transfer.list commands on a bounded worker pool. A command starts once
+ * every earlier command it conflicts with (overlapping source/target blocks or
+ * a shared stash) has been committed, and commands are committed strictly in
+ * list order, so the device content and the retry checkpoint are the same as
+ * for serial execution.
+ */
+class CommandScheduler {
+public:
+    using ExecuteFunc = std::function<CommandResult(CommandNode &)>;
+    using CommitFunc = std::function<bool(CommandNode &, CommandResult)>;
+    static constexpr size_t MAX_SCHEDULE_WINDOW = 128;
+
+    CommandScheduler(size_t workerCount, ExecuteFunc execute, CommitFunc commit)
+        : workerCount_(workerCount), execute_(execute), commit_(commit) {}
+    ~CommandScheduler();
+
+    void AddCommand(std::unique_ptr<Command> cmd);
+    bool Run();
+
+    static bool IsParallelCommand(CommandType type);
+    static bool IsConflict(CommandNode &first, CommandNode &second);
+    static void CollectResources(CommandNode &node);
+
+private:
+    CommandScheduler(const CommandScheduler&) = delete;
+    const CommandScheduler& operator=(const CommandScheduler&) = delete;
+
+    static bool CollectSourceResources(const Command &cmd, size_t pos, CommandNode &node);
+    void ComputeDependency(size_t index);
+    void Dispatch(std::unique_lock<std::mutex> &lock);
+    bool Commit(std::unique_lock<std::mutex> &lock);
+    void WorkerRun();
+    void StopWorkers();
+
+    size_t workerCount_ { 0 };
+    ExecuteFunc execute_ {};
+    CommitFunc commit_ {};
+    std::vector<std::unique_ptr<CommandNode>> nodes_ {};
+    std::vector<std::thread> workers_ {};
+    std::deque<size_t> readyQueue_ {};
+    std::mutex mutex_ {};
+    std::condition_variable workerCond_ {};
+    std::condition_variable doneCond_ {};
+    size_t cursor_ { 0 };
+    size_t inFlight_ { 0 };
+    // index of the earliest failed command, nodes_.size() while all succeed
+    size_t failedIndex_ { 0 };
+    bool stop_ { false };
+};
+} // namespace Updater
+#endif // UPDATER_COMMAND_SCHEDULER_H
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "patch_checkpoint_file.h"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "log/log.h"
+#include "securec.h"
+#include "utils.h"
+#include "zlib.h"
+
+namespace Updater {
+constexpr uint32_t PATCH_CHECKPOINT_MAGIC = 0x50434B50;
+
+struct PatchCheckpointHead {
+    uint32_t magic;
+    uint32_t crc;
+    uint64_t patchLength;
+    char tgtHash[SHA256_DIGEST_LENGTH * 2];
+};
+
+static uint32_t CheckpointCrc(const PatchCheckpointHead &head, const UpdatePatch::PatchCheckpoint &checkpoint)
+{
+    uLong crc = crc32(0, reinterpret_cast<const Bytef *>(&head.patchLength),
+        sizeof(head.patchLength) + sizeof(head.tgtHash));
+    return static_cast<uint32_t>(crc32(crc, reinterpret_cast<const Bytef *>(&checkpoint), sizeof(checkpoint)));
+}
+
+bool PatchCheckpointFile::Load(UpdatePatch::PatchCheckpoint &checkpoint) const
+{
+    int fd = open(path_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::string content = "";
+    bool ret = Utils::ReadFileToString(fd, content);
+    close(fd);
+    PatchCheckpointHead head {};
+    if (!ret || content.size() != sizeof(head) + sizeof(checkpoint) ||
+        memcpy_s(&head, sizeof(head), content.data(), sizeof(head)) != EOK ||
+        memcpy_s(&checkpoint, sizeof(checkpoint), content.data() + sizeof(head), sizeof(checkpoint)) != EOK) {
+        LOG(WARNING) << "Invalid patch checkpoint " << path_;
+        return false;
+    }
+    if (head.magic != PATCH_CHECKPOINT_MAGIC || head.patchLength != patchLength_ ||
+        tgtHash_.compare(0, std::string::npos, head.tgtHash, sizeof(head.tgtHash)) != 0 ||
+        head.crc != CheckpointCrc(head, checkpoint)) {
+        LOG(WARNING) << "Patch checkpoint does not match command";
+        return false;
+    }
+    LOG(INFO) << "Patch checkpoint loaded, " << checkpoint.newOffset << " bytes of target written";
+    return true;
+}
+
+bool PatchCheckpointFile::Save(const UpdatePatch::PatchCheckpoint &checkpoint) const
+{
+    PatchCheckpointHead head { PATCH_CHECKPOINT_MAGIC, 0, patchLength_, {} };
+    if (memcpy_s(head.tgtHash, sizeof(head.tgtHash), tgtHash_.data(),
+        std::min(tgtHash_.size(), sizeof(head.tgtHash))) != EOK) {
+        return false;
+    }
+    head.crc = CheckpointCrc(head, checkpoint);
+    std::string tmpPath = path_ + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    bool ret = fd >= 0 && Utils::WriteFully(fd, reinterpret_cast<const uint8_t *>(&head), sizeof(head)) &&
+        Utils::WriteFully(fd, reinterpret_cast<const uint8_t *>(&checkpoint), sizeof(checkpoint)) && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (ret && rename(tmpPath.c_str(), path_.c_str()) == 0) {
+        return true;
+    }
+    // An older checkpoint is still right, the target before it is not written again.
+    LOG(ERROR) << "Failed to write patch checkpoint, errno " << errno;
+    unlink(tmpPath.c_str());
+    return false;
+}
+
+void PatchCheckpointFile::Remove() const
+{
+    unlink(path_.c_str());
+}
+} // namespace Updater
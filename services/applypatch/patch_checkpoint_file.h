@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef UPDATER_PATCH_CHECKPOINT_FILE_H
+#define UPDATER_PATCH_CHECKPOINT_FILE_H
+
+#include <string>
+#include "patch/update_patch.h"
+
+namespace Updater {
+/*
+ * Checkpoint of a diff command with a large target, kept in the store while
+ * its patch is applied. An interrupted attempt leaves the last one behind, so
+ * the retry only hashes the target before it and applies the rest of the patch.
+ */
+class PatchCheckpointFile {
+public:
+    PatchCheckpointFile(const std::string &path, const std::string &tgtHash, size_t patchLength)
+        : path_(path), tgtHash_(tgtHash), patchLength_(patchLength) {}
+    ~PatchCheckpointFile() = default;
+
+    // Load the checkpoint of an interrupted attempt at the same patch, false if there is none
+    bool Load(UpdatePatch::PatchCheckpoint &checkpoint) const;
+    // The target before checkpoint.newOffset must be synced
+    bool Save(const UpdatePatch::PatchCheckpoint &checkpoint) const;
+    void Remove() const;
+
+private:
+    std::string path_ {};
+    std::string tgtHash_ {};
+    size_t patchLength_ { 0 };
+};
+} // namespace Updater
+#endif // UPDATER_PATCH_CHECKPOINT_FILE_H
@@ -17,6 +17,7 @@
 #include <cstdio>
 #include <string>
 #include <unistd.h>
+#include "block_io.h"
 #include "log/log.h"
 
 namespace Updater {
@@ -56,24 +57,10 @@ bool RawWriter::Write(const uint8_t *addr, size_t len, [[maybe_unused]] const vo
 
 int RawWriter::WriteInternal(int fd, const uint8_t *data, size_t len)
 {
-    ssize_t written = 0;
-    size_t rest = len;
-
-    int ret = lseek64(fd, offset_, SEEK_SET);
-    if (ret == -1) {
-        LOG(ERROR) << "RawWriter: failed to seek file to " << offset_ << " : " << strerror(errno);
+    if (!BlockIo::WriteAt(fd, data, len, offset_)) {
+        LOG(ERROR) << "RawWriter: failed to write data of len " << len;
         return -1;
     }
-
-    while (rest > 0) {
-        written = write(fd, data, rest);
-        if (written < 0) {
-            LOG(ERROR) << "RawWriter: failed to write data of len " << len << " : " << strerror(errno);
-            return -1;
-        }
-        data += written;
-        rest -= static_cast<size_t>(written);
-    }
     offset_ += static_cast<off64_t>(len);
     return 0;
 }
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stash_cache.h"
+#include <limits>
+#include "applypatch/store.h"
+#include "log/log.h"
+#include "utils.h"
+
+namespace Updater {
+constexpr size_t NO_MORE_USE = std::numeric_limits<size_t>::max();
+
+StashCache::~StashCache()
+{
+    LOG(INFO) << "Stash cache " << hits_ << " hits, " << spills_ << " spills, " << entries_.size() << " left";
+}
+
+void StashCache::AddUses(const Command &cmd, size_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Stashes are read through "id:ranges" arguments, no other argument has a colon.
+    size_t pos = 1;
+    for (std::string arg = cmd.GetArgumentByPos(pos++); !arg.empty(); arg = cmd.GetArgumentByPos(pos++)) {
+        std::vector<std::string> tokens = Utils::SplitString(arg, ":");
+        if (tokens.size() == H_CMD_ARGS_LIMIT) {
+            uses_[tokens[H_ZERO_NUMBER]].push_back(index);
+        }
+    }
+}
+
+void StashCache::SetPosition(size_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    position_ = index;
+}
+
+size_t StashCache::NextUse(const std::string &id)
+{
+    auto it = uses_.find(id);
+    if (it == uses_.end()) {
+        return NO_MORE_USE;
+    }
+    while (!it->second.empty() && it->second.front() < position_) {
+        it->second.pop_front();
+    }
+    return it->second.empty() ? NO_MORE_USE : it->second.front();
+}
+
+int32_t StashCache::PersistLocked(const std::string &id, StashEntry &entry)
+{
+    if (entry.isPersisted) {
+        return 0;
+    }
+    int32_t ret = Store::WriteStashToStore(storeBase_, id, entry.data, isCompress_);
+    if (ret != 0) {
+        LOG(ERROR) << "Failed to write stash " << id << " to store";
+        return ret;
+    }
+    entry.isPersisted = true;
+    return 0;
+}
+
+int32_t StashCache::EvictLocked(size_t size, size_t nextUse)
+{
+    while (used_ + size > limit_) {
+        auto victim = entries_.end();
+        size_t farthest = nextUse;
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            size_t use = NextUse(it->first);
+            if (use > farthest) {
+                farthest = use;
+                victim = it;
+            }
+        }
+        if (victim == entries_.end()) {
+            // The new stash is needed last, leave it to the caller.
+            return 0;
+        }
+        int32_t ret = PersistLocked(victim->first, victim->second);
+        if (ret != 0) {
+            return ret;
+        }
+        used_ -= victim->second.data.size();
+        entries_.erase(victim);
+        spills_++;
+    }
+    return 0;
+}
+
+int32_t StashCache::Save(const std::string &id, const std::vector<uint8_t> &buffer, const BlockSet &source)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.find(id) != entries_.end()) {
+        return 0;
+    }
+    if (buffer.size() <= limit_) {
+        int32_t ret = EvictLocked(buffer.size(), NextUse(id));
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    if (used_ + buffer.size() > limit_) {
+        spills_++;
+        return Store::WriteStashToStore(storeBase_, id, buffer, isCompress_);
+    }
+    StashEntry &entry = entries_[id];
+    entry.data = buffer;
+    entry.source = source;
+    used_ += buffer.size();
+    return 0;
+}
+
+int32_t StashCache::Load(const std::string &id, std::vector<uint8_t> &buffer)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(id);
+        if (it != entries_.end()) {
+            buffer = it->second.data;
+            hits_++;
+            return 0;
+        }
+    }
+    return Store::LoadDataFromStore(storeBase_, id, buffer);
+}
+
+int32_t StashCache::Free(const std::string &id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    uses_.erase(id);
+    auto it = entries_.find(id);
+    if (it == entries_.end()) {
+        return Store::FreeStore(storeBase_, id);
+    }
+    bool isPersisted = it->second.isPersisted;
+    used_ -= it->second.data.size();
+    entries_.erase(it);
+    return isPersisted ? Store::FreeStore(storeBase_, id) : 0;
+}
+
+int32_t StashCache::Persist(const BlockSet &blocks)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : entries_) {
+        if (entry.second.isPersisted || !entry.second.source.IsOverlap(blocks)) {
+            continue;
+        }
+        int32_t ret = PersistLocked(entry.first, entry.second);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+int32_t StashCache::PersistAll()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : entries_) {
+        int32_t ret = PersistLocked(entry.first, entry.second);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+} // namespace Updater
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef UPDATER_STASH_CACHE_H
+#define UPDATER_STASH_CACHE_H
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "applypatch/block_set.h"
+#include "applypatch/command.h"
+
+namespace Updater {
+/*
+ * Keeps stashes of a block update in memory up to a byte budget. A stash is
+ * written to the store directory only when it has to survive a reboot, that
+ * is before any of its source blocks get overwritten, or when it is evicted.
+ * The stash whose next use in the transfer list is the farthest is evicted
+ * first.
+ */
+class StashCache {
+public:
+    StashCache(const std::string &storeBase, size_t limit, bool isCompress = false)
+        : storeBase_(storeBase), limit_(limit), isCompress_(isCompress) {}
+    ~StashCache();
+
+    // Record the stashes read by the command at index of the transfer list
+    void AddUses(const Command &cmd, size_t index);
+    // Commands before index are completed, their stash uses no longer count
+    void SetPosition(size_t index);
+    // Returns 0 on success, 1 on io error and -1 on other failures, as Store::WriteStashToStore
+    int32_t Save(const std::string &id, const std::vector<uint8_t> &buffer, const BlockSet &source);
+    int32_t Load(const std::string &id, std::vector<uint8_t> &buffer);
+    int32_t Free(const std::string &id);
+    // Write every stash read from blocks to the store before they are overwritten
+    int32_t Persist(const BlockSet &blocks);
+    int32_t PersistAll();
+
+private:
+    StashCache(const StashCache&) = delete;
+    const StashCache& operator=(const StashCache&) = delete;
+
+    struct StashEntry {
+        std::vector<uint8_t> data {};
+        BlockSet source {};
+        bool isPersisted { false };
+    };
+
+    size_t NextUse(const std::string &id);
+    int32_t PersistLocked(const std::string &id, StashEntry &entry);
+    int32_t EvictLocked(size_t size, size_t nextUse);
+
+    std::string storeBase_ {};
+    size_t limit_ { 0 };
+    bool isCompress_ { false };
+    size_t used_ { 0 };
+    size_t position_ { 0 };
+    std::mutex mutex_ {};
+    std::unordered_map<std::string, StashEntry> entries_ {};
+    // pending uses of every stash, in list order
+    std::unordered_map<std::string, std::deque<size_t>> uses_ {};
+    size_t hits_ { 0 };
+    size_t spills_ { 0 };
+};
+} // namespace Updater
+#endif // UPDATER_STASH_CACHE_H
@@ -23,11 +23,60 @@
 #include <unistd.h>
 #include "applypatch/transfer_manager.h"
 #include "log/log.h"
+#include "lz4.h"
+#include "securec.h"
+#include "stash_cache.h"
 #include "utils.h"
 
 using namespace Updater::Utils;
 
 namespace Updater {
+constexpr uint32_t STASH_LZ4_MAGIC = 0x345A5453;
+const std::string STASH_POOL_NAME = "stash_pool";
+
+struct StashFileHead {
+    uint32_t magic;
+    uint32_t rawSize;
+    uint32_t dataSize;
+};
+
+// Compressed stashes live in a pool next to the stores of all partitions and are linked into each store.
+static std::string GetPoolPath(const std::string &dirPath)
+{
+    std::string::size_type pos = dirPath.find_last_of('/');
+    if (pos == std::string::npos) {
+        return STASH_POOL_NAME;
+    }
+    return dirPath.substr(0, pos + 1) + STASH_POOL_NAME;
+}
+
+// The pool holds a link of its own, the file is dropped when no store links it any more.
+static void ReleasePoolFile(const std::string &poolFile)
+{
+    struct stat fileStat {};
+    if (stat(poolFile.c_str(), &fileStat) == 0 && fileStat.st_nlink <= 1 && DeleteFile(poolFile) != 0) {
+        LOG(WARNING) << "Failed to delete " << poolFile;
+    }
+}
+
+static void ReleasePool(const std::string &dirPath)
+{
+    std::vector<std::string> files;
+    if (GetFilesFromDirectory(GetPoolPath(dirPath), files) <= 0) {
+        return;
+    }
+    for (const auto &file : files) {
+        ReleasePoolFile(file);
+    }
+}
+
+static bool IsCompressedStash(const std::vector<uint8_t> &data, StashFileHead &head)
+{
+    return data.size() >= sizeof(head) && memcpy_s(&head, sizeof(head), data.data(), sizeof(head)) == EOK &&
+        head.magic == STASH_LZ4_MAGIC && head.dataSize == data.size() - sizeof(head) &&
+        head.rawSize % H_BLOCK_SIZE == 0;
+}
+
 void Store::DoFreeSpace(const std::string &directoryPath)
 {
     std::vector<std::string> files;
@@ -41,6 +90,7 @@ void Store::DoFreeSpace(const std::string &directoryPath)
             continue;
         }
     }
+    ReleasePool(directoryPath);
 }
 
 int32_t Store::FreeStore(const std::string &dirPath, const std::string &fileName)
@@ -50,6 +100,7 @@ int32_t Store::FreeStore(const std::string &dirPath, const std::string &fileName
     }
     std::string path = dirPath + "/" + fileName;
     if (DeleteFile(path.c_str()) != -1) {
+        ReleasePoolFile(GetPoolPath(dirPath) + "/" + fileName);
         return 0;
     }
     LOG(ERROR) << "Failed to delete " << path;
@@ -92,6 +143,7 @@ int32_t Store::CreateNewSpace(const std::string &path, bool needClear)
             iter++;
         }
         files.clear();
+        ReleasePool(path);
     }
     return 0;
 }
@@ -150,18 +202,14 @@ int32_t Store::LoadDataFromStore(const std::string &dirPath, const std::string &
         LOG(DEBUG) << "Failed to stat";
         return -1;
     }
-    if (fileStat.st_size % H_BLOCK_SIZE != 0) {
-        LOG(ERROR) << "Not multiple of block size 4096";
-        return -1;
-    }
 
     int fd = open(path.c_str(), O_RDONLY);
     if (fd == -1) {
         LOG(ERROR) << "Failed to create";
         return -1;
     }
-    buffer.resize(fileStat.st_size);
-    if (!ReadFully(fd, buffer.data(), fileStat.st_size)) {
+    std::vector<uint8_t> data(fileStat.st_size);
+    if (!ReadFully(fd, data.data(), fileStat.st_size)) {
         LOG(ERROR) << "Failed to read store data";
         close(fd);
         fd = -1;
@@ -169,6 +217,112 @@ int32_t Store::LoadDataFromStore(const std::string &dirPath, const std::string &
     }
     close(fd);
     fd = -1;
+    StashFileHead head {};
+    if (IsCompressedStash(data, head)) {
+        buffer.resize(head.rawSize);
+        int size = LZ4_decompress_safe(reinterpret_cast<const char *>(data.data() + sizeof(head)),
+            reinterpret_cast<char *>(buffer.data()), static_cast<int>(head.dataSize), static_cast<int>(head.rawSize));
+        if (size < 0 || static_cast<uint32_t>(size) != head.rawSize) {
+            LOG(ERROR) << "Failed to decompress " << path;
+            return -1;
+        }
+        return 0;
+    }
+    if (fileStat.st_size % H_BLOCK_SIZE != 0) {
+        LOG(ERROR) << "Not multiple of block size 4096";
+        return -1;
+    }
+    buffer.swap(data);
     return 0;
 }
+
+int32_t Store::WriteCompressedToStore(const std::string &dirPath, const std::string &fileName,
+    const std::vector<uint8_t> &buffer)
+{
+    if (dirPath.empty() || fileName.empty() || buffer.size() > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+        return -1;
+    }
+    std::string poolPath = GetPoolPath(dirPath);
+    std::string poolFile = poolPath + "/" + fileName;
+    struct stat fileStat {};
+    // Stashes are named by the sha256 of their content, so an existing pool file is the same stash.
+    if (stat(poolFile.c_str(), &fileStat) == -1) {
+        if (MkdirRecursive(poolPath, S_IRWXU) != 0) {
+            LOG(ERROR) << "Failed to make stash pool";
+            return -1;
+        }
+        StashFileHead head { STASH_LZ4_MAGIC, static_cast<uint32_t>(buffer.size()), 0 };
+        std::vector<uint8_t> data(sizeof(head) + LZ4_compressBound(static_cast<int>(buffer.size())));
+        int size = LZ4_compress_default(reinterpret_cast<const char *>(buffer.data()),
+            reinterpret_cast<char *>(data.data() + sizeof(head)), static_cast<int>(buffer.size()),
+            static_cast<int>(data.size() - sizeof(head)));
+        if (size <= 0) {
+            LOG(ERROR) << "Failed to compress stash " << fileName;
+            return -1;
+        }
+        head.dataSize = static_cast<uint32_t>(size);
+        if (memcpy_s(data.data(), data.size(), &head, sizeof(head)) != EOK) {
+            LOG(ERROR) << "memcpy_s failed";
+            return -1;
+        }
+        // A torn pool file must never be linked, write it aside first.
+        std::string tmpName = fileName + ".tmp";
+        int32_t ret = WriteDataToStore(poolPath, tmpName, data, static_cast<int>(sizeof(head)) + size);
+        if (ret != 0) {
+            return ret;
+        }
+        if (rename((poolPath + "/" + tmpName).c_str(), poolFile.c_str()) != 0) {
+            LOG(ERROR) << "Failed to rename stash " << fileName << ", " << strerror(errno);
+            return -1;
+        }
+        if (!SyncParentDirectory(poolFile)) {
+            return -1;
+        }
+        LOG(INFO) << "Compress stash " << fileName << " from " << buffer.size() << " to " << size;
+    }
+    std::string path = dirPath + "/" + fileName;
+    if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+        LOG(ERROR) << "Failed to delete " << path;
+        return -1;
+    }
+    if (link(poolFile.c_str(), path.c_str()) != 0) {
+        LOG(ERROR) << "Failed to link stash " << fileName << ", " << strerror(errno);
+        return -1;
+    }
+    return SyncParentDirectory(path) ? 0 : -1;
+}
+
+int32_t Store::WriteStashToStore(const std::string &dirPath, const std::string &fileName,
+    const std::vector<uint8_t> &buffer, bool isCompress)
+{
+    if (isCompress) {
+        return WriteCompressedToStore(dirPath, fileName, buffer);
+    }
+    return WriteDataToStore(dirPath, fileName, buffer, static_cast<int>(buffer.size()));
+}
+
+int32_t Store::SaveStash(const TransferParams &params, const std::string &id,
+    const std::vector<uint8_t> &buffer, const BlockSet &source)
+{
+    if (params.stashCache != nullptr) {
+        return params.stashCache->Save(id, buffer, source);
+    }
+    return WriteStashToStore(params.storeBase, id, buffer, params.compressStash);
+}
+
+int32_t Store::LoadStash(const TransferParams &params, const std::string &id, std::vector<uint8_t> &buffer)
+{
+    if (params.stashCache != nullptr) {
+        return params.stashCache->Load(id, buffer);
+    }
+    return LoadDataFromStore(params.storeBase, id, buffer);
+}
+
+int32_t Store::FreeStash(const TransferParams &params, const std::string &id)
+{
+    if (params.stashCache != nullptr) {
+        return params.stashCache->Free(id);
+    }
+    return FreeStore(params.storeBase, id);
+}
 } // namespace Updater
@@ -13,19 +13,28 @@
  * limitations under the License.
  */
 #include "applypatch/transfer_manager.h"
+#include <algorithm>
 #include <fcntl.h>
+#include <iterator>
 #include <sstream>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "applypatch/command_function.h"
+#include "applied_bitmap.h"
+#include "checkpoint_journal.h"
+#include "command_scheduler.h"
 #include "log/log.h"
+#include "stash_cache.h"
 #include "updater/updater_const.h"
 #include "utils.h"
+#include "write_behind_queue.h"
+#include "zero_engine.h"
 #include "applypatch/update_progress.h"
 #include "thread_pool.h"
 
 namespace Updater {
 using namespace Updater::Utils;
+constexpr const char *APPLIED_BITMAP_FILE = "applied_bitmap";
 
 TransferManager::TransferManager()
 {
@@ -33,23 +42,36 @@ TransferManager::TransferManager()
     transferParams_->writerThreadInfo = std::make_unique<WriterThreadInfo>();
 }
 
-bool TransferManager::CommandsExecute(int fd, Command &cmd)
+TransferManager::~TransferManager()
+{
+    journal_.reset();
+}
+
+CommandResult TransferManager::ExecuteCommand(int fd, Command &cmd)
 {
     cmd.SetSrcFileDescriptor(fd);
     cmd.SetTargetFileDescriptor(fd);
     CommandFunction* cf = CommandFunctionFactory::GetInstance().GetCommandFunction(cmd.GetCommandHead());
     if (cf == nullptr) {
         LOG(ERROR) << "Failed to get cmd exec";
-        return false;
-    }
-    CommandResult ret = cf->Execute(cmd);
-    if (!cmd.GetTransferParams()->canWrite) {
-        return ret == SUCCESS;
+        return FAILED;
     }
-    if (!CheckResult(ret, cmd.GetCommandLine(), cmd.GetCommandType())) {
+    return cf->Execute(cmd);
+}
+
+bool TransferManager::CommandsExecute(int fd, Command &cmd)
+{
+    if (CommandFunctionFactory::GetInstance().GetCommandFunction(cmd.GetCommandHead()) == nullptr) {
+        LOG(ERROR) << "Failed to get cmd exec";
         return false;
     }
-    return true;
+    return ExecuteCommand(fd, cmd) == SUCCESS;
+}
+
+// Commands that hash their target first and are skipped when it is already written
+static bool IsTargetHashed(CommandType type)
+{
+    return type == CommandType::MOVE || type == CommandType::BSDIFF || type == CommandType::IMGDIFF;
 }
 
 static bool JudgeBlockVerifyCmdType(Command &cmd)
@@ -89,6 +111,180 @@ bool TransferManager::CommandParserPreCheck(const std::vector<std::string> &cont
     return true;
 }
 
+void TransferManager::KeepStashForRetry(std::unique_ptr<Command> cmd,
+    std::vector<std::unique_ptr<Command>> &stashCmds)
+{
+    // Stashes cached in memory were lost on reboot, so stash again the ones not freed before the checkpoint.
+    if (cmd->GetCommandType() == CommandType::STASH) {
+        stashCmds.push_back(std::move(cmd));
+    } else if (cmd->GetCommandType() == CommandType::FREE) {
+        std::string id = cmd->GetArgumentByPos(1);
+        stashCmds.erase(std::remove_if(stashCmds.begin(), stashCmds.end(),
+            [&id](const std::unique_ptr<Command> &stashCmd) { return stashCmd->GetArgumentByPos(1) == id; }),
+            stashCmds.end());
+    }
+}
+
+CommandResult TransferManager::PersistStash(const CommandNode &node)
+{
+    if (transferParams_->stashCache == nullptr) {
+        return SUCCESS;
+    }
+    int32_t ret = node.isResolved ? transferParams_->stashCache->Persist(node.tgtBlocks) :
+        transferParams_->stashCache->PersistAll();
+    return CommandResult(ret);
+}
+
+CommandResult TransferManager::WaitForWrites(const CommandNode &node)
+{
+    std::shared_ptr<WriteBehindQueue> queue = transferParams_->writeQueue;
+    if (queue == nullptr) {
+        return SUCCESS;
+    }
+    bool ret = true;
+    if (node.cmd->GetCommandType() == CommandType::FREE) {
+        // A retry needs the stash again until the blocks written from it are durable.
+        ret = queue->Flush();
+    } else if (node.isBarrier) {
+        ret = queue->Drain();
+    } else {
+        // Blocks read or overwritten by the command must not be behind in the queue.
+        ret = queue->Wait(node.srcBlocks) && queue->Wait(node.tgtBlocks);
+    }
+    if (!ret) {
+        LOG(ERROR) << "Failed to write blocks before " << node.cmd->GetCommandHead();
+        return errno == EIO ? NEED_RETRY : FAILED;
+    }
+    return SUCCESS;
+}
+
+CommandResult TransferManager::ExecuteNode(int fd, CommandNode &node)
+{
+    // Blocks read by commands that are not checkpointed yet must not be overwritten before.
+    if (!journal_->Barrier(node)) {
+        LOG(ERROR) << "Failed to sync checkpoint before " << node.cmd->GetCommandHead();
+        return errno == EIO ? NEED_RETRY : FAILED;
+    }
+    CommandResult result = PersistStash(node);
+    if (result != SUCCESS) {
+        LOG(ERROR) << "Failed to persist stashes before " << node.cmd->GetCommandHead();
+        return result;
+    }
+    result = WaitForWrites(node);
+    if (result != SUCCESS) {
+        return result;
+    }
+    std::shared_ptr<AppliedBitmap> bitmap = transferParams_->appliedBitmap;
+    if (bitmap != nullptr) {
+        bitmap->Start(node.cmd->GetIndex());
+    }
+    result = ExecuteCommand(fd, *node.cmd);
+    if (result == SUCCESS && bitmap != nullptr && IsTargetHashed(node.cmd->GetCommandType())) {
+        bitmap->SetApplied(node.cmd->GetIndex());
+    }
+    return result;
+}
+
+void TransferManager::InitAppliedBitmap(size_t count)
+{
+    if (!transferParams_->canWrite || transferParams_->storeBase.empty()) {
+        return;
+    }
+    auto bitmap = std::make_shared<AppliedBitmap>(transferParams_->storeBase + "/" + APPLIED_BITMAP_FILE, count);
+    if (transferParams_->env != nullptr && transferParams_->env->IsRetry()) {
+        bitmap->Load();
+    }
+    transferParams_->appliedBitmap = bitmap;
+}
+
+void TransferManager::InitWriteQueue(int fd)
+{
+    if (transferParams_->writeBehindSize == 0 || !transferParams_->canWrite) {
+        return;
+    }
+    auto queue = std::make_shared<WriteBehindQueue>(fd, transferParams_->writeBehindSize);
+    if (!queue->Start()) {
+        LOG(WARNING) << "Write behind is not available, write in place";
+        return;
+    }
+    transferParams_->writeQueue = queue;
+    // The queued blocks are synced only before the retry checkpoint moves past them.
+    WriteBehindQueue *rawQueue = queue.get();
+    journal_->SetDataSync([rawQueue] { return rawQueue->Flush(); });
+}
+
+bool TransferManager::CommandsSchedule(int fd, std::vector<std::unique_ptr<Command>> &cmds, size_t totalSize)
+{
+    journal_ = std::make_unique<CheckpointJournal>(transferParams_->retryFile, transferParams_->checkpointCommands,
+        transferParams_->checkpointBlocks);
+    bool hasCheckpoint = !transferParams_->retryFile.empty();
+    if (!hasCheckpoint) {
+        LOG(WARNING) << "Retry checkpoint is not configured";
+    } else if (!journal_->Open(fd, transferParams_->env != nullptr && transferParams_->env->IsRetry())) {
+        LOG(ERROR) << "Failed to open retry checkpoint " << transferParams_->retryFile;
+        return false;
+    }
+    if (transferParams_->stashCacheSize > 0) {
+        transferParams_->stashCache = std::make_shared<StashCache>(transferParams_->storeBase,
+            transferParams_->stashCacheSize, transferParams_->compressStash);
+        for (size_t i = 0; i < cmds.size(); i++) {
+            transferParams_->stashCache->AddUses(*cmds[i], i);
+        }
+    }
+    std::shared_ptr<AppliedBitmap> bitmap = transferParams_->appliedBitmap;
+    if (bitmap != nullptr) {
+        // Only commands completed before the target blocks are synced count as applied.
+        journal_->SetSyncHooks([bitmap] { bitmap->Snapshot(); }, [bitmap] { bitmap->Persist(); });
+    }
+    InitWriteQueue(fd);
+    transferParams_->zeroEngine = std::make_shared<ZeroEngine>(fd);
+    size_t initBlock = transferParams_->written;
+    size_t committed = 0;
+    CommandScheduler scheduler(std::max(transferParams_->workerCount, static_cast<size_t>(1)),
+        [this, fd](CommandNode &node) { return ExecuteNode(fd, node); },
+        [this, &initBlock, &committed, totalSize, hasCheckpoint](CommandNode &node, CommandResult result) {
+            if (!CheckResult(result, node.cmd->GetCommandLine(), node.cmd->GetCommandType())) {
+                LOG(ERROR) << "Running command : " << node.cmd->GetCommandLine() << " fail";
+                return false;
+            }
+            if (transferParams_->stashCache != nullptr) {
+                transferParams_->stashCache->SetPosition(++committed);
+            }
+            if (hasCheckpoint && node.cmd->GetCommandType() != CommandType::NEW && !RegisterForRetry(node)) {
+                LOG(ERROR) << "Failed to checkpoint command : " << node.cmd->GetCommandLine();
+                CheckResult(errno == EIO ? NEED_RETRY : FAILED, node.cmd->GetCommandLine(),
+                    node.cmd->GetCommandType());
+                return false;
+            }
+            if (totalSize != 0 && (transferParams_->written - initBlock) > 0) {
+                UpdateProgress(initBlock, totalSize);
+            }
+            return true;
+        });
+    for (auto &cmd : cmds) {
+        if (CommandFunctionFactory::GetInstance().GetCommandFunction(cmd->GetCommandHead()) == nullptr) {
+            LOG(ERROR) << "Failed to get cmd exec of " << cmd->GetCommandLine();
+            return false;
+        }
+        scheduler.AddCommand(std::move(cmd));
+    }
+    bool ret = scheduler.Run();
+    // Commands completed before a failure stay checkpointed.
+    journal_->Close();
+    if (transferParams_->writeQueue != nullptr) {
+        if (!transferParams_->writeQueue->Flush()) {
+            LOG(ERROR) << "Failed to sync written blocks";
+            ret = false;
+        }
+        journal_->SetDataSync(nullptr);
+        transferParams_->writeQueue.reset();
+    }
+    transferParams_->stashCache.reset();
+    transferParams_->appliedBitmap.reset();
+    transferParams_->zeroEngine.reset();
+    return ret;
+}
+
 bool TransferManager::CommandsParser(int fd, const std::vector<std::string> &context)
 {
     if (!CommandParserPreCheck(context)) {
@@ -99,7 +295,9 @@ bool TransferManager::CommandsParser(int fd, const std::vector<std::string> &con
     std::vector<std::string>::const_iterator ct = context.begin();
     ct = InitCommandParser(ct, retryCmd);
     size_t totalSize = transferParams_->blockCount;
-    size_t initBlock = 0;
+    std::vector<std::unique_ptr<Command>> cmds;
+    std::vector<std::unique_ptr<Command>> stashCmds;
+    InitAppliedBitmap(context.size());
     for (; ct != context.end(); ct++) {
         std::unique_ptr<Command> cmd = std::make_unique<Command>(transferParams_.get());
         if (cmd == nullptr) {
@@ -109,31 +307,43 @@ bool TransferManager::CommandsParser(int fd, const std::vector<std::string> &con
         if (!cmd->Init(*ct) || transferParams_->env == nullptr) {
             continue;
         }
+        cmd->SetIndex(static_cast<size_t>(ct - context.begin()));
         if (!retryCmd.empty() && transferParams_->env->IsRetry()) {
             if (*ct == retryCmd) {
                 retryCmd.clear();
             }
             if (cmd->GetCommandType() != CommandType::NEW) {
                 LOG(INFO) << "Retry: Command " << *ct << " passed";
+                if (transferParams_->canWrite && transferParams_->stashCacheSize > 0) {
+                    KeepStashForRetry(std::move(cmd), stashCmds);
+                }
+                if (retryCmd.empty()) {
+                    std::move(stashCmds.begin(), stashCmds.end(), std::back_inserter(cmds));
+                    stashCmds.clear();
+                }
                 continue;
             }
         }
-        if (!transferParams_->canWrite && !JudgeBlockVerifyCmdType(*cmd)) {
+        if (transferParams_->canWrite) {
+            if (transferParams_->appliedBitmap != nullptr && IsTargetHashed(cmd->GetCommandType()) &&
+                transferParams_->appliedBitmap->IsApplied(cmd->GetIndex())) {
+                LOG(INFO) << "Retry: Command " << *ct << " applied";
+                continue;
+            }
+            cmds.push_back(std::move(cmd));
+            continue;
+        }
+        // Verification runs serially and does not touch the retry checkpoint.
+        if (!JudgeBlockVerifyCmdType(*cmd)) {
             continue;
         }
         if (!CommandsExecute(fd, *cmd)) {
             LOG(ERROR) << "Running command : " << cmd->GetCommandLine() << " fail";
             return false;
         }
-        if (!transferParams_->canWrite) {
-            continue;
-        }
-        if (initBlock == 0) {
-            initBlock = transferParams_->written;
-        }
-        if (totalSize != 0 && (transferParams_->written - initBlock) > 0) {
-            UpdateProgress(initBlock, totalSize);
-        }
+    }
+    if (transferParams_->canWrite && !CommandsSchedule(fd, cmds, totalSize)) {
+        return false;
     }
     if (fabs(Uscript::GetScriptProportion() - 1.0f) < 1e-6) {
         FillUpdateProgress();
@@ -149,47 +359,24 @@ void TransferManager::UpdateProgress(size_t &initBlock, size_t totalSize)
     initBlock = transferParams_->written;
 }
 
-bool TransferManager::RegisterForRetry(const std::string &cmd)
+bool TransferManager::RegisterForRetry(const CommandNode &node)
 {
-    std::string path = transferParams_->retryFile;
-    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-    if (fd == -1) {
+    if (journal_ == nullptr) {
         LOG(ERROR) << "Failed to create";
         return false;
     }
-    bool ret = Utils::WriteStringToFile(fd, cmd);
-    if (ret == false) {
-        LOG(ERROR) << "Write retry flag error";
-    }
-    fsync(fd);
-    close(fd);
-    return ret;
+    return journal_->Append(node);
 }
 
 std::string TransferManager::ReloadForRetry() const
 {
-    std::string path = transferParams_->retryFile;
-    int fd = open(path.c_str(), O_RDONLY);
-    if (fd < 0) {
-        LOG(ERROR) << "Failed to open";
-        return "";
-    }
-    (void)lseek(fd, 0, SEEK_SET);
-    std::string cmd = "";
-    if (!Utils::ReadFileToString(fd, cmd)) {
-        LOG(ERROR) << "Error to read retry flag";
-    }
-    close(fd);
-    return cmd;
+    return CheckpointJournal::LoadLastCommand(transferParams_->retryFile);
 }
 
 bool TransferManager::CheckResult(const CommandResult result, const std::string &cmd, const CommandType &type)
 {
     switch (result) {
         case SUCCESS:
-            if (type != CommandType::NEW) {
-                RegisterForRetry(cmd);
-            }
             break;
         case NEED_RETRY:
             LOG(INFO) << "IO failed. Running command need retry!";
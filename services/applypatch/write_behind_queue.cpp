@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "write_behind_queue.h"
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include "block_io.h"
+#include "log/log.h"
+
+namespace Updater {
+WriteBehindQueue::~WriteBehindQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        queueCond_.notify_all();
+    }
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+    LOG(INFO) << "Write behind " << written_ << " bytes, " << syncs_ << " syncs";
+}
+
+bool WriteBehindQueue::Start()
+{
+    if (fd_ < 0) {
+        LOG(ERROR) << "Invalid fd for write behind";
+        return false;
+    }
+    worker_ = std::thread([this] { WorkerRun(); });
+    return true;
+}
+
+void WriteBehindQueue::WorkerRun()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        // Queued writes are finished before the worker stops.
+        queueCond_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+        if (requests_.empty()) {
+            return;
+        }
+        WriteRequest &request = requests_.front();
+        bool ret = true;
+        if (error_ == 0) {
+            lock.unlock();
+            ret = BlockIo::WriteAt(fd_, request.data.data(), request.data.size(), request.offset);
+            int err = errno;
+            lock.lock();
+            if (!ret) {
+                LOG(ERROR) << "Failed to write " << request.data.size() << " bytes at " << request.offset <<
+                    ", errno " << err;
+                error_ = err == 0 ? EIO : err;
+            }
+        }
+        written_ += ret ? request.data.size() : 0;
+        inFlight_ -= request.data.size();
+        completed_ = request.seq;
+        requests_.pop_front();
+        doneCond_.notify_all();
+    }
+}
+
+bool WriteBehindQueue::Submit(const uint8_t *data, size_t len, off64_t offset)
+{
+    if (len == 0) {
+        return true;
+    }
+    WriteRequest request {};
+    request.data.assign(data, data + len);
+    request.offset = offset;
+    size_t first = static_cast<size_t>(offset) / H_BLOCK_SIZE;
+    size_t last = (static_cast<size_t>(offset) + len + H_BLOCK_SIZE - 1) / H_BLOCK_SIZE;
+    request.blocks = BlockSet(std::vector<BlockPair> { { first, last } });
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    // A write larger than the limit is let through alone.
+    doneCond_.wait(lock, [this, len] { return error_ != 0 || inFlight_ == 0 || inFlight_ + len <= limit_; });
+    if (error_ != 0) {
+        errno = error_;
+        return false;
+    }
+    request.seq = ++submitted_;
+    inFlight_ += len;
+    requests_.push_back(std::move(request));
+    queueCond_.notify_one();
+    return true;
+}
+
+bool WriteBehindQueue::WaitLocked(std::unique_lock<std::mutex> &lock, size_t seq)
+{
+    doneCond_.wait(lock, [this, seq] { return error_ != 0 || completed_ >= seq; });
+    if (error_ != 0) {
+        errno = error_;
+        return false;
+    }
+    return true;
+}
+
+bool WriteBehindQueue::Wait(const BlockSet &blocks)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t seq = 0;
+    for (const auto &request : requests_) {
+        if (request.blocks.IsOverlap(blocks)) {
+            seq = request.seq;
+        }
+    }
+    return WaitLocked(lock, seq);
+}
+
+bool WriteBehindQueue::Drain()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return WaitLocked(lock, submitted_);
+}
+
+bool WriteBehindQueue::Flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t seq = submitted_;
+    if (!WaitLocked(lock, seq)) {
+        return false;
+    }
+    if (synced_ >= seq) {
+        return true;
+    }
+    lock.unlock();
+    int ret = fsync(fd_);
+    int err = errno;
+    lock.lock();
+    if (ret != 0) {
+        LOG(ERROR) << "Failed to sync written blocks, errno " << err;
+        error_ = err;
+        errno = err;
+        return false;
+    }
+    synced_ = std::max(synced_, seq);
+    syncs_++;
+    return true;
+}
+} // namespace Updater
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef UPDATER_WRITE_BEHIND_QUEUE_H
+#define UPDATER_WRITE_BEHIND_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+#include "applypatch/block_set.h"
+
+namespace Updater {
+/*
+ * Writes blocks of a device in the background, in the order they are queued.
+ * Queued data is copied and the writer blocks once limit bytes are in flight.
+ * Nothing is synced until Flush, so the caller syncs only where crash
+ * consistency needs it: before a checkpoint and before data that a retry
+ * would need again is dropped. Blocks must be waited for before they are read
+ * or written by other means. A failed write fails every later call with its
+ * errno.
+ */
+class WriteBehindQueue {
+public:
+    WriteBehindQueue(int fd, size_t limit) : fd_(fd), limit_(limit) {}
+    ~WriteBehindQueue();
+
+    bool Start();
+    bool Submit(const uint8_t *data, size_t len, off64_t offset);
+    // Wait until the queued writes to any of blocks are on the device
+    bool Wait(const BlockSet &blocks);
+    // Wait until every queued write is on the device
+    bool Drain();
+    // Drain and sync the device, the sync is skipped when nothing was written since the last one
+    bool Flush();
+
+private:
+    WriteBehindQueue(const WriteBehindQueue&) = delete;
+    const WriteBehindQueue& operator=(const WriteBehindQueue&) = delete;
+
+    struct WriteRequest {
+        std::vector<uint8_t> data {};
+        off64_t offset { 0 };
+        BlockSet blocks {};
+        size_t seq { 0 };
+    };
+
+    void WorkerRun();
+    bool WaitLocked(std::unique_lock<std::mutex> &lock, size_t seq);
+
+    int fd_ { -1 };
+    size_t limit_ { 0 };
+    std::mutex mutex_ {};
+    std::condition_variable queueCond_ {};
+    std::condition_variable doneCond_ {};
+    // requests are popped once written, the front one is being written
+    std::deque<WriteRequest> requests_ {};
+    size_t inFlight_ { 0 };
+    size_t submitted_ { 0 };
+    size_t completed_ { 0 };
+    size_t synced_ { 0 };
+    int error_ { 0 };
+    bool stop_ { false };
+    std::thread worker_ {};
+    size_t written_ { 0 };
+    size_t syncs_ { 0 };
+};
+} // namespace Updater
+#endif // UPDATER_WRITE_BEHIND_QUEUE_H
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "zero_engine.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include "applypatch/block_set.h"
+#include "block_io.h"
+#include "log/log.h"
+#include "securec.h"
+
+namespace Updater {
+ZeroEngine::ZeroEngine(int fd) : fd_(fd), buffer_(nullptr, free)
+{
+    struct stat st {};
+    if (fstat(fd, &st) == 0 && S_ISBLK(st.st_mode)) {
+        isBlockDevice_ = true;
+        canZeroOut_ = true;
+    }
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, H_BLOCK_SIZE, ZERO_BUFFER_SIZE) == 0) {
+        (void)memset_s(buffer, ZERO_BUFFER_SIZE, 0, ZERO_BUFFER_SIZE);
+        buffer_.reset(static_cast<uint8_t *>(buffer));
+    }
+    LOG(INFO) << "Zero engine, block device " << isBlockDevice_;
+}
+
+bool ZeroEngine::RangeIoctl(unsigned long request, off64_t offset, size_t size, std::atomic<bool> &isSupported)
+{
+    if (!isSupported) {
+        return false;
+    }
+    uint64_t range[2] = { static_cast<uint64_t>(offset), static_cast<uint64_t>(size) };
+    if (ioctl(fd_, request, &range) == 0) {
+        return true;
+    }
+    int err = errno;
+    LOG(WARNING) << "Range ioctl " << request << " failed at " << offset << ", errno " << err;
+    // Not supported by the device, write the zeroes instead from now on.
+    if (err == EOPNOTSUPP || err == ENOTTY || err == EINVAL) {
+        isSupported = false;
+    }
+    return false;
+}
+
+int32_t ZeroEngine::WriteZero(off64_t offset, size_t size)
+{
+    if (buffer_ == nullptr) {
+        LOG(ERROR) << "Failed to allocate zero buffer";
+        return -1;
+    }
+    while (size > 0) {
+        size_t len = std::min(size, ZERO_BUFFER_SIZE);
+        if (!BlockIo::WriteAt(fd_, buffer_.get(), len, offset)) {
+            return errno == EIO ? 1 : -1;
+        }
+        offset += static_cast<off64_t>(len);
+        size -= len;
+    }
+    return 0;
+}
+
+int32_t ZeroEngine::Zero(size_t block, size_t count)
+{
+    off64_t offset = static_cast<off64_t>(block) * H_BLOCK_SIZE;
+    size_t size = count * H_BLOCK_SIZE;
+    if (RangeIoctl(BLKZEROOUT, offset, size, canZeroOut_)) {
+        return 0;
+    }
+    return WriteZero(offset, size);
+}
+
+int32_t ZeroEngine::Discard(size_t block, size_t count)
+{
+    if (!isBlockDevice_) {
+        return 0;
+    }
+    uint64_t range[2] = { static_cast<uint64_t>(block) * H_BLOCK_SIZE, static_cast<uint64_t>(count) * H_BLOCK_SIZE };
+    if (ioctl(fd_, BLKDISCARD, &range) == -1 && errno != EOPNOTSUPP) {
+        int err = errno;
+        LOG(ERROR) << "Failed to discard " << count << " blocks at " << block << ", errno " << err;
+        return err == EIO ? 1 : -1;
+    }
+    return 0;
+}
+} // namespace Updater
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef UPDATER_ZERO_ENGINE_H
+#define UPDATER_ZERO_ENGINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <sys/types.h>
+
+namespace Updater {
+/*
+ * Zeroes and discards ranges of blocks. A block device is asked to zero the
+ * range itself with BLKZEROOUT. Regular files and devices without support
+ * get large buffered writes, and an unsupported BLKZEROOUT is not tried
+ * again. Discard is never used for zeroing, as the kernel no longer reports
+ * whether discarded blocks read back as zeroes.
+ */
+class ZeroEngine {
+public:
+    static constexpr size_t ZERO_BUFFER_SIZE = 1024 * 1024;
+
+    explicit ZeroEngine(int fd);
+    ~ZeroEngine() = default;
+
+    // Returns 0 on success, 1 on io error and -1 on other failures
+    int32_t Zero(size_t block, size_t count);
+    // Blocks are left undefined, nothing is done when the device cannot discard
+    int32_t Discard(size_t block, size_t count);
+
+private:
+    ZeroEngine(const ZeroEngine&) = delete;
+    const ZeroEngine& operator=(const ZeroEngine&) = delete;
+
+    bool RangeIoctl(unsigned long request, off64_t offset, size_t size, std::atomic<bool> &isSupported);
+    int32_t WriteZero(off64_t offset, size_t size);
+
+    int fd_ { -1 };
+    bool isBlockDevice_ { false };
+    std::atomic<bool> canZeroOut_ { false };
+    std::unique_ptr<uint8_t, void (*)(void *)> buffer_;
+};
+} // namespace Updater
+#endif // UPDATER_ZERO_ENGINE_H
@@ -13,6 +13,7 @@
  * limitations under the License.
  */
 #include "bzip2_adapter.h"
+#include <algorithm>
 #include <iostream>
 #include "bzlib.h"
 
@@ -222,14 +223,28 @@ int32_t BZip2BufferReadAdapter::Close()
     return PATCH_SUCCESS;
 }
 
-int32_t BZip2BufferReadAdapter::ReadData(BlockBuffer &info)
+int32_t BZip2ReadAdapter::ReadData(BlockBuffer &info)
+{
+    size_t readLen = 0;
+    int32_t ret = ReadAvailableData(info, readLen);
+    if (ret != 0) {
+        return ret;
+    }
+    if (readLen < info.length) {
+        PATCH_LOGE("Failed to read mem ret %zu length %zu", readLen, info.length);
+        return -1;
+    }
+    return 0;
+}
+
+int32_t BZip2BufferReadAdapter::ReadAvailableData(BlockBuffer &info, size_t &readLen)
 {
     if (!init_) {
         PATCH_LOGE("State error %d", init_);
         return -1;
     }
     int32_t ret = 0;
-    size_t readLen = 0;
+    readLen = 0;
     stream_.next_out = reinterpret_cast<char*>(info.buffer);
     stream_.avail_out = info.length;
     while (1) {
@@ -251,8 +266,187 @@ int32_t BZip2BufferReadAdapter::ReadData(BlockBuffer &info)
             return -1;
         }
     }
-    if (readLen < info.length) {
-        PATCH_LOGE("Failed to read mem ret %zu length %zu", readLen, info.length);
+    return 0;
+}
+
+int32_t StoredReadAdapter::Open()
+{
+    if (init_) {
+        PATCH_LOGE("State error %d", init_);
+        return -1;
+    }
+    if (buffer_.length < offset_ || dataLength_ > buffer_.length - offset_) {
+        PATCH_LOGE("Invalid buffer length. dataLength:%zu, buffer_.length:%zu, offset_:%zu",
+            dataLength_, buffer_.length, offset_);
+        return -1;
+    }
+    position_ = 0;
+    init_ = true;
+    return PATCH_SUCCESS;
+}
+
+int32_t StoredReadAdapter::Close()
+{
+    init_ = false;
+    return PATCH_SUCCESS;
+}
+
+int32_t StoredReadAdapter::ReadAvailableData(BlockBuffer &info, size_t &readLen)
+{
+    if (!init_) {
+        PATCH_LOGE("State error %d", init_);
+        return -1;
+    }
+    readLen = std::min(info.length, dataLength_ - position_);
+    if (readLen > 0 && memcpy_s(info.buffer, info.length, buffer_.buffer + offset_ + position_, readLen) != EOK) {
+        PATCH_LOGE("Failed to copy stored data");
+        return -1;
+    }
+    position_ += readLen;
+    return 0;
+}
+
+constexpr size_t PIPELINE_MIN_CHUNK = 4 * 1024;
+constexpr size_t PIPELINE_MAX_CHUNK = 256 * 1024;
+constexpr size_t PIPELINE_CHUNKS = 4;
+
+BZip2PipelineReadAdapter::~BZip2PipelineReadAdapter()
+{
+    Close();
+}
+
+int32_t BZip2PipelineReadAdapter::Open()
+{
+    if (init_) {
+        PATCH_LOGE("State error %d", init_);
+        return -1;
+    }
+    if (buffer_.length < offset_ || dataLength_ > buffer_.length - offset_) {
+        PATCH_LOGE("Invalid buffer length. dataLength:%zu, buffer_.length:%zu, offset_:%zu",
+            dataLength_, buffer_.length, offset_);
+        return -1;
+    }
+    (void)memset_s(&stream_, sizeof(bz_stream), 0, sizeof(bz_stream));
+    int32_t ret = BZ2_bzDecompressInit(&stream_, 0, 0);
+    if (ret != BZ_OK) {
+        PATCH_LOGE("Failed to open read mem ret %d", ret);
+        return -1;
+    }
+    stream_.avail_in = static_cast<unsigned int>(dataLength_);
+    stream_.next_in  = reinterpret_cast<char*>(buffer_.buffer + offset_);
+    chunkSize_ = std::clamp(limit_ / PIPELINE_CHUNKS, PIPELINE_MIN_CHUNK, PIPELINE_MAX_CHUNK);
+    finished_ = false;
+    result_ = BZ_OK;
+    stop_ = false;
+    init_ = true;
+    decoder_ = std::thread([this] { DecodeRun(); });
+    return PATCH_SUCCESS;
+}
+
+int32_t BZip2PipelineReadAdapter::Close()
+{
+    if (!init_) {
+        return PATCH_SUCCESS;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        cond_.notify_all();
+    }
+    if (decoder_.joinable()) {
+        decoder_.join();
+    }
+    chunks_.clear();
+    chunkOffset_ = 0;
+    queued_ = 0;
+    init_ = false;
+    if (BZ2_bzDecompressEnd(&stream_) != BZ_OK) {
+        PATCH_LOGE("Failed to close read mem");
+        return -1;
+    }
+    return PATCH_SUCCESS;
+}
+
+int32_t BZip2PipelineReadAdapter::DecodeChunk(std::vector<uint8_t> &chunk)
+{
+    stream_.next_out = reinterpret_cast<char*>(chunk.data());
+    stream_.avail_out = chunk.size();
+    while (stream_.avail_out > 0) {
+        int32_t ret = BZ2_bzDecompress(&stream_);
+        if (ret == BZ_STREAM_END) {
+            chunk.resize(chunk.size() - stream_.avail_out);
+            return BZ_STREAM_END;
+        }
+        if (ret != BZ_OK) {
+            PATCH_LOGE("Failed to decompress ret %d", ret);
+            chunk.resize(chunk.size() - stream_.avail_out);
+            return ret;
+        }
+        if (stream_.avail_out > 0 && stream_.avail_in == 0) {
+            PATCH_LOGE("Not enough buffer to decompress");
+            chunk.resize(chunk.size() - stream_.avail_out);
+            return BZ_UNEXPECTED_EOF;
+        }
+    }
+    return BZ_OK;
+}
+
+void BZip2PipelineReadAdapter::DecodeRun()
+{
+    while (true) {
+        std::vector<uint8_t> chunk(chunkSize_);
+        int32_t ret = DecodeChunk(chunk);
+        std::unique_lock<std::mutex> lock(mutex_);
+        // The front chunk may be partly read, so one chunk always fits.
+        cond_.wait(lock, [this, &chunk] { return stop_ || chunks_.empty() || queued_ + chunk.size() <= limit_; });
+        if (stop_) {
+            return;
+        }
+        if (!chunk.empty()) {
+            queued_ += chunk.size();
+            chunks_.push_back(std::move(chunk));
+        }
+        if (ret != BZ_OK) {
+            finished_ = true;
+            result_ = ret;
+        }
+        cond_.notify_all();
+        if (finished_) {
+            return;
+        }
+    }
+}
+
+int32_t BZip2PipelineReadAdapter::ReadAvailableData(BlockBuffer &info, size_t &readLen)
+{
+    if (!init_) {
+        PATCH_LOGE("State error %d", init_);
+        return -1;
+    }
+    readLen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (readLen < info.length) {
+        cond_.wait(lock, [this] { return !chunks_.empty() || finished_; });
+        if (chunks_.empty()) {
+            break;
+        }
+        std::vector<uint8_t> &chunk = chunks_.front();
+        size_t len = std::min(info.length - readLen, chunk.size() - chunkOffset_);
+        if (memcpy_s(info.buffer + readLen, info.length - readLen, chunk.data() + chunkOffset_, len) != EOK) {
+            PATCH_LOGE("Failed to copy decoded data");
+            return -1;
+        }
+        readLen += len;
+        chunkOffset_ += len;
+        if (chunkOffset_ == chunk.size()) {
+            queued_ -= chunk.size();
+            chunks_.pop_front();
+            chunkOffset_ = 0;
+            cond_.notify_all();
+        }
+    }
+    // The decoder already logged the error, a short read is fine at the end of the stream.
+    if (readLen < info.length && result_ != BZ_STREAM_END) {
         return -1;
     }
     return 0;
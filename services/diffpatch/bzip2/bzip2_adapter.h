@@ -15,6 +15,10 @@
 
 #ifndef BZIP2_ADAPTER_H
 #define BZIP2_ADAPTER_H
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include "bzlib.h"
 #include "deflate_adapter.h"
@@ -73,7 +77,10 @@ public:
     {
         return 0;
     };
-    virtual int32_t ReadData(BlockBuffer &info) = 0;
+    // Fails unless info.length bytes are read
+    virtual int32_t ReadData(BlockBuffer &info);
+    // Reads up to info.length bytes, less only when the stream ends
+    virtual int32_t ReadAvailableData(BlockBuffer &info, size_t &readLen) = 0;
 protected:
     bool init_ { false };
     size_t offset_ { 0 };
@@ -90,9 +97,60 @@ public:
     int32_t Open() override;
     int32_t Close() override;
 
-    int32_t ReadData(BlockBuffer &info) override;
+    int32_t ReadAvailableData(BlockBuffer &info, size_t &readLen) override;
 private:
     BlockBuffer buffer_ {};
 };
+
+// Reads a section stored without compression
+class StoredReadAdapter : public BZip2ReadAdapter {
+public:
+    StoredReadAdapter(size_t offset, size_t length, const BlockBuffer &info)
+        : BZip2ReadAdapter(offset, length), buffer_(info) {}
+    ~StoredReadAdapter() override {}
+
+    int32_t Open() override;
+    int32_t Close() override;
+
+    int32_t ReadAvailableData(BlockBuffer &info, size_t &readLen) override;
+private:
+    BlockBuffer buffer_ {};
+    size_t position_ { 0 };
+};
+
+/*
+ * Decodes the section on its own thread ahead of the reader, holding at most
+ * limit decoded bytes. A decode error is only reported once the reader needs
+ * the data behind it, so the result is the same as reading inline.
+ */
+class BZip2PipelineReadAdapter : public BZip2ReadAdapter {
+public:
+    BZip2PipelineReadAdapter(size_t offset, size_t length, const BlockBuffer &info, size_t limit)
+        : BZip2ReadAdapter(offset, length), buffer_(info), limit_(limit) {}
+    ~BZip2PipelineReadAdapter() override;
+
+    int32_t Open() override;
+    int32_t Close() override;
+
+    int32_t ReadAvailableData(BlockBuffer &info, size_t &readLen) override;
+private:
+    void DecodeRun();
+    int32_t DecodeChunk(std::vector<uint8_t> &chunk);
+
+    BlockBuffer buffer_ {};
+    size_t limit_ { 0 };
+    size_t chunkSize_ { 0 };
+    std::mutex mutex_ {};
+    std::condition_variable cond_ {};
+    std::deque<std::vector<uint8_t>> chunks_ {};
+    // bytes of the front chunk already read
+    size_t chunkOffset_ { 0 };
+    size_t queued_ { 0 };
+    bool finished_ { false };
+    // why the decoder finished, BZ_STREAM_END or an error
+    int32_t result_ { BZ_OK };
+    bool stop_ { false };
+    std::thread decoder_ {};
+};
 } // namespace UpdatePatch
 #endif // BZIP2_ADAPTER_H
\ No newline at end of file
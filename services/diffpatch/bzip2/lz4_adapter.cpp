@@ -96,7 +96,6 @@ int32_t Lz4FrameAdapter::Open()
 int32_t Lz4FrameAdapter::Close()
 {
     if (!init_) {
-        PATCH_LOGE("Has been close");
         return 0;
     }
     LZ4F_errorCode_t errorCode = LZ4F_freeCompressionContext(compressionContext_);
@@ -300,4 +299,69 @@ int32_t Lz4BlockAdapter::FlushData(size_t &offset)
     offset = offset_;
     return 0;
 }
+
+int32_t Lz4FrameReadAdapter::Open()
+{
+    if (init_) {
+        PATCH_LOGE("State error %d", init_);
+        return -1;
+    }
+    if (buffer_.length < offset_ || dataLength_ > buffer_.length - offset_) {
+        PATCH_LOGE("Invalid buffer length. dataLength:%zu, buffer_.length:%zu, offset_:%zu",
+            dataLength_, buffer_.length, offset_);
+        return -1;
+    }
+    LZ4F_errorCode_t errorCode = LZ4F_createDecompressionContext(&decompressionContext_, LZ4F_VERSION);
+    if (LZ4F_isError(errorCode)) {
+        PATCH_LOGE("Failed to create decompress context %s", LZ4F_getErrorName(errorCode));
+        return -1;
+    }
+    position_ = 0;
+    finished_ = false;
+    init_ = true;
+    return PATCH_SUCCESS;
+}
+
+int32_t Lz4FrameReadAdapter::Close()
+{
+    if (!init_) {
+        return PATCH_SUCCESS;
+    }
+    LZ4F_errorCode_t errorCode = LZ4F_freeDecompressionContext(decompressionContext_);
+    decompressionContext_ = nullptr;
+    init_ = false;
+    if (LZ4F_isError(errorCode)) {
+        PATCH_LOGE("Failed to free decompress context %s", LZ4F_getErrorName(errorCode));
+        return -1;
+    }
+    return PATCH_SUCCESS;
+}
+
+int32_t Lz4FrameReadAdapter::ReadAvailableData(BlockBuffer &info, size_t &readLen)
+{
+    if (!init_) {
+        PATCH_LOGE("State error %d", init_);
+        return -1;
+    }
+    readLen = 0;
+    while (readLen < info.length && !finished_) {
+        size_t outSize = info.length - readLen;
+        size_t inSize = dataLength_ - position_;
+        size_t ret = LZ4F_decompress(decompressionContext_, info.buffer + readLen, &outSize,
+            buffer_.buffer + offset_ + position_, &inSize, nullptr);
+        if (LZ4F_isError(ret)) {
+            PATCH_LOGE("Failed to decompress %s", LZ4F_getErrorName(ret));
+            return -1;
+        }
+        position_ += inSize;
+        readLen += outSize;
+        // 0 means the frame is complete
+        finished_ = (ret == 0);
+        if (!finished_ && inSize == 0 && outSize == 0) {
+            PATCH_LOGE("Not enough buffer to decompress");
+            return -1;
+        }
+    }
+    return 0;
+}
 } // namespace UpdatePatch
@@ -17,6 +17,7 @@
 #define LZ4_ADAPTER_H
 #include <iostream>
 #include <vector>
+#include "bzip2_adapter.h"
 #include "deflate_adapter.h"
 #include "diffpatch.h"
 #include "lz4.h"
@@ -84,5 +85,26 @@ public:
 private:
     int32_t CompressData(const BlockBuffer &srcData) override;
 };
+
+// Reads a section holding one lz4 frame
+class Lz4FrameReadAdapter : public BZip2ReadAdapter {
+public:
+    Lz4FrameReadAdapter(size_t offset, size_t length, const BlockBuffer &info)
+        : BZip2ReadAdapter(offset, length), buffer_(info) {}
+    ~Lz4FrameReadAdapter() override
+    {
+        Close();
+    }
+
+    int32_t Open() override;
+    int32_t Close() override;
+
+    int32_t ReadAvailableData(BlockBuffer &info, size_t &readLen) override;
+private:
+    BlockBuffer buffer_ {};
+    size_t position_ { 0 };
+    bool finished_ { false };
+    LZ4F_decompressionContext_t decompressionContext_ { nullptr };
+};
 } // namespace UpdatePatch
 #endif // LZ4_ADAPTER_H
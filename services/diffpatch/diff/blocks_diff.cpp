@@ -15,9 +15,15 @@
 
 #include "blocks_diff.h"
 #include "scope_guard.h"
+#include <algorithm>
+#include <climits>
 #include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <thread>
 #include <vector>
+#include "lz4_adapter.h"
+#include "suffix_sort.h"
 #include "update_diff.h"
 
 using namespace Hpackage;
@@ -34,6 +40,99 @@ constexpr uint32_t BUCKET_SIZE = 256;
 constexpr uint32_t MULTIPLE_TWO = 2;
 constexpr int64_t BLOCK_SCORE = 8;
 constexpr int64_t MIN_LENGTH = 16;
+constexpr size_t SECTION_CODECS_LEN = 8;
+constexpr size_t SECTION_COUNT = 3;
+constexpr int8_t SECTION_LZ4_BLOCK_ID = 5; // 256K
+constexpr int8_t SECTION_LZ4_LEVEL = 9; // lz4hc default
+constexpr size_t WINDOW_HEADER_LEN = 32;
+constexpr size_t WINDOW_ENTRY_LEN = 16;
+constexpr size_t MIB = 1024 * 1024;
+constexpr size_t KIB = 1024;
+constexpr size_t SAIS_TYPE_BITS_RATIO = 4; // a bit per byte at the first level, half as many at each next one
+
+std::atomic<uint8_t> BlocksDiff::sectionCodec_ { PATCH_CODEC_BZIP2 };
+std::atomic<size_t> BlocksDiff::patchWindowSize_ { 0 };
+std::atomic<uint8_t> BlocksDiff::suffixSortType_ { SUFFIX_SORT_SAIS };
+std::atomic<size_t> BlocksDiff::memoryLimit_ { 0 };
+std::atomic<size_t> BlocksDiff::patchScanWindowSize_ { 0 };
+std::atomic<size_t> BlocksDiff::scanWorkers_ {
+    std::max(static_cast<size_t>(std::thread::hardware_concurrency()), static_cast<size_t>(1))
+};
+
+namespace {
+class BufferSectionWriter : public UpdatePatchWriter {
+public:
+    BufferSectionWriter(std::vector<uint8_t> &buffer, size_t offset) : buffer_(buffer), offset_(offset) {}
+    ~BufferSectionWriter() override {}
+
+    int32_t Init() override
+    {
+        return 0;
+    }
+    int32_t Finish() override
+    {
+        return 0;
+    }
+    int32_t Write(size_t start, const BlockBuffer &data, size_t len) override
+    {
+        if (len == 0) {
+            return 0;
+        }
+        size_t end = offset_ + start + len;
+        if (end > buffer_.size()) {
+            buffer_.resize(IGMDIFF_LIMIT_UNIT * (end / IGMDIFF_LIMIT_UNIT + 1));
+        }
+        return memcpy_s(buffer_.data() + offset_ + start, buffer_.size() - offset_ - start, data.buffer, len);
+    }
+private:
+    std::vector<uint8_t> &buffer_;
+    size_t offset_ { 0 };
+};
+
+// Sections are written one after the other at the end of the stream.
+class StreamSectionWriter : public UpdatePatchWriter {
+public:
+    explicit StreamSectionWriter(std::fstream &stream) : stream_(stream) {}
+    ~StreamSectionWriter() override {}
+
+    int32_t Init() override
+    {
+        return 0;
+    }
+    int32_t Finish() override
+    {
+        return 0;
+    }
+    int32_t Write(size_t start, const BlockBuffer &data, size_t len) override
+    {
+        stream_.write(reinterpret_cast<const char*>(data.buffer), len);
+        return stream_.fail() ? -1 : 0;
+    }
+private:
+    std::fstream &stream_;
+};
+
+class StoredAdapter : public DeflateAdapter {
+public:
+    explicit StoredAdapter(UpdatePatchWriterPtr outStream) : DeflateAdapter(), outStream_(outStream) {}
+    ~StoredAdapter() override {}
+
+    int32_t WriteData(const BlockBuffer &srcData) override
+    {
+        int32_t ret = outStream_->Write(dataSize_, srcData, srcData.length);
+        dataSize_ += srcData.length;
+        return ret;
+    }
+    int32_t FlushData(size_t &dataSize) override
+    {
+        dataSize = dataSize_;
+        return 0;
+    }
+private:
+    UpdatePatchWriterPtr outStream_ { nullptr };
+    size_t dataSize_ { 0 };
+};
+} // namespace
 
 static void WriteLE64(const BlockBuffer &buffer, int64_t value)
 {
@@ -59,6 +158,30 @@ static void WriteLE64(const BlockBuffer &buffer, int64_t value)
     }
 }
 
+// MemAvailable of the host, 0 if it is unknown
+static size_t GetAvailableMemory()
+{
+#ifdef __WIN32
+    return 0;
+#else
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    size_t value = 0;
+    std::string unit;
+    while (meminfo >> key >> value >> unit) {
+        if (key == "MemAvailable:") {
+            return value * KIB;
+        }
+    }
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || pageSize <= 0) {
+        return 0;
+    }
+    return static_cast<size_t>(pages) * static_cast<size_t>(pageSize);
+#endif
+}
+
 int32_t BlocksDiff::MakePatch(const std::string &oldFileName, const std::string &newFileName,
     const std::string &patchFileName)
 {
@@ -128,17 +251,124 @@ int32_t BlocksDiff::MakePatch(const BlockBuffer &newInfo,
     return ret;
 }
 
+void BlocksDiff::SetSectionCodec(uint8_t codec)
+{
+    sectionCodec_ = codec;
+}
+
+void BlocksDiff::SetWindowSize(size_t size)
+{
+    patchWindowSize_ = size;
+}
+
+void BlocksDiff::SetSuffixSort(uint8_t sortType)
+{
+    suffixSortType_ = sortType;
+}
+
+void BlocksDiff::SetMemoryLimit(size_t limit)
+{
+    memoryLimit_ = limit;
+}
+
+void BlocksDiff::SetScanWindowSize(size_t size)
+{
+    patchScanWindowSize_ = size;
+}
+
+void BlocksDiff::SetScanWorkers(size_t count)
+{
+    scanWorkers_ = std::max(count, static_cast<size_t>(1));
+}
+
+size_t BlocksDiff::GetScanWorkers()
+{
+    return scanWorkers_;
+}
+
+const char *BlocksDiff::GetPatchMagic() const
+{
+    return codec_ == PATCH_CODEC_BZIP2 ? BSDIFF_MAGIC : BSDIFF_CODEC_MAGIC;
+}
+
+std::vector<uint8_t> BlocksDiff::GetSectionCodecs() const
+{
+    if (codec_ == PATCH_CODEC_BZIP2) {
+        return {};
+    }
+    std::vector<uint8_t> codecs(SECTION_CODECS_LEN, 0);
+    for (size_t i = 0; i < SECTION_COUNT; i++) {
+        codecs[i] = codec_;
+    }
+    return codecs;
+}
+
+std::unique_ptr<DeflateAdapter> BlocksDiff::CreateSectionAdapter(size_t patchOffset)
+{
+    if (codec_ == PATCH_CODEC_BZIP2) {
+        return CreateBZip2Adapter(patchOffset);
+    }
+    sectionWriter_ = CreateSectionWriter(patchOffset);
+    std::unique_ptr<DeflateAdapter> adapter = nullptr;
+    if (codec_ == PATCH_CODEC_LZ4) {
+        // Linked blocks with hc make the section smaller, it decodes as fast.
+        Lz4FileInfo info {};
+        info.fileInfo.packMethod = PKG_COMPRESS_METHOD_LZ4;
+        info.compressionLevel = SECTION_LZ4_LEVEL;
+        info.blockSizeID = SECTION_LZ4_BLOCK_ID;
+        adapter = std::make_unique<Lz4FrameAdapter>(sectionWriter_.get(), 0, &info.fileInfo);
+    } else if (codec_ == PATCH_CODEC_STORED) {
+        adapter = std::make_unique<StoredAdapter>(sectionWriter_.get());
+    } else {
+        PATCH_LOGE("Unknown section codec %d", codec_);
+        return nullptr;
+    }
+    if (adapter->Open() != 0) {
+        PATCH_LOGE("Failed to open section adapter");
+        return nullptr;
+    }
+    return adapter;
+}
+
 int32_t BlocksDiff::MakePatch(const BlockBuffer &newInfo, const BlockBuffer &oldInfo, size_t &patchSize)
 {
     if (suffixArray_ == nullptr) {
-        suffixArray_.reset(new SuffixArray<int32_t>());
-        if (suffixArray_ == nullptr) {
-            PATCH_LOGE("Failed to create SuffixArray");
-            return -1;
+        int32_t ret = CreateSuffixArray(oldInfo);
+        if (ret != 0) {
+            return ret;
         }
-        suffixArray_->Init(oldInfo);
     }
+    if (windowSize_ > 0 && newInfo.length > windowSize_) {
+        return MakeWindowedPatch(newInfo, oldInfo, patchSize);
+    }
+    return MakeSinglePatch(newInfo, oldInfo, patchSize);
+}
+
+int32_t BlocksDiff::CreateSuffixArray(const BlockBuffer &oldInfo)
+{
+    // qsufsort marks a sorted group of all the suffixes with -(length + 1)
+    bool isWide = oldInfo.length >= static_cast<size_t>(INT32_MAX);
+    size_t memorySize = isWide ? SuffixArray<int64_t>::GetMemorySize(oldInfo.length, suffixSort_) :
+        SuffixArray<int32_t>::GetMemorySize(oldInfo.length, suffixSort_);
+    size_t limit = memoryLimit_.load() != 0 ? memoryLimit_.load() : GetAvailableMemory();
+    if (limit != 0 && memorySize > limit) {
+        PATCH_LOGE("Suffix array of %zu bytes needs %zu MiB, only %zu MiB available",
+            oldInfo.length, memorySize / MIB, limit / MIB);
+        return PATCH_EXCEED_LIMIT;
+    }
+    if (isWide) {
+        suffixArray_ = std::make_shared<SuffixArray<int64_t>>();
+    } else {
+        suffixArray_ = std::make_shared<SuffixArray<int32_t>>();
+    }
+    PATCH_LOGI("Suffix array of %zu bytes, %s indexes, about %zu MiB", oldInfo.length,
+        isWide ? "64 bit" : "32 bit", memorySize / MIB);
+    suffixArray_->Init(oldInfo, suffixSort_);
+    return 0;
+}
 
+int32_t BlocksDiff::MakeSinglePatch(const BlockBuffer &newInfo, const BlockBuffer &oldInfo, size_t &patchSize)
+{
     std::vector<ControlData> controlDatas;
     int32_t ret = GetCtrlDatas(newInfo, oldInfo, controlDatas);
     if (ret != 0) {
@@ -149,6 +379,64 @@ int32_t BlocksDiff::MakePatch(const BlockBuffer &newInfo, const BlockBuffer &old
     return WritePatchData(controlDatas, newInfo, patchSize);
 }
 
+int32_t BlocksDiff::MakeWindowedPatch(const BlockBuffer &newInfo, const BlockBuffer &oldInfo, size_t &patchSize)
+{
+    size_t count = (newInfo.length + windowSize_ - 1) / windowSize_;
+    std::vector<std::vector<uint8_t>> windowPatches(count);
+    std::vector<uint8_t> header(WINDOW_HEADER_LEN + count * WINDOW_ENTRY_LEN, 0);
+    if (memcpy_s(header.data(), header.size(), BSDIFF_WINDOW_MAGIC,
+        std::char_traits<char>::length(BSDIFF_WINDOW_MAGIC)) != EOK) {
+        PATCH_LOGE("Failed to copy magic");
+        return -1;
+    }
+    size_t offset = std::char_traits<char>::length(BSDIFF_WINDOW_MAGIC);
+    WriteLE64({header.data() + offset, sizeof(int64_t)}, static_cast<int64_t>(windowSize_));
+    offset += sizeof(int64_t);
+    WriteLE64({header.data() + offset, sizeof(int64_t)}, static_cast<int64_t>(count));
+    offset += sizeof(int64_t);
+    WriteLE64({header.data() + offset, sizeof(int64_t)}, static_cast<int64_t>(newInfo.length));
+    offset += sizeof(int64_t);
+
+    size_t windowOffset = header.size();
+    for (size_t i = 0; i < count; i++) {
+        size_t start = i * windowSize_;
+        BlockBuffer window = {newInfo.buffer + start, std::min(windowSize_, newInfo.length - start)};
+        std::vector<uint8_t> &windowPatch = windowPatches[i];
+        windowPatch.resize(IGMDIFF_LIMIT_UNIT);
+        BlocksBufferDiff bufferDiff(windowPatch, 0);
+        BlocksDiff &windowDiff = bufferDiff;
+        windowDiff.suffixArray_ = suffixArray_;
+        windowDiff.codec_ = codec_;
+        size_t windowPatchSize = 0;
+        int32_t ret = windowDiff.MakeSinglePatch(window, oldInfo, windowPatchSize);
+        if (ret != 0 || windowPatch.size() < windowPatchSize) {
+            PATCH_LOGE("Failed to make patch of window %zu", i);
+            return -1;
+        }
+        windowPatch.resize(windowPatchSize);
+        WriteLE64({header.data() + offset, sizeof(int64_t)}, static_cast<int64_t>(windowOffset));
+        offset += sizeof(int64_t);
+        WriteLE64({header.data() + offset, sizeof(int64_t)}, static_cast<int64_t>(windowPatchSize));
+        offset += sizeof(int64_t);
+        windowOffset += windowPatchSize;
+    }
+
+    std::unique_ptr<UpdatePatchWriter> writer = CreateSectionWriter(0);
+    patchSize = 0;
+    int32_t ret = writer->Write(patchSize, {header.data(), header.size()}, header.size());
+    patchSize += header.size();
+    for (size_t i = 0; i < count && ret == 0; i++) {
+        ret = writer->Write(patchSize, {windowPatches[i].data(), windowPatches[i].size()}, windowPatches[i].size());
+        patchSize += windowPatches[i].size();
+    }
+    if (ret != 0) {
+        PATCH_LOGE("Failed to write windowed patch");
+        return ret;
+    }
+    PATCH_LOGI("MakeWindowedPatch success patchSize:%zu windows:%zu", patchSize, count);
+    return 0;
+}
+
 int32_t BlocksDiff::WritePatchData(const std::vector<ControlData> &controlDatas,
     const BlockBuffer &newInfo, size_t &patchSize)
 {
@@ -208,6 +496,16 @@ std::unique_ptr<DeflateAdapter> BlocksBufferDiff::CreateBZip2Adapter(size_t patc
     return bzip2Adapter;
 }
 
+std::unique_ptr<UpdatePatchWriter> BlocksBufferDiff::CreateSectionWriter(size_t patchOffset)
+{
+    return std::make_unique<BufferSectionWriter>(patchData_, offset_ + patchOffset);
+}
+
+std::unique_ptr<UpdatePatchWriter> BlocksStreamDiff::CreateSectionWriter(size_t patchOffset)
+{
+    return std::make_unique<StreamSectionWriter>(stream_);
+}
+
 std::unique_ptr<DeflateAdapter> BlocksStreamDiff::CreateBZip2Adapter(size_t patchOffset)
 {
     std::unique_ptr<DeflateAdapter> bzip2Adapter = std::make_unique<BZip2StreamAdapter>(stream_);
@@ -222,13 +520,15 @@ std::unique_ptr<DeflateAdapter> BlocksStreamDiff::CreateBZip2Adapter(size_t patc
 int32_t BlocksBufferDiff::WritePatchHeader(int64_t controlSize,
     int64_t diffDataSize, int64_t newSize, size_t &headerLen)
 {
-    headerLen = std::char_traits<char>::length(BSDIFF_MAGIC) + sizeof(int64_t) + sizeof(int64_t) + sizeof(int64_t);
+    std::vector<uint8_t> codecs = GetSectionCodecs();
+    headerLen = std::char_traits<char>::length(BSDIFF_MAGIC) + sizeof(int64_t) + sizeof(int64_t) + sizeof(int64_t) +
+        codecs.size();
     if (patchData_.size() <= headerLen + offset_) {
         PATCH_LOGE("Invalid patch size");
         return -1;
     }
 
-    int32_t ret = memcpy_s(patchData_.data() + offset_, patchData_.size(), BSDIFF_MAGIC,
+    int32_t ret = memcpy_s(patchData_.data() + offset_, patchData_.size(), GetPatchMagic(),
         std::char_traits<char>::length(BSDIFF_MAGIC));
     if (ret != 0) {
         PATCH_LOGE("Failed to copy magic");
@@ -244,6 +544,12 @@ int32_t BlocksBufferDiff::WritePatchHeader(int64_t controlSize,
     BlockBuffer newData = {patchData_.data() + offset_ + headerLen, patchData_.size()};
     WriteLE64(newData, newSize);
     headerLen += sizeof(int64_t);
+    if (!codecs.empty() && memcpy_s(patchData_.data() + offset_ + headerLen, patchData_.size() - offset_ - headerLen,
+        codecs.data(), codecs.size()) != EOK) {
+        PATCH_LOGE("Failed to copy section codecs");
+        return -1;
+    }
+    headerLen += codecs.size();
     return 0;
 }
 
@@ -258,7 +564,7 @@ int32_t BlocksStreamDiff::WritePatchHeader(int64_t controlSize,
     }
 #endif
     stream_.seekp(offset_, std::ios::beg);
-    stream_.write(BSDIFF_MAGIC, std::char_traits<char>::length(BSDIFF_MAGIC));
+    stream_.write(GetPatchMagic(), std::char_traits<char>::length(BSDIFF_MAGIC));
     PkgBuffer buffer(sizeof(int64_t));
     WriteLE64(buffer, controlSize);
     stream_.write(reinterpret_cast<const char*>(buffer.buffer), sizeof(int64_t));
@@ -266,7 +572,10 @@ int32_t BlocksStreamDiff::WritePatchHeader(int64_t controlSize,
     stream_.write(reinterpret_cast<const char*>(buffer.buffer), sizeof(int64_t));
     WriteLE64(buffer, newSize);
     stream_.write(reinterpret_cast<const char*>(buffer.buffer), sizeof(int64_t));
-    headerLen = std::char_traits<char>::length(BSDIFF_MAGIC) + sizeof(int64_t)  + sizeof(int64_t)  + sizeof(int64_t);
+    std::vector<uint8_t> codecs = GetSectionCodecs();
+    stream_.write(reinterpret_cast<const char*>(codecs.data()), codecs.size());
+    headerLen = std::char_traits<char>::length(BSDIFF_MAGIC) + sizeof(int64_t)  + sizeof(int64_t)  + sizeof(int64_t) +
+        codecs.size();
     stream_.seekp(0, std::ios::end);
     return 0;
 }
@@ -351,6 +660,64 @@ void BlocksDiff::ComputeLength(const BlockBuffer &newInfo,
 
 int32_t BlocksDiff::GetCtrlDatas(const BlockBuffer &newInfo,
     const BlockBuffer &oldInfo, std::vector<ControlData> &controlDatas)
+{
+    if (scanWindowSize_ == 0 || newInfo.length <= scanWindowSize_) {
+        return ScanCtrlDatas(newInfo, oldInfo, controlDatas);
+    }
+    return ScanWindowsConcurrently(newInfo, oldInfo, controlDatas);
+}
+
+/*
+ * Every window is searched as if it was a new file of its own, so the windows
+ * only share the read only suffix array. The patch does not depend on the
+ * number of workers.
+ */
+int32_t BlocksDiff::ScanWindowsConcurrently(const BlockBuffer &newInfo,
+    const BlockBuffer &oldInfo, std::vector<ControlData> &controlDatas)
+{
+    size_t count = (newInfo.length + scanWindowSize_ - 1) / scanWindowSize_;
+    std::vector<std::vector<ControlData>> windowControls(count);
+    std::vector<int32_t> results(count, 0);
+    std::atomic<size_t> next { 0 };
+    auto workerRun = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            size_t start = i * scanWindowSize_;
+            BlockBuffer window = {newInfo.buffer + start, std::min(scanWindowSize_, newInfo.length - start)};
+            std::vector<uint8_t> unused {};
+            BlocksBufferDiff bufferDiff(unused, 0);
+            BlocksDiff &windowDiff = bufferDiff;
+            windowDiff.suffixArray_ = suffixArray_;
+            results[i] = windowDiff.ScanCtrlDatas(window, oldInfo, windowControls[i]);
+        }
+    };
+    std::vector<std::thread> workers {};
+    for (size_t i = 1; i < std::min(scanWorkers_.load(), count); i++) {
+        workers.emplace_back(workerRun);
+    }
+    workerRun();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] != 0 || windowControls[i].empty()) {
+            PATCH_LOGE("Failed to get control data of window %zu", i);
+            return -1;
+        }
+        // the next window starts at old offset 0, as a new file does
+        if (i + 1 < count) {
+            ControlData &last = windowControls[i].back();
+            last.offsetIncrement = -((last.diffOldStart - oldInfo.buffer) + last.diffLength);
+        }
+        controlDatas.insert(controlDatas.end(), windowControls[i].begin(), windowControls[i].end());
+    }
+    PATCH_LOGI("Scanned %zu windows with %zu workers, %zu control data", count,
+        std::min(scanWorkers_.load(), count), controlDatas.size());
+    return 0;
+}
+
+int32_t BlocksDiff::ScanCtrlDatas(const BlockBuffer &newInfo,
+    const BlockBuffer &oldInfo, std::vector<ControlData> &controlDatas)
 {
     int64_t matchLen = 0;
     while (currentOffset_ < static_cast<int64_t>(newInfo.length)) {
@@ -381,42 +748,41 @@ int32_t BlocksDiff::GetCtrlDatas(const BlockBuffer &newInfo,
 
 int32_t BlocksDiff::WriteControlData(const std::vector<ControlData> controlDatas, size_t &patchSize)
 {
-    std::unique_ptr<DeflateAdapter> bzip2Adapter = CreateBZip2Adapter(patchSize);
-    if (bzip2Adapter == nullptr) {
-        PATCH_LOGE("Failed to create bzip2Adapter");
+    std::unique_ptr<DeflateAdapter> adapter = CreateSectionAdapter(patchSize);
+    if (adapter == nullptr) {
+        PATCH_LOGE("Failed to create section adapter");
         return -1;
     }
-    bzip2Adapter->Open();
     int32_t ret = 0;
     uint8_t buffer[sizeof(int64_t)] = {0};
     BlockBuffer srcData = {buffer, sizeof(int64_t)};
     PATCH_DEBUG("WriteControlData patchSize %zu controlDatas %zu", patchSize, controlDatas.size());
     std::vector<int64_t> data;
-    ON_SCOPE_EXIT(closeBzip2Adapter) {
-        bzip2Adapter->Close();
+    ON_SCOPE_EXIT(closeAdapter) {
+        adapter->Close();
     };
     for (size_t i = 0; i < controlDatas.size(); i++) {
         WriteLE64(srcData, controlDatas[i].diffLength);
-        ret = bzip2Adapter->WriteData(srcData);
+        ret = adapter->WriteData(srcData);
         if (ret != 0) {
             PATCH_LOGE("Failed to write data");
             return ret;
         }
         WriteLE64(srcData, controlDatas[i].extraLength);
-        ret = bzip2Adapter->WriteData(srcData);
+        ret = adapter->WriteData(srcData);
         if (ret != 0) {
             PATCH_LOGE("Failed to write data");
             return ret;
         }
         WriteLE64(srcData, controlDatas[i].offsetIncrement);
-        ret = bzip2Adapter->WriteData(srcData);
+        ret = adapter->WriteData(srcData);
         if (ret != 0) {
             PATCH_LOGE("WriteControlData : Failed to write data");
             return ret;
         }
     }
     size_t dataSize = 0;
-    ret = bzip2Adapter->FlushData(dataSize);
+    ret = adapter->FlushData(dataSize);
     if (ret != 0) {
         PATCH_LOGE("Failed to FlushData %d", ret);
         return ret;
@@ -429,14 +795,13 @@ int32_t BlocksDiff::WriteControlData(const std::vector<ControlData> controlDatas
 int32_t BlocksDiff::WriteDiffData(const std::vector<ControlData> controlDatas, size_t &patchSize)
 {
     PATCH_DEBUG("WriteDiffData patchSize %zu", patchSize);
-    std::unique_ptr<DeflateAdapter> bzip2Adapter = CreateBZip2Adapter(patchSize);
-    if (bzip2Adapter == nullptr) {
-        PATCH_LOGE("Failed to create bzip2Adapter");
+    std::unique_ptr<DeflateAdapter> adapter = CreateSectionAdapter(patchSize);
+    if (adapter == nullptr) {
+        PATCH_LOGE("Failed to create section adapter");
         return -1;
     }
-    bzip2Adapter->Open();
-    ON_SCOPE_EXIT(closeBzip2Adapter) {
-        bzip2Adapter->Close();
+    ON_SCOPE_EXIT(closeAdapter) {
+        adapter->Close();
     };
 
     std::vector<uint8_t> diffData(IGMDIFF_LIMIT_UNIT, 0);
@@ -455,7 +820,7 @@ int32_t BlocksDiff::WriteDiffData(const std::vector<ControlData> controlDatas, s
             }
 
             BlockBuffer srcData = {reinterpret_cast<uint8_t*>(diffData.data()), static_cast<size_t>(cpyLen)};
-            ret = bzip2Adapter->WriteData(srcData);
+            ret = adapter->WriteData(srcData);
             if (ret != 0) {
                 PATCH_LOGE("Failed to write data");
                 return ret;
@@ -464,7 +829,7 @@ int32_t BlocksDiff::WriteDiffData(const std::vector<ControlData> controlDatas, s
         }
     }
     size_t dataSize = 0;
-    ret = bzip2Adapter->FlushData(dataSize);
+    ret = adapter->FlushData(dataSize);
     if (ret != 0) {
         PATCH_LOGE("Failed to FlushData %d", ret);
         return ret;
@@ -477,14 +842,13 @@ int32_t BlocksDiff::WriteDiffData(const std::vector<ControlData> controlDatas, s
 int32_t BlocksDiff::WriteExtraData(const std::vector<ControlData> controlDatas, size_t &patchSize)
 {
     PATCH_DEBUG("WriteExtraData patchSize %zu ", patchSize);
-    std::unique_ptr<DeflateAdapter> bzip2Adapter = CreateBZip2Adapter(patchSize);
-    if (bzip2Adapter == nullptr) {
-        PATCH_LOGE("Failed to create bzip2Adapter");
+    std::unique_ptr<DeflateAdapter> adapter = CreateSectionAdapter(patchSize);
+    if (adapter == nullptr) {
+        PATCH_LOGE("Failed to create section adapter");
         return -1;
     }
-    bzip2Adapter->Open();
-    ON_SCOPE_EXIT(closeBzip2Adapter) {
-        bzip2Adapter->Close();
+    ON_SCOPE_EXIT(closeAdapter) {
+        adapter->Close();
     };
     int32_t ret = 0;
     for (size_t i = 0; i < controlDatas.size(); i++) {
@@ -492,14 +856,14 @@ int32_t BlocksDiff::WriteExtraData(const std::vector<ControlData> controlDatas,
             continue;
         }
         BlockBuffer srcData = {controlDatas[i].extraNewStart, static_cast<size_t>(controlDatas[i].extraLength)};
-        ret = bzip2Adapter->WriteData(srcData);
+        ret = adapter->WriteData(srcData);
         if (ret != 0) {
             PATCH_LOGE("WriteExtraData : Failed to write data");
             return ret;
         }
     }
     size_t dataSize = 0;
-    ret = bzip2Adapter->FlushData(dataSize);
+    ret = adapter->FlushData(dataSize);
     if (ret != 0) {
         PATCH_LOGE("Failed to FlushData %d", ret);
         return ret;
@@ -510,8 +874,13 @@ int32_t BlocksDiff::WriteExtraData(const std::vector<ControlData> controlDatas,
 }
 
 template<class DataType>
-void SuffixArray<DataType>::Init(const BlockBuffer &oldInfo)
+void SuffixArray<DataType>::Init(const BlockBuffer &oldInfo, uint8_t sortType)
 {
+    if (sortType == SUFFIX_SORT_SAIS) {
+        SaisSort<DataType>(oldInfo.buffer, static_cast<DataType>(oldInfo.length), suffixArray_);
+        PATCH_DEBUG("SuffixArray::Init %zu sais finish", oldInfo.length);
+        return;
+    }
     std::vector<DataType> suffixArrayTemp;
     std::vector<DataType> buckets;
     InitBuckets(oldInfo, buckets, suffixArrayTemp);
@@ -541,7 +910,19 @@ void SuffixArray<DataType>::Init(const BlockBuffer &oldInfo)
         suffixArray_[suffixArrayTemp[i]] = i;
     }
 
-    PATCH_DEBUG("SuffixArray::Init %d finish", static_cast<int>(oldInfo.length));
+    PATCH_DEBUG("SuffixArray::Init %zu finish", oldInfo.length);
+}
+
+template<class DataType>
+size_t SuffixArray<DataType>::GetMemorySize(size_t length, uint8_t sortType)
+{
+    size_t arraySize = (length + 1) * sizeof(DataType);
+    if (sortType == SUFFIX_SORT_SAIS) {
+        // the buckets of a reduced level, which has at most half of the suffixes, and the type bits of all levels
+        return arraySize * MULTIPLE_TWO + length / SAIS_TYPE_BITS_RATIO;
+    }
+    // the ranks take as much as the array
+    return arraySize * MULTIPLE_TWO;
 }
 
 template<class DataType>
@@ -702,4 +1083,7 @@ void SuffixArray<DataType>::InitBuckets(const BlockBuffer &oldInfo,
     }
     suffixArray_[0] = -1;
 }
+
+template class SuffixArray<int32_t>;
+template class SuffixArray<int64_t>;
 } // namespace UpdatePatch
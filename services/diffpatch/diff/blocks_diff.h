@@ -16,7 +16,9 @@
 #ifndef BLOCKS_DIFF_H
 #define BLOCKS_DIFF_H
 
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include "bzip2_adapter.h"
 #include "diffpatch.h"
@@ -25,15 +27,28 @@
 #include "update_diff.h"
 
 namespace UpdatePatch {
+// Suffix array of the old data, the index type depends on its size
+class SuffixArrayBase {
+public:
+    SuffixArrayBase() = default;
+    virtual ~SuffixArrayBase() {}
+
+    virtual void Init(const BlockBuffer &oldInfo, uint8_t sortType) = 0;
+    virtual int64_t Search(const BlockBuffer &newInfo,
+        const BlockBuffer &oldInfo, int64_t start, int64_t end, int64_t &pos) const = 0;
+};
+
 template<class DataType>
-class SuffixArray {
+class SuffixArray final : public SuffixArrayBase {
 public:
     SuffixArray() = default;
-    ~SuffixArray() {}
+    ~SuffixArray() override {}
 
-    void Init(const BlockBuffer &oldInfo);
+    void Init(const BlockBuffer &oldInfo, uint8_t sortType) override;
     int64_t Search(const BlockBuffer &newInfo,
-        const BlockBuffer &oldInfo, int64_t start, int64_t end, int64_t &pos) const;
+        const BlockBuffer &oldInfo, int64_t start, int64_t end, int64_t &pos) const override;
+    // Upper bound of the memory Init takes for length bytes of old data
+    static size_t GetMemorySize(size_t length, uint8_t sortType);
 private:
     void InitBuckets(const BlockBuffer &oldInfo,
         std::vector<DataType> &buckets, std::vector<DataType> &suffixArrayTemp);
@@ -58,13 +73,44 @@ public:
 
     int32_t MakePatch(const BlockBuffer &newInfo, const BlockBuffer &oldInfo, size_t &patchSize);
 
+    // Codec of the sections of patches made from now on, PATCH_CODEC_BZIP2 keeps the BSDIFF40 format
+    static void SetSectionCodec(uint8_t codec);
+    // New files larger than size are cut into windows with patches of their own, 0 makes a single patch
+    static void SetWindowSize(size_t size);
+    // Suffix sort of the old data, SUFFIX_SORT_SAIS is linear in its size
+    static void SetSuffixSort(uint8_t sortType);
+    // Memory the suffix array may take, 0 takes the memory available on the host
+    static void SetMemoryLimit(size_t limit);
+    // New data larger than size is searched in windows of that size at the same time, the control data of
+    // the windows is stitched into one patch. 0 searches it as a whole.
+    static void SetScanWindowSize(size_t size);
+    static void SetScanWorkers(size_t count);
+    static size_t GetScanWorkers();
+protected:
+    const char *GetPatchMagic() const;
+    // Header bytes after the lengths, empty for BSDIFF40
+    std::vector<uint8_t> GetSectionCodecs() const;
+
 private:
     virtual std::unique_ptr<DeflateAdapter> CreateBZip2Adapter(size_t patchOffset) = 0;
+    // Writer of a section starting at patchOffset, for the codecs other than bzip2
+    virtual std::unique_ptr<UpdatePatchWriter> CreateSectionWriter(size_t patchOffset) = 0;
     virtual int32_t WritePatchHeader(int64_t controlSize,
         int64_t diffDataSize, int64_t newSize, size_t &headerLen) = 0;
 
+    std::unique_ptr<DeflateAdapter> CreateSectionAdapter(size_t patchOffset);
+    // Old data of 2 GiB and more takes 64 bit indexes, fails if the host cannot hold them
+    int32_t CreateSuffixArray(const BlockBuffer &oldInfo);
+    int32_t MakeSinglePatch(const BlockBuffer &newInfo, const BlockBuffer &oldInfo, size_t &patchSize);
+    // BSDIFF42 patch, the windows share the suffix array of the old data
+    int32_t MakeWindowedPatch(const BlockBuffer &newInfo, const BlockBuffer &oldInfo, size_t &patchSize);
+
     int32_t GetCtrlDatas(const BlockBuffer &newInfo,
         const BlockBuffer &oldInfo, std::vector<ControlData> &controlDatas);
+    int32_t ScanCtrlDatas(const BlockBuffer &newInfo,
+        const BlockBuffer &oldInfo, std::vector<ControlData> &controlDatas);
+    int32_t ScanWindowsConcurrently(const BlockBuffer &newInfo,
+        const BlockBuffer &oldInfo, std::vector<ControlData> &controlDatas);
     int32_t WritePatchData(const std::vector<ControlData> &controlDatas,
         const BlockBuffer &newInfo, size_t &patchSize);
     int32_t WriteControlData(const std::vector<ControlData> controlDatas, size_t &patchSize);
@@ -76,13 +122,25 @@ private:
     void ComputeLength(const BlockBuffer &newInfo,
         const BlockBuffer &oldInfo, int64_t &lengthFront, int64_t &lengthBack);
 
-    std::unique_ptr<SuffixArray<int32_t>> suffixArray_ {nullptr};
+    std::shared_ptr<SuffixArrayBase> suffixArray_ {nullptr};
     std::vector<ControlData> controls_ {};
     int64_t matchPos_ { 0 };
     int64_t currentOffset_ { 0 };
     int64_t lastOffset_ { 0 };
     int64_t lastScan_ { 0 };
     int64_t lastPos_ { 0 };
+    uint8_t codec_ { sectionCodec_.load() };
+    size_t windowSize_ { patchWindowSize_.load() };
+    uint8_t suffixSort_ { suffixSortType_.load() };
+    size_t scanWindowSize_ { patchScanWindowSize_.load() };
+    std::unique_ptr<UpdatePatchWriter> sectionWriter_ { nullptr };
+
+    static std::atomic<uint8_t> sectionCodec_;
+    static std::atomic<size_t> patchWindowSize_;
+    static std::atomic<uint8_t> suffixSortType_;
+    static std::atomic<size_t> memoryLimit_;
+    static std::atomic<size_t> patchScanWindowSize_;
+    static std::atomic<size_t> scanWorkers_;
 };
 
 class BlocksStreamDiff : public BlocksDiff {
@@ -92,6 +150,7 @@ public:
 
 private:
     std::unique_ptr<DeflateAdapter> CreateBZip2Adapter(size_t patchOffset) override;
+    std::unique_ptr<UpdatePatchWriter> CreateSectionWriter(size_t patchOffset) override;
     int32_t WritePatchHeader(int64_t controlSize,
         int64_t diffDataSize, int64_t newSize, size_t &headerLen) override;
     std::fstream &stream_;
@@ -106,6 +165,7 @@ public:
 
 private:
     std::unique_ptr<DeflateAdapter> CreateBZip2Adapter(size_t patchOffset) override;
+    std::unique_ptr<UpdatePatchWriter> CreateSectionWriter(size_t patchOffset) override;
     int32_t WritePatchHeader(int64_t controlSize,
         int64_t diffDataSize, int64_t newSize, size_t &headerLen) override;
     std::vector<uint8_t> &patchData_;
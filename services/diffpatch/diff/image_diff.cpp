@@ -14,9 +14,12 @@
  */
 
 #include "image_diff.h"
+#include <algorithm>
 #include <iostream>
+#include <thread>
 #include <vector>
 #include "diffpatch.h"
+#include "zlib.h"
 
 using namespace Hpackage;
 
@@ -25,6 +28,50 @@ namespace UpdatePatch {
 constexpr int32_t LZ4F_MAX_BLOCKID = 7;
 constexpr int32_t ZIP_MAX_LEVEL = 9;
 constexpr int32_t MAX_NEW_LENGTH = 1 << 20;
+// smaller entries are probed on one thread, starting threads would take longer
+constexpr size_t MIN_PROBE_PARALLEL_LENGTH = 64 * 1024;
+
+// every worker holds a suffix array and starts its own scan threads, so more are only used on request
+std::atomic<size_t> ImageDiff::diffWorkers_ { 1 };
+
+std::atomic<size_t> ZipImageDiff::probeWorkers_ {
+    std::max(static_cast<size_t>(std::thread::hardware_concurrency()), static_cast<size_t>(1))
+};
+
+namespace {
+constexpr size_t PROBE_BUFFER_SIZE = 64 * 1024;
+
+/*
+ * Deflate buffer as ZipAdapter does when the patch is applied and compare the
+ * output with orgData as it comes, so a wrong level stops at the first
+ * different chunk instead of finishing the compression.
+ */
+bool IsSameDeflate(const ZipFileInfo &zipInfo, int32_t level, const BlockBuffer &buffer, const BlockBuffer &orgData)
+{
+    z_stream zstream {};
+    if (deflateInit2(&zstream, level, zipInfo.method, zipInfo.windowBits, zipInfo.memLevel, zipInfo.strategy) != Z_OK) {
+        PATCH_LOGE("Failed to deflateInit2 level %d", level);
+        return false;
+    }
+    std::vector<uint8_t> out(PROBE_BUFFER_SIZE);
+    zstream.next_in = buffer.buffer;
+    zstream.avail_in = static_cast<uInt>(buffer.length);
+    size_t offset = 0;
+    bool isSame = true;
+    int32_t ret = Z_OK;
+    while (isSame && ret == Z_OK) {
+        zstream.next_out = out.data();
+        zstream.avail_out = static_cast<uInt>(out.size());
+        ret = deflate(&zstream, zstream.avail_in != 0 ? Z_NO_FLUSH : Z_FINISH);
+        size_t len = out.size() - zstream.avail_out;
+        isSame = (ret == Z_OK || ret == Z_STREAM_END) && orgData.length - offset >= len &&
+            memcmp(orgData.buffer + offset, out.data(), len) == 0;
+        offset += len;
+    }
+    deflateEnd(&zstream);
+    return isSame && ret == Z_STREAM_END && offset == orgData.length;
+}
+} // namespace
 
 template<class DataType>
 static void WriteToFile(std::ofstream &patchFile, DataType data, size_t dataSize)
@@ -48,6 +95,24 @@ static size_t GetHeaderSize(const ImageBlock &block)
     }
 }
 
+// Old and new data the bsdiff patch of block is made of, false if the block has no patch
+static bool GetPatchSource(ImageBlock &block, BlockBuffer &newInfo, BlockBuffer &oldInfo)
+{
+    switch (block.type) {
+        case BLOCK_NORMAL:
+            newInfo = { block.newInfo.buffer + block.newInfo.start, block.newInfo.length };
+            oldInfo = { block.oldInfo.buffer + block.oldInfo.start, block.oldInfo.length };
+            return true;
+        case BLOCK_DEFLATE:
+        case BLOCK_LZ4:
+            newInfo = { block.destOriginalData.data(), block.destOriginalLength };
+            oldInfo = { block.srcOriginalData.data(), block.srcOriginalLength };
+            return true;
+        default:
+            return false;
+    }
+}
+
 int32_t ImageDiff::MakePatch(const std::string &patchName)
 {
     PATCH_LOGI("ImageDiff::MakePatch %s limit_:%d", patchName.c_str(), limit_);
@@ -154,6 +219,10 @@ int32_t ImageDiff::WriteHeader(std::ofstream &patchFile,
 int32_t ImageDiff::MakeBlockPatch(ImageBlock &block, std::fstream &blockPatchFile,
     const BlockBuffer &newInfo, const BlockBuffer &oldInfo, size_t &patchSize) const
 {
+    if (block.isPatched) {
+        patchSize = block.patchData.size();
+        return 0;
+    }
     if (!usePatchFile_) {
         std::vector<uint8_t> patchData;
         int32_t ret = BlocksDiff::MakePatch(newInfo, oldInfo, patchData, 0, patchSize);
@@ -205,6 +274,59 @@ int32_t ImageDiff::WritePatch(std::ofstream &patchFile, std::fstream &blockPatch
     return 0;
 }
 
+int32_t ImageDiff::MakeBlockPatches()
+{
+    if (diffWorkers_.load() <= 1 || usePatchFile_) {
+        // made one after the other while the headers are written, large patches are streamed to the file
+        return 0;
+    }
+    std::vector<size_t> indexes {};
+    std::vector<size_t> lengths(updateBlocks_.size(), 0);
+    BlockBuffer newInfo {};
+    BlockBuffer oldInfo {};
+    for (size_t index = 0; index < updateBlocks_.size(); index++) {
+        if (GetPatchSource(updateBlocks_[index], newInfo, oldInfo)) {
+            indexes.push_back(index);
+            lengths[index] = newInfo.length;
+        }
+    }
+    size_t workerCount = std::min(diffWorkers_.load(), indexes.size());
+    if (workerCount <= 1) {
+        return 0;
+    }
+    // the largest blocks go first so that a late one does not keep a single thread busy
+    std::stable_sort(indexes.begin(), indexes.end(), [&lengths](size_t left, size_t right) {
+        return lengths[left] > lengths[right];
+    });
+    PATCH_LOGI("MakeBlockPatches %zu blocks on %zu threads", indexes.size(), workerCount);
+    std::atomic<size_t> next { 0 };
+    std::atomic<bool> failed { false };
+    auto workerRun = [&]() {
+        for (size_t i = next++; i < indexes.size() && !failed.load(); i = next++) {
+            ImageBlock &block = updateBlocks_[indexes[i]];
+            BlockBuffer blockNew {};
+            BlockBuffer blockOld {};
+            GetPatchSource(block, blockNew, blockOld);
+            size_t patchSize = 0;
+            if (BlocksDiff::MakePatch(blockNew, blockOld, block.patchData, 0, patchSize) != 0) {
+                PATCH_LOGE("Failed to make patch of block %zu", indexes[i]);
+                failed = true;
+                return;
+            }
+            block.isPatched = true;
+        }
+    };
+    std::vector<std::thread> workers {};
+    for (size_t i = 1; i < workerCount; i++) {
+        workers.emplace_back(workerRun);
+    }
+    workerRun();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    return failed.load() ? -1 : 0;
+}
+
 int32_t ImageDiff::DiffImage(const std::string &patchName)
 {
     std::fstream blockPatchFile;
@@ -235,6 +357,11 @@ int32_t ImageDiff::DiffImage(const std::string &patchName)
         }
     }
 
+    if (MakeBlockPatches() != 0) {
+        PATCH_LOGE("Failed to make block patches");
+        return -1;
+    }
+
     for (size_t index = 0; index < updateBlocks_.size(); index++) {
         PATCH_LOGI("DiffImage [%zu] write header patchOffset %zu dataOffset %zu",
             index, static_cast<size_t>(patchFile.tellp()), dataOffset);
@@ -256,6 +383,16 @@ int32_t ImageDiff::DiffImage(const std::string &patchName)
     return 0;
 }
 
+void ImageDiff::SetDiffWorkers(size_t count)
+{
+    diffWorkers_ = std::max(count, static_cast<size_t>(1));
+}
+
+size_t ImageDiff::GetDiffWorkers()
+{
+    return diffWorkers_;
+}
+
 int32_t CompressedImageDiff::MakePatch(const std::string &patchName)
 {
     PATCH_DEBUG("CompressedImageDiff::MakePatch %s limit_:%d", patchName.c_str(), limit_);
@@ -454,22 +591,69 @@ int32_t ZipImageDiff::TestAndSetConfig(const BlockBuffer &buffer, const std::str
         level_, method_, windowBits_, memLevel_, strategy_);
     BlockBuffer orgData = {orgNewBuffer.buffer + fileInfo->dataOffset, fileInfo->packedSize};
     PATCH_DEBUG("DiffFile new orignial hash %zu %s", fileInfo->packedSize, GeneraterBufferHash(orgData).c_str());
-    std::vector<uint8_t> data;
+
+    // entries of an archive are mostly compressed alike, the level of the last alike entry goes first
+    auto key = std::make_tuple(method_, windowBits_, memLevel_, strategy_);
+    std::vector<int32_t> levels {};
+    auto guess = levelGuesses_.find(key);
+    if (guess != levelGuesses_.end()) {
+        levels.push_back(guess->second);
+    }
     for (int32_t i = ZIP_MAX_LEVEL; i >= 0; i--) {
-        zipInfo.level = i;
-        size_t bufferSize = 0;
-        ret = CompressData(&zipInfo.fileInfo, buffer, data, bufferSize);
-        if (ret != 0) {
-            PATCH_LOGE("Can not Compress buff");
-            return -1;
+        if (levels.empty() || levels[0] != i) {
+            levels.push_back(i);
         }
-        if ((bufferSize == fileInfo->packedSize) &&
-            memcmp(data.data(), orgNewBuffer.buffer + fileInfo->dataOffset, bufferSize) == 0) {
-            level_ = i;
-            return 0;
+    }
+    int32_t index = ProbeLevels(zipInfo, levels, buffer, orgData);
+    if (index < 0) {
+        PATCH_LOGE("No level gives %s again", fileName.c_str());
+        return -1;
+    }
+    level_ = levels[index];
+    levelGuesses_[key] = level_;
+    return 0;
+}
+
+int32_t ZipImageDiff::ProbeLevels(const ZipFileInfo &zipInfo, const std::vector<int32_t> &levels,
+    const BlockBuffer &buffer, const BlockBuffer &orgData) const
+{
+    if (IsSameDeflate(zipInfo, levels[0], buffer, orgData)) {
+        return 0;
+    }
+    int32_t count = static_cast<int32_t>(levels.size());
+    size_t workerCount = buffer.length < MIN_PROBE_PARALLEL_LENGTH ? 1 :
+        std::min(probeWorkers_.load(), levels.size() - 1);
+    // the first matching level in the order of levels wins, later ones are not started once it is known
+    std::atomic<int32_t> next { 1 };
+    std::atomic<int32_t> found { count };
+    auto workerRun = [&]() {
+        for (int32_t i = next++; i < found.load(); i = next++) {
+            if (!IsSameDeflate(zipInfo, levels[i], buffer, orgData)) {
+                continue;
+            }
+            int32_t current = found.load();
+            while (i < current && !found.compare_exchange_weak(current, i)) {}
         }
+    };
+    std::vector<std::thread> workers {};
+    for (size_t i = 1; i < workerCount; i++) {
+        workers.emplace_back(workerRun);
     }
-    return -1;
+    workerRun();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    return found.load() < count ? found.load() : -1;
+}
+
+void ZipImageDiff::SetProbeWorkers(size_t count)
+{
+    probeWorkers_ = std::max(count, static_cast<size_t>(1));
+}
+
+size_t ZipImageDiff::GetProbeWorkers()
+{
+    return probeWorkers_;
 }
 
 int32_t Lz4ImageDiff::WriteHeader(std::ofstream &patchFile,
@@ -15,8 +15,11 @@
 
 #ifndef IMGAE_DIFF_H
 #define IMGAE_DIFF_H
+#include <atomic>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <tuple>
 #include <vector>
 #include "blocks_diff.h"
 #include "update_diff.h"
@@ -31,6 +34,8 @@ struct ImageBlock {
     std::vector<uint8_t> patchData;
     std::vector<uint8_t> srcOriginalData;
     std::vector<uint8_t> destOriginalData;
+    // patchData was made ahead by MakeBlockPatches
+    bool isPatched { false };
 };
 
 class ImageDiff {
@@ -47,18 +52,27 @@ public:
     virtual int32_t WriteHeader(std::ofstream &patchFile,
         std::fstream &blockPatchFile, size_t &dataOffset, ImageBlock &block) const;
 
+    // Threads that make the bsdiff patches of the blocks at the same time, 1 by default,
+    // patches streamed to the bspatch file are always made one after the other
+    static void SetDiffWorkers(size_t count);
+    static size_t GetDiffWorkers();
+
 protected:
     int32_t SplitImage(const PatchBuffer &oldInfo, const PatchBuffer &newInfo);
     int32_t DiffImage(const std::string &patchName);
     int32_t MakeBlockPatch(ImageBlock &block, std::fstream &blockPatchFile,
         const BlockBuffer &newInfo, const BlockBuffer &oldInfo, size_t &patchSize) const;
     int32_t WritePatch(std::ofstream &patchFile, std::fstream &blockPatchFile);
+    int32_t MakeBlockPatches();
 
     size_t limit_;
     std::vector<ImageBlock> updateBlocks_ {};
     UpdateDiff::ImageParserPtr newParser_ {nullptr};
     UpdateDiff::ImageParserPtr oldParser_ {nullptr};
     bool usePatchFile_ { false };
+
+private:
+    static std::atomic<size_t> diffWorkers_;
 };
 
 class CompressedImageDiff : public ImageDiff {
@@ -90,6 +104,10 @@ public:
     int32_t WriteHeader(std::ofstream &patchFile,
         std::fstream &blockPatchFile, size_t &dataOffset, ImageBlock &block) const override;
 
+    // Threads that recompress an entry at the candidate levels at the same time
+    static void SetProbeWorkers(size_t count);
+    static size_t GetProbeWorkers();
+
 protected:
     int32_t TestAndSetConfig(const BlockBuffer &buffer, const std::string &fileName) override;
 
@@ -98,6 +116,15 @@ protected:
     int32_t windowBits_ = 0;
     int32_t memLevel_ = 0;
     int32_t strategy_ = 0;
+
+private:
+    // Index of the first of levels that gives orgData again, -1 if none does
+    int32_t ProbeLevels(const Hpackage::ZipFileInfo &zipInfo, const std::vector<int32_t> &levels,
+        const BlockBuffer &buffer, const BlockBuffer &orgData) const;
+
+    // level that matched the last entry of each (method, windowBits, memLevel, strategy) of the archive
+    std::map<std::tuple<int32_t, int32_t, int32_t, int32_t>, int32_t> levelGuesses_ {};
+    static std::atomic<size_t> probeWorkers_;
 };
 
 class Lz4ImageDiff : public CompressedImageDiff {
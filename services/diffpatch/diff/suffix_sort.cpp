@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "suffix_sort.h"
+#include <algorithm>
+
+namespace UpdatePatch {
+namespace {
+constexpr size_t ALPHABET_SIZE = 256;
+constexpr uint32_t BITS_PER_BYTE = 8;
+
+/*
+ * One level of SA-IS over text of length characters in [0, alphabet). The
+ * text ends with a virtual sentinel smaller than any character, its suffix is
+ * always sa[0]. The reduced text of the next level is kept in the upper half
+ * of sa, so the only extra memory is the type bits and the buckets.
+ */
+template<class CharType, class DataType>
+class SaisBuilder {
+public:
+    SaisBuilder(const CharType *text, DataType *sa, DataType length, DataType alphabet)
+        : text_(text), sa_(sa), length_(length), alphabet_(alphabet),
+          types_(static_cast<size_t>(length) / BITS_PER_BYTE + 1, 0) {}
+    ~SaisBuilder() {}
+
+    void Build();
+
+private:
+    static constexpr DataType EMPTY = -1;
+
+    bool IsS(DataType i) const
+    {
+        return ((types_[i / BITS_PER_BYTE] >> (i % BITS_PER_BYTE)) & 1) != 0;
+    }
+    void SetS(DataType i)
+    {
+        types_[i / BITS_PER_BYTE] |= static_cast<uint8_t>(1u << (i % BITS_PER_BYTE));
+    }
+    // leftmost S type position, the sentinel is one
+    bool IsLms(DataType i) const
+    {
+        return i > 0 && IsS(i) && !IsS(i - 1);
+    }
+
+    void ClassifyTypes();
+    void CountCharacters();
+    void GetBucketHeads();
+    void GetBucketTails();
+    void InduceL();
+    void InduceS();
+    bool IsEqualLms(DataType first, DataType second) const;
+    DataType NameLmsSubstrings(DataType lmsCount);
+    void SortReduced(DataType lmsCount, DataType nameCount);
+
+    const CharType *text_;
+    DataType *sa_;
+    DataType length_;
+    DataType alphabet_;
+    std::vector<uint8_t> types_;
+    std::vector<DataType> counts_;
+    std::vector<DataType> buckets_;
+};
+
+template<class CharType, class DataType>
+void SaisBuilder<CharType, DataType>::Build()
+{
+    sa_[0] = length_;
+    if (length_ == 0) {
+        return;
+    }
+    ClassifyTypes();
+    CountCharacters();
+
+    // sort the LMS substrings
+    std::fill(sa_ + 1, sa_ + length_ + 1, EMPTY);
+    GetBucketTails();
+    for (DataType i = 1; i < length_; i++) {
+        if (IsLms(i)) {
+            sa_[--buckets_[text_[i]]] = i;
+        }
+    }
+    InduceL();
+    InduceS();
+
+    DataType lmsCount = 0;
+    for (DataType i = 0; i <= length_; i++) {
+        if (IsLms(sa_[i])) {
+            sa_[lmsCount++] = sa_[i];
+        }
+    }
+    DataType nameCount = NameLmsSubstrings(lmsCount);
+    SortReduced(lmsCount, nameCount);
+
+    // the LMS suffixes are sorted now, induce all the others from them
+    std::fill(sa_ + lmsCount, sa_ + length_ + 1, EMPTY);
+    GetBucketTails();
+    for (DataType i = lmsCount - 1; i > 0; i--) {
+        DataType pos = sa_[i];
+        sa_[i] = EMPTY;
+        sa_[--buckets_[text_[pos]]] = pos;
+    }
+    InduceL();
+    InduceS();
+}
+
+template<class CharType, class DataType>
+void SaisBuilder<CharType, DataType>::ClassifyTypes()
+{
+    SetS(length_);
+    for (DataType i = length_ - 2; i >= 0; i--) {
+        if (text_[i] < text_[i + 1] || (text_[i] == text_[i + 1] && IsS(i + 1))) {
+            SetS(i);
+        }
+    }
+}
+
+template<class CharType, class DataType>
+void SaisBuilder<CharType, DataType>::CountCharacters()
+{
+    counts_.assign(static_cast<size_t>(alphabet_), 0);
+    buckets_.resize(static_cast<size_t>(alphabet_));
+    for (DataType i = 0; i < length_; i++) {
+        counts_[text_[i]]++;
+    }
+}
+
+// sa[0] is the bucket of the sentinel, the bucket of the first character starts at 1
+template<class CharType, class DataType>
+void SaisBuilder<CharType, DataType>::GetBucketHeads()
+{
+    DataType sum = 1;
+    for (size_t c = 0; c < counts_.size(); c++) {
+        buckets_[c] = sum;
+        sum += counts_[c];
+    }
+}
+
+template<class CharType, class DataType>
+void SaisBuilder<CharType, DataType>::GetBucketTails()
+{
+    DataType sum = 1;
+    for (size_t c = 0; c < counts_.size(); c++) {
+        sum += counts_[c];
+        buckets_[c] = sum;
+    }
+}
+
+template<class CharType, class DataType>
+void SaisBuilder<CharType, DataType>::InduceL()
+{
+    GetBucketHeads();
+    for (DataType i = 0; i <= length_; i++) {
+        DataType pos = sa_[i] - 1;
+        if (sa_[i] > 0 && !IsS(pos)) {
+            sa_[buckets_[text_[pos]]++] = pos;
+        }
+    }
+}
+
+template<class CharType, class DataType>
+void SaisBuilder<CharType, DataType>::InduceS()
+{
+    GetBucketTails();
+    for (DataType i = length_; i >= 0; i--) {
+        DataType pos = sa_[i] - 1;
+        if (sa_[i] > 0 && IsS(pos)) {
+            sa_[--buckets_[text_[pos]]] = pos;
+        }
+    }
+}
+
+template<class CharType, class DataType>
+bool SaisBuilder<CharType, DataType>::IsEqualLms(DataType first, DataType second) const
+{
+    for (DataType d = 0;; d++) {
+        // only one substring holds the sentinel
+        if (first + d == length_ || second + d == length_) {
+            return false;
+        }
+        if (text_[first + d] != text_[second + d] || IsS(first + d) != IsS(second + d)) {
+            return false;
+        }
+        // the types so far are the same, so both substrings end here
+        if (d > 0 && IsLms(first + d)) {
+            return true;
+        }
+    }
+}
+
+/*
+ * The sorted LMS substrings are in sa[0, lmsCount). Each gets the rank of its
+ * substring as name, the names in text order are the reduced text, stored in
+ * the last lmsCount entries of sa. The sentinel gets name 0.
+ */
+template<class CharType, class DataType>
+DataType SaisBuilder<CharType, DataType>::NameLmsSubstrings(DataType lmsCount)
+{
+    // LMS positions are at least 2 apart, pos / 2 does not collide
+    std::fill(sa_ + lmsCount, sa_ + length_ + 1, EMPTY);
+    DataType nameCount = 0;
+    DataType prev = EMPTY;
+    for (DataType i = 0; i < lmsCount; i++) {
+        DataType pos = sa_[i];
+        if (prev == EMPTY || !IsEqualLms(pos, prev)) {
+            nameCount++;
+            prev = pos;
+        }
+        sa_[lmsCount + pos / 2] = nameCount - 1;
+    }
+    DataType j = length_;
+    for (DataType i = length_; i >= lmsCount; i--) {
+        if (sa_[i] != EMPTY) {
+            sa_[j--] = sa_[i];
+        }
+    }
+    return nameCount;
+}
+
+// Replace sa[0, lmsCount) with the LMS positions in the order of their suffixes
+template<class CharType, class DataType>
+void SaisBuilder<CharType, DataType>::SortReduced(DataType lmsCount, DataType nameCount)
+{
+    // the reduced text without its sentinel, over names [0, nameCount - 1)
+    DataType reducedLength = lmsCount - 1;
+    DataType *reduced = sa_ + length_ + 1 - lmsCount;
+    for (DataType i = 0; i < reducedLength; i++) {
+        reduced[i]--;
+    }
+    if (nameCount < lmsCount) {
+        // only one level holds its buckets at a time, they are counted again afterwards
+        std::vector<DataType>().swap(counts_);
+        std::vector<DataType>().swap(buckets_);
+        SaisBuilder<DataType, DataType>(reduced, sa_, reducedLength, nameCount - 1).Build();
+        CountCharacters();
+    } else {
+        // all names are unique, the names are the ranks
+        sa_[0] = reducedLength;
+        for (DataType i = 0; i < reducedLength; i++) {
+            sa_[reduced[i] + 1] = i;
+        }
+    }
+    DataType j = 0;
+    for (DataType i = 1; i <= length_; i++) {
+        if (IsLms(i)) {
+            reduced[j++] = i;
+        }
+    }
+    for (DataType i = 0; i < lmsCount; i++) {
+        sa_[i] = reduced[sa_[i]];
+    }
+}
+} // namespace
+
+template<class DataType>
+void SaisSort(const uint8_t *data, DataType length, std::vector<DataType> &suffixArray)
+{
+    suffixArray.resize(static_cast<size_t>(length) + 1);
+    SaisBuilder<uint8_t, DataType>(data, suffixArray.data(), length, ALPHABET_SIZE).Build();
+}
+
+template void SaisSort<int32_t>(const uint8_t *data, int32_t length, std::vector<int32_t> &suffixArray);
+template void SaisSort<int64_t>(const uint8_t *data, int64_t length, std::vector<int64_t> &suffixArray);
+} // namespace UpdatePatch
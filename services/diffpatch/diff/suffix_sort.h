@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SUFFIX_SORT_H
+#define SUFFIX_SORT_H
+
+#include <cstdint>
+#include <vector>
+
+namespace UpdatePatch {
+/*
+ * Suffix array of data built by induced sorting (SA-IS), in time linear in
+ * length. suffixArray gets length + 1 entries with the empty suffix first,
+ * the layout of the qsufsort of SuffixArray. A suffix array is unique, so
+ * both sorts give the same patches.
+ */
+template<class DataType>
+void SaisSort(const uint8_t *data, DataType length, std::vector<DataType> &suffixArray);
+} // namespace UpdatePatch
+#endif // SUFFIX_SORT_H
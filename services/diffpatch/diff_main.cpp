@@ -12,6 +12,8 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include "blocks_diff.h"
+#include "image_diff.h"
 #include "update_diff.h"
 #include "update_patch.h"
 #include <getopt.h>
@@ -22,15 +24,20 @@ struct DiffParams {
     std::string patch;
     int limit;
     int block;
+    int codec;
+    size_t window;
+    int sort;
+    size_t scanWindow;
+    int workers;
 };
 
 int main(int argc, char *argv[])
 {
     DiffParams diffParams {
-        "", "", "", 0, 0
+        "", "", "", 0, 0, PATCH_CODEC_BZIP2, 0, SUFFIX_SORT_SAIS, 0, 0
     };
     int opt;
-    const char *optstring = "s:d:p:l:b:";
+    const char *optstring = "s:d:p:l:b:c:w:a:t:j:";
     while ((opt = getopt(argc, argv, optstring)) != -1) {
         switch (opt) {
             case 's':
@@ -48,6 +55,21 @@ int main(int argc, char *argv[])
             case 'b':
                 diffParams.block = atoi(optarg);
                 break;
+            case 'c':
+                diffParams.codec = atoi(optarg);
+                break;
+            case 'w':
+                diffParams.window = static_cast<size_t>(atol(optarg));
+                break;
+            case 'a':
+                diffParams.sort = atoi(optarg);
+                break;
+            case 't':
+                diffParams.scanWindow = static_cast<size_t>(atol(optarg));
+                break;
+            case 'j':
+                diffParams.workers = atoi(optarg);
+                break;
             case '?':
                 break;
             default:
@@ -57,6 +79,15 @@ int main(int argc, char *argv[])
 
     // pack
     if (diffParams.source != "" && diffParams.destination != "" && diffParams.patch != "") {
+        UpdatePatch::BlocksDiff::SetSectionCodec(static_cast<uint8_t>(diffParams.codec));
+        UpdatePatch::BlocksDiff::SetWindowSize(diffParams.window);
+        UpdatePatch::BlocksDiff::SetSuffixSort(static_cast<uint8_t>(diffParams.sort));
+        UpdatePatch::BlocksDiff::SetScanWindowSize(diffParams.scanWindow);
+        if (diffParams.workers > 0) {
+            UpdatePatch::BlocksDiff::SetScanWorkers(static_cast<size_t>(diffParams.workers));
+            UpdatePatch::ImageDiff::SetDiffWorkers(static_cast<size_t>(diffParams.workers));
+            UpdatePatch::ZipImageDiff::SetProbeWorkers(static_cast<size_t>(diffParams.workers));
+        }
         if (diffParams.block != 1) {
             UpdatePatch::UpdateDiff::DiffImage(
                 diffParams.limit,
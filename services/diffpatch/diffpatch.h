@@ -97,6 +97,23 @@ enum {
     40	48	Bzip2ed diff block
     48	56	Bzip2ed extra block
 */
+/* A patch whose sections use other codecs starts with "BSDIFF41", the
+   lengths above are those of the encoded blocks and the header goes on with
+    32	1	codec of ctrl block   [PATCH_CODEC_{BZIP2, LZ4, STORED}]
+    33	1	codec of diff block
+    34	1	codec of extra block
+    35	5	reserved
+   so the ctrl block starts at 40.
+*/
+/* A patch of a new file cut into windows starts with "BSDIFF42"
+    0	8	 "BSDIFF42"
+    8	8	window size
+    16	8	window count
+    24	8	length of new file
+    32	16	for each window, offset [from start of patch] and length of its patch
+   The patch of a window is a BSDIFF40 or BSDIFF41 patch of its part of the
+   new file against the whole old file, so the windows apply on their own.
+*/
 
 // patch block types
 #define BLOCK_NORMAL 0
@@ -105,6 +122,15 @@ enum {
 #define BLOCK_RAW 3
 #define BLOCK_LZ4 4
 
+// bsdiff section codecs
+#define PATCH_CODEC_BZIP2 0
+#define PATCH_CODEC_LZ4 1
+#define PATCH_CODEC_STORED 2
+
+// suffix sorts of the old data of bsdiff, both give the same patches
+#define SUFFIX_SORT_QSUFSORT 0
+#define SUFFIX_SORT_SAIS 1
+
 static constexpr size_t GZIP_HEADER_LEN = 10;
 static constexpr size_t VERSION = 2;
 static constexpr unsigned short HEADER_CRC = 0x02; /* bit 1 set: CRC16 for the gzip header */
@@ -128,6 +154,8 @@ static constexpr int PATCH_DEFLATE_MIN_HEADER_LEN = 60;
 static constexpr int PATCH_LZ4_MIN_HEADER_LEN = 64;
 
 constexpr const char *BSDIFF_MAGIC = "BSDIFF40";
+constexpr const char *BSDIFF_CODEC_MAGIC = "BSDIFF41";
+constexpr const char *BSDIFF_WINDOW_MAGIC = "BSDIFF42";
 constexpr const char *PKGDIFF_MAGIC = "PKGDIFF0";
 
 struct PatchHeader {
@@ -14,9 +14,15 @@
  */
 
 #include "blocks_patch.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <vector>
+#include "byte_add.h"
 #include "diffpatch.h"
 
 using namespace Hpackage;
@@ -24,8 +30,48 @@ using namespace std;
 
 namespace UpdatePatch {
 #define PATCH_MIN std::char_traits<char>::length(BSDIFF_MAGIC) + sizeof(int64_t) * 3
+constexpr size_t SECTION_CODECS_LEN = 8;
 #define GET_BYTE_FROM_BUFFER(v, index, buffer)  ((v) * 256 + (buffer)[index])
 constexpr uint8_t BUFFER_MASK = 0x80;
+constexpr size_t DECODE_QUEUE_LIMIT = 1024 * 1024;
+// Smaller patches decode faster than the threads start.
+constexpr size_t PIPELINE_MIN_PATCH = 256 * 1024;
+constexpr size_t CONTROL_TUPLE_SIZE = sizeof(int64_t) * 3;
+constexpr size_t CONTROL_BATCH = 2048;
+constexpr size_t SKIP_BUFFER_SIZE = 64 * 1024;
+constexpr size_t WINDOW_HEADER_LEN = 32;
+constexpr size_t WINDOW_ENTRY_LEN = 16;
+
+std::atomic<size_t> BlocksPatch::decodeQueueLimit_ { DECODE_QUEUE_LIMIT };
+std::atomic<size_t> BlocksPatch::totalTupleCount_ { 0 };
+std::atomic<uint64_t> BlocksPatch::totalDecodeTime_ { 0 };
+// window threads would nest under the command scheduler workers and the section decoder threads
+std::atomic<size_t> BlocksPatch::windowWorkers_ { 1 };
+
+namespace {
+// Output of a window applied in place, it starts at the offset of the window
+class WindowWriter : public UpdatePatchWriter {
+public:
+    WindowWriter(UpdatePatchWriterPtr writer, int64_t offset) : writer_(writer), offset_(offset) {}
+    ~WindowWriter() override {}
+
+    int32_t Init() override
+    {
+        return 0;
+    }
+    int32_t Write(size_t start, const BlockBuffer &buffer, size_t len) override
+    {
+        return writer_->Write(static_cast<size_t>(offset_) + start, buffer, len);
+    }
+    int32_t Finish() override
+    {
+        return 0;
+    }
+private:
+    UpdatePatchWriterPtr writer_ { nullptr };
+    int64_t offset_ { 0 };
+};
+} // namespace
 
 static int64_t ReadLE64(const uint8_t *buffer)
 {
@@ -57,8 +103,19 @@ static int64_t ReadLE64(const uint8_t *buffer)
     return y;
 }
 
+// Part [begin, end) of a diff of length at oldOffset that lies inside the old data, the rest is copied as is.
+static bool GetOldRange(int64_t oldOffset, int64_t length, size_t oldLength, int64_t &begin, int64_t &end)
+{
+    begin = std::max(static_cast<int64_t>(0), -oldOffset);
+    end = std::min(length, static_cast<int64_t>(oldLength) - oldOffset);
+    return begin < end;
+}
+
 int32_t BlocksPatch::ApplyPatch()
 {
+    if (IsWindowedPatch()) {
+        return ApplyWindows();
+    }
     int64_t controlDataSize = 0;
     int64_t diffDataSize = 0;
     int32_t ret = ReadHeader(controlDataSize, diffDataSize, newSize_);
@@ -66,46 +123,452 @@ int32_t BlocksPatch::ApplyPatch()
         PATCH_LOGE("Failed to read header ");
         return -1;
     }
-
-    while (newOffset_ < newSize_) {
-        ControlData ctrlData {};
-        ret = ReadControlData(ctrlData);
+    // the rest of the tuple a resumed checkpoint is inside of
+    ControlData ctrlData {};
+    bool isPartial = false;
+    if (resume_ != nullptr) {
+        ret = SkipToCheckpoint(ctrlData, isPartial);
         if (ret != 0) {
-            PATCH_LOGE("Failed to read control data");
             return ret;
         }
+    }
+
+    while (newOffset_ < newSize_) {
+        if (!isPartial) {
+            ret = NextControlData(ctrlData);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+        isPartial = false;
         if (newOffset_ + ctrlData.diffLength > newSize_) {
             PATCH_LOGE("Failed to check new offset %ld %zu", ctrlData.diffLength, newOffset_);
             return PATCH_INVALID_PATCH;
         }
 
-        ret = RestoreDiffData(ctrlData);
+        ret = RestorePieces(ctrlData, true);
         if (ret != 0) {
             PATCH_LOGE("Failed to read diff data");
             return ret;
         }
-        oldOffset_ += ctrlData.diffLength;
-        newOffset_ += ctrlData.diffLength;
         if (newOffset_ + ctrlData.extraLength > newSize_) {
             PATCH_LOGE("Failed to check new offset %ld %zu", ctrlData.diffLength, newOffset_);
             return PATCH_INVALID_PATCH;
         }
 
-        ret = RestoreExtraData(ctrlData);
+        ret = RestorePieces(ctrlData, false);
         if (ret != 0) {
             PATCH_LOGE("Failed to read extra data");
             return ret;
         }
-
-        newOffset_ += ctrlData.extraLength;
         oldOffset_ += ctrlData.offsetIncrement;
+        position_++;
+        if (IsCheckpointDue()) {
+            ret = SaveCheckpoint();
+            if (ret != 0) {
+                return ret;
+            }
+        }
     }
+    totalTupleCount_ += controlStats_.tupleCount;
+    totalDecodeTime_ += controlStats_.decodeTime;
+    PATCH_DEBUG("Control tuples %zu decoded in %llu us", controlStats_.tupleCount,
+        static_cast<unsigned long long>(controlStats_.decodeTime));
     controlDataReader_->Close();
     diffDataReader_->Close();
     extraDataReader_->Close();
     return 0;
 }
 
+void BlocksPatch::SetCheckpoint(size_t interval, const PatchCheckpoint *resume, CheckpointSaver save)
+{
+    checkpointInterval_ = save != nullptr ? interval : 0;
+    resume_ = resume;
+    saveCheckpoint_ = save;
+}
+
+static int32_t SkipData(BZip2ReadAdapter &reader, int64_t length, std::vector<uint8_t> &buffer)
+{
+    while (length > 0) {
+        size_t count = std::min(static_cast<size_t>(length), SKIP_BUFFER_SIZE);
+        buffer.resize(count);
+        BlockBuffer data = {buffer.data(), count};
+        int32_t ret = reader.ReadData(data);
+        if (ret != 0) {
+            return ret;
+        }
+        length -= static_cast<int64_t>(count);
+    }
+    return 0;
+}
+
+int32_t BlocksPatch::NextControlData(ControlData &ctrlData)
+{
+    if (controlIndex_ == controlTable_.size()) {
+        int32_t ret = ReadControlBatch();
+        if (ret != 0) {
+            PATCH_LOGE("Failed to read control data");
+            return ret;
+        }
+    }
+    ctrlData = controlTable_[controlIndex_++];
+    return 0;
+}
+
+bool BlocksPatch::IsCheckpointDue() const
+{
+    return checkpointInterval_ > 0 && newOffset_ < newSize_ &&
+        newOffset_ - lastCheckpoint_ >= static_cast<int64_t>(checkpointInterval_);
+}
+
+int32_t BlocksPatch::RestorePieces(ControlData &ctrlData, bool isDiff)
+{
+    int64_t &length = isDiff ? ctrlData.diffLength : ctrlData.extraLength;
+    if (checkpointInterval_ == 0 || length <= 0) {
+        int32_t ret = isDiff ? RestoreDiffData(ctrlData) : RestoreExtraData(ctrlData);
+        if (ret != 0) {
+            return ret;
+        }
+        oldOffset_ += isDiff ? length : 0;
+        newOffset_ += length;
+        length = 0;
+        return 0;
+    }
+    while (length > 0) {
+        ControlData piece = ctrlData;
+        piece.diffLength = isDiff ? std::min(length, static_cast<int64_t>(checkpointInterval_)) : 0;
+        piece.extraLength = isDiff ? 0 : std::min(length, static_cast<int64_t>(checkpointInterval_));
+        int64_t pieceLength = isDiff ? piece.diffLength : piece.extraLength;
+        int32_t ret = isDiff ? RestoreDiffData(piece) : RestoreExtraData(piece);
+        if (ret != 0) {
+            return ret;
+        }
+        oldOffset_ += isDiff ? pieceLength : 0;
+        newOffset_ += pieceLength;
+        length -= pieceLength;
+        // a checkpoint at the end of the tuple is taken once offsetIncrement is added
+        bool isTupleLeft = length > 0 || (isDiff && ctrlData.extraLength > 0);
+        if (isTupleLeft && IsCheckpointDue()) {
+            ret = SaveCheckpoint();
+            if (ret != 0) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
+int32_t BlocksPatch::SkipToCheckpoint(ControlData &ctrlData, bool &isPartial)
+{
+    std::vector<uint8_t> buffer {};
+    while (position_ < resume_->position) {
+        int32_t ret = NextControlData(ctrlData);
+        if (ret != 0) {
+            return ret;
+        }
+        if (newOffset_ + ctrlData.diffLength + ctrlData.extraLength > newSize_) {
+            PATCH_LOGE("Failed to check new offset %ld %zu", ctrlData.diffLength, newOffset_);
+            return PATCH_INVALID_PATCH;
+        }
+        if (SkipData(*diffDataReader_, ctrlData.diffLength, buffer) != 0 ||
+            SkipData(*extraDataReader_, ctrlData.extraLength, buffer) != 0) {
+            PATCH_LOGE("Failed to skip patch data");
+            return -1;
+        }
+        newOffset_ += ctrlData.diffLength + ctrlData.extraLength;
+        oldOffset_ += ctrlData.diffLength + ctrlData.offsetIncrement;
+        position_++;
+    }
+    // the checkpoint may be inside of the next tuple
+    int64_t skip = static_cast<int64_t>(resume_->newOffset) - newOffset_;
+    if (skip > 0) {
+        int32_t ret = NextControlData(ctrlData);
+        if (ret != 0) {
+            return ret;
+        }
+        int64_t diffSkip = std::min(skip, std::max(ctrlData.diffLength, static_cast<int64_t>(0)));
+        int64_t extraSkip = skip - diffSkip;
+        if (extraSkip > ctrlData.extraLength || (extraSkip == ctrlData.extraLength && ctrlData.extraLength > 0) ||
+            SkipData(*diffDataReader_, diffSkip, buffer) != 0 || SkipData(*extraDataReader_, extraSkip, buffer) != 0) {
+            PATCH_LOGE("Failed to skip patch data in tuple");
+            return PATCH_INVALID_PATCH;
+        }
+        ctrlData.diffLength -= diffSkip;
+        ctrlData.extraLength -= extraSkip;
+        oldOffset_ += diffSkip;
+        newOffset_ += skip;
+        isPartial = true;
+    }
+    if (newOffset_ != static_cast<int64_t>(resume_->newOffset) || oldOffset_ != resume_->oldOffset) {
+        PATCH_LOGE("Checkpoint does not match patch, new offset %ld old offset %ld", newOffset_, oldOffset_);
+        return PATCH_INVALID_PATCH;
+    }
+    PATCH_LOGI("Resume patch at tuple %llu new offset %ld", static_cast<unsigned long long>(position_), newOffset_);
+    lastCheckpoint_ = newOffset_;
+    return 0;
+}
+
+int32_t BlocksPatch::SaveCheckpoint()
+{
+    PatchCheckpoint checkpoint {};
+    checkpoint.position = position_;
+    checkpoint.oldOffset = oldOffset_;
+    checkpoint.newOffset = static_cast<uint64_t>(newOffset_);
+    int32_t ret = saveCheckpoint_(checkpoint);
+    if (ret != 0) {
+        PATCH_LOGE("Failed to save checkpoint at tuple %llu", static_cast<unsigned long long>(position_));
+        return ret;
+    }
+    lastCheckpoint_ = newOffset_;
+    return 0;
+}
+
+bool BlocksPatch::IsWindowedPatch() const
+{
+    return patchInfo_.buffer != nullptr && patchInfo_.length >= patchInfo_.start &&
+        patchInfo_.length - patchInfo_.start >= WINDOW_HEADER_LEN &&
+        memcmp(patchInfo_.buffer + patchInfo_.start, BSDIFF_WINDOW_MAGIC,
+            std::char_traits<char>::length(BSDIFF_WINDOW_MAGIC)) == 0;
+}
+
+int32_t BlocksPatch::ReadWindows(std::vector<PatchWindow> &windows)
+{
+    if (isWindow_) {
+        PATCH_LOGE("Corrupt patch, window of a windowed patch");
+        return PATCH_INVALID_PATCH;
+    }
+    size_t patchSize = patchInfo_.length - patchInfo_.start;
+    const uint8_t *header = patchInfo_.buffer + patchInfo_.start;
+    size_t offset = std::char_traits<char>::length(BSDIFF_WINDOW_MAGIC);
+    int64_t windowSize = ReadLE64(header + offset);
+    offset += sizeof(int64_t);
+    int64_t count = ReadLE64(header + offset);
+    offset += sizeof(int64_t);
+    newSize_ = ReadLE64(header + offset);
+    if (windowSize <= 0 || newSize_ < 0 || count != newSize_ / windowSize + ((newSize_ % windowSize) != 0 ? 1 : 0) ||
+        static_cast<size_t>(count) > (patchSize - WINDOW_HEADER_LEN) / WINDOW_ENTRY_LEN) {
+        PATCH_LOGE("Invalid windows %ld of %ld for new size %ld", count, windowSize, newSize_);
+        return PATCH_INVALID_PATCH;
+    }
+    windows.resize(static_cast<size_t>(count));
+    const uint8_t *entry = header + WINDOW_HEADER_LEN;
+    for (size_t i = 0; i < windows.size(); i++) {
+        int64_t patchOffset = ReadLE64(entry);
+        int64_t patchLength = ReadLE64(entry + sizeof(int64_t));
+        entry += WINDOW_ENTRY_LEN;
+        if (patchOffset < 0 || patchLength < 0 || static_cast<size_t>(patchOffset) > patchSize ||
+            static_cast<size_t>(patchLength) > patchSize - static_cast<size_t>(patchOffset)) {
+            PATCH_LOGE("Invalid patch of window %zu", i);
+            return PATCH_INVALID_PATCH;
+        }
+        windows[i].patchOffset = static_cast<size_t>(patchOffset);
+        windows[i].patchLength = static_cast<size_t>(patchLength);
+        windows[i].newOffset = static_cast<int64_t>(i) * windowSize;
+        windows[i].newSize = std::min(windowSize, newSize_ - windows[i].newOffset);
+    }
+    return 0;
+}
+
+PatchBuffer BlocksPatch::GetWindowPatch(const PatchWindow &window) const
+{
+    size_t start = patchInfo_.start + window.patchOffset;
+    return {patchInfo_.buffer, start, start + window.patchLength};
+}
+
+int32_t BlocksPatch::ApplyWindows()
+{
+    std::vector<PatchWindow> windows {};
+    int32_t ret = ReadWindows(windows);
+    if (ret != 0) {
+        return ret;
+    }
+    size_t first = 0;
+    if (resume_ != nullptr) {
+        ret = SkipToWindow(windows, first);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    BlockBuffer oldInfo {};
+    if (!GetOldBuffer(oldInfo)) {
+        for (size_t i = first; i < windows.size() && ret == 0; i++) {
+            ret = ApplyWindowInPlace(windows[i]);
+            ret = ret != 0 ? ret : FinishWindow(windows[i]);
+        }
+        return ret;
+    }
+    size_t workerCount = std::min(windowWorkers_.load(), windows.size() - first);
+    if (workerCount > 1) {
+        return ApplyWindowsConcurrently(windows, first, oldInfo, workerCount);
+    }
+    std::vector<uint8_t> output {};
+    for (size_t i = first; i < windows.size() && ret == 0; i++) {
+        ret = ApplyBufferWindow(windows[i], oldInfo, output, true);
+        ret = ret != 0 ? ret : WriteWindow(windows[i], {output.data(), output.size()});
+        ret = ret != 0 ? ret : FinishWindow(windows[i]);
+    }
+    return ret;
+}
+
+int32_t BlocksPatch::ApplyWindowsConcurrently(const std::vector<PatchWindow> &windows, size_t first,
+    const BlockBuffer &oldInfo, size_t workerCount)
+{
+    struct WindowTask {
+        std::vector<uint8_t> output {};
+        int32_t result { 0 };
+        bool done { false };
+    };
+    std::vector<WindowTask> tasks(windows.size());
+    std::mutex mutex {};
+    std::condition_variable workerCond {};
+    std::condition_variable doneCond {};
+    // windows are started in order, at most maxPending of them wait to be written
+    size_t next = first;
+    size_t written = first;
+    size_t maxPending = workerCount * 2;
+    bool stop = false;
+    auto workerRun = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            workerCond.wait(lock, [&] { return stop || (next < windows.size() && next < written + maxPending); });
+            if (stop) {
+                return;
+            }
+            size_t index = next++;
+            lock.unlock();
+            // the decode threads of every window would outnumber the cores
+            int32_t result = ApplyBufferWindow(windows[index], oldInfo, tasks[index].output, false);
+            lock.lock();
+            tasks[index].result = result;
+            tasks[index].done = true;
+            doneCond.notify_all();
+        }
+    };
+    std::vector<std::thread> workers {};
+    for (size_t i = 0; i < workerCount; i++) {
+        workers.emplace_back(workerRun);
+    }
+    int32_t ret = 0;
+    for (size_t i = first; i < windows.size() && ret == 0; i++) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            doneCond.wait(lock, [&] { return tasks[i].done; });
+        }
+        std::vector<uint8_t> &output = tasks[i].output;
+        ret = tasks[i].result;
+        ret = ret != 0 ? ret : WriteWindow(windows[i], {output.data(), output.size()});
+        ret = ret != 0 ? ret : FinishWindow(windows[i]);
+        std::vector<uint8_t>().swap(output);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            written = i + 1;
+        }
+        workerCond.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    workerCond.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    return ret;
+}
+
+int32_t BlocksPatch::ApplyBufferWindow(const PatchWindow &window, const BlockBuffer &oldInfo,
+    std::vector<uint8_t> &output, bool canPipeline) const
+{
+    BlocksBufferPatch patch(GetWindowPatch(window), oldInfo, output);
+    BlocksPatch &windowPatch = patch;
+    windowPatch.isWindow_ = true;
+    windowPatch.canPipeline_ = canPipeline;
+    int32_t ret = windowPatch.ApplyPatch();
+    if (ret != 0 || output.size() != static_cast<size_t>(window.newSize)) {
+        PATCH_LOGE("Failed to apply window at %ld", window.newOffset);
+        return ret != 0 ? ret : PATCH_INVALID_PATCH;
+    }
+    return 0;
+}
+
+int32_t BlocksPatch::ApplyWindowInPlace(const PatchWindow &window)
+{
+    PATCH_LOGE("Window at %ld needs the old data in a buffer", window.newOffset);
+    return -1;
+}
+
+int32_t BlocksPatch::SkipToWindow(const std::vector<PatchWindow> &windows, size_t &first)
+{
+    if (resume_->position > windows.size() || resume_->oldOffset != 0 ||
+        resume_->newOffset != static_cast<uint64_t>(resume_->position < windows.size() ?
+        windows[resume_->position].newOffset : newSize_)) {
+        PATCH_LOGE("Checkpoint does not match windows, window %llu new offset %llu",
+            static_cast<unsigned long long>(resume_->position), static_cast<unsigned long long>(resume_->newOffset));
+        return PATCH_INVALID_PATCH;
+    }
+    first = static_cast<size_t>(resume_->position);
+    position_ = resume_->position;
+    newOffset_ = static_cast<int64_t>(resume_->newOffset);
+    lastCheckpoint_ = newOffset_;
+    PATCH_LOGI("Resume patch at window %zu new offset %ld", first, newOffset_);
+    return 0;
+}
+
+int32_t BlocksPatch::FinishWindow(const PatchWindow &window)
+{
+    newOffset_ = window.newOffset + window.newSize;
+    position_++;
+    return IsCheckpointDue() ? SaveCheckpoint() : 0;
+}
+
+void BlocksPatch::SetWindowWorkers(size_t count)
+{
+    windowWorkers_ = count;
+}
+
+size_t BlocksPatch::GetWindowWorkers()
+{
+    return windowWorkers_;
+}
+
+void BlocksPatch::SetDecodeQueueLimit(size_t limit)
+{
+    decodeQueueLimit_ = limit;
+}
+
+ControlStats BlocksPatch::GetControlStats()
+{
+    ControlStats stats {};
+    stats.tupleCount = totalTupleCount_;
+    stats.decodeTime = totalDecodeTime_;
+    return stats;
+}
+
+void BlocksPatch::ResetControlStats()
+{
+    totalTupleCount_ = 0;
+    totalDecodeTime_ = 0;
+}
+
+std::unique_ptr<BZip2ReadAdapter> BlocksPatch::CreateReader(uint8_t codec, size_t offset, size_t length,
+    const BlockBuffer &patchBuffer)
+{
+    switch (codec) {
+        case PATCH_CODEC_BZIP2:
+            if (isPipelined_) {
+                return std::make_unique<BZip2PipelineReadAdapter>(offset, length, patchBuffer, decodeQueueLimit_);
+            }
+            return std::make_unique<BZip2BufferReadAdapter>(offset, length, patchBuffer);
+        case PATCH_CODEC_LZ4:
+            return std::make_unique<Lz4FrameReadAdapter>(offset, length, patchBuffer);
+        case PATCH_CODEC_STORED:
+            return std::make_unique<StoredReadAdapter>(offset, length, patchBuffer);
+        default:
+            PATCH_LOGE("Unknown section codec %d", codec);
+            return nullptr;
+    }
+}
+
 int32_t BlocksPatch::ReadHeader(int64_t &controlDataSize, int64_t &diffDataSize, int64_t &newSize)
 {
     if (patchInfo_.buffer == nullptr || patchInfo_.length < patchInfo_.start ||
@@ -117,7 +580,13 @@ int32_t BlocksPatch::ReadHeader(int64_t &controlDataSize, int64_t &diffDataSize,
     PATCH_DEBUG("Restore patch hash %zu %zu %s",
         patchInfo_.length, patchInfo_.start, GeneraterBufferHash(patchData).c_str());
     uint8_t *header = patchInfo_.buffer + patchInfo_.start;
-    if (memcmp(header, BSDIFF_MAGIC, std::char_traits<char>::length(BSDIFF_MAGIC)) != 0) {
+    uint8_t codecs[] = { PATCH_CODEC_BZIP2, PATCH_CODEC_BZIP2, PATCH_CODEC_BZIP2 };
+    bool hasCodecs = memcmp(header, BSDIFF_CODEC_MAGIC, std::char_traits<char>::length(BSDIFF_CODEC_MAGIC)) == 0;
+    if (hasCodecs && patchInfo_.length - patchInfo_.start <= PATCH_MIN + SECTION_CODECS_LEN) {
+        PATCH_LOGE("Invalid patch length %zu", patchInfo_.length - patchInfo_.start);
+        return -1;
+    }
+    if (!hasCodecs && memcmp(header, BSDIFF_MAGIC, std::char_traits<char>::length(BSDIFF_MAGIC)) != 0) {
         PATCH_LOGE("Corrupt patch, patch head != BSDIFF40");
         return -1;
     }
@@ -129,6 +598,12 @@ int32_t BlocksPatch::ReadHeader(int64_t &controlDataSize, int64_t &diffDataSize,
     offset += sizeof(int64_t);
     newSize = ReadLE64(header + offset);
     offset += sizeof(int64_t);
+    if (hasCodecs) {
+        for (size_t i = 0; i < sizeof(codecs); i++) {
+            codecs[i] = header[offset + i];
+        }
+        offset += SECTION_CODECS_LEN;
+    }
     if (controlDataSize < 0) {
         PATCH_LOGE("Invalid control data size");
         return -1;
@@ -137,49 +612,61 @@ int32_t BlocksPatch::ReadHeader(int64_t &controlDataSize, int64_t &diffDataSize,
         PATCH_LOGE("Invalid new data size");
         return -1;
     }
-    if (diffDataSize < 0 || (diffDataSize + controlDataSize) > static_cast<int64_t>(patchInfo_.length)) {
+    // the sections must end inside this patch, which may be one window of a larger buffer
+    size_t sectionsLength = patchInfo_.length - patchInfo_.start - offset;
+    if (diffDataSize < 0 || static_cast<uint64_t>(controlDataSize) > sectionsLength ||
+        static_cast<uint64_t>(diffDataSize) > sectionsLength - static_cast<size_t>(controlDataSize)) {
         PATCH_LOGE("Invalid patch data size");
         return -1;
     }
     BlockBuffer patchBuffer = {header, patchInfo_.length - patchInfo_.start};
-    controlDataReader_.reset(new BZip2BufferReadAdapter(offset, static_cast<size_t>(controlDataSize), patchBuffer));
+    isPipelined_ = canPipeline_ && decodeQueueLimit_ > 0 && patchBuffer.length >= PIPELINE_MIN_PATCH;
+    controlDataReader_ = CreateReader(codecs[0], offset, static_cast<size_t>(controlDataSize), patchBuffer);
     offset += static_cast<size_t>(controlDataSize);
-    diffDataReader_.reset(new BZip2BufferReadAdapter(offset, static_cast<size_t>(diffDataSize), patchBuffer));
+    diffDataReader_ = CreateReader(codecs[1], offset, static_cast<size_t>(diffDataSize), patchBuffer);
     offset += static_cast<size_t>(diffDataSize);
-    extraDataReader_.reset(new BZip2BufferReadAdapter(offset,
-        patchInfo_.length - patchInfo_.start - offset, patchBuffer));
+    extraDataReader_ = CreateReader(codecs[2], offset, patchInfo_.length - patchInfo_.start - offset,
+        patchBuffer);
     if (controlDataReader_ == nullptr || diffDataReader_ == nullptr || extraDataReader_ == nullptr) {
         PATCH_LOGE("Failed to create reader");
         return -1;
     }
-    controlDataReader_->Open();
-    diffDataReader_->Open();
-    extraDataReader_->Open();
+    if (controlDataReader_->Open() != 0 || diffDataReader_->Open() != 0 || extraDataReader_->Open() != 0) {
+        PATCH_LOGE("Failed to open reader");
+        return -1;
+    }
     return 0;
 }
 
-int32_t BlocksPatch::ReadControlData(ControlData &ctrlData)
+int32_t BlocksPatch::ReadControlBatch()
 {
-    std::vector<uint8_t> data(sizeof(int64_t), 0);
-    BlockBuffer info = {data.data(), sizeof(int64_t)};
-    int32_t ret = controlDataReader_->ReadData(info);
+    auto start = std::chrono::steady_clock::now();
+    controlBuffer_.resize(CONTROL_BATCH * CONTROL_TUPLE_SIZE);
+    BlockBuffer info = {controlBuffer_.data(), controlBuffer_.size()};
+    size_t readLen = 0;
+    int32_t ret = controlDataReader_->ReadAvailableData(info, readLen);
     if (ret != 0) {
-        PATCH_LOGE("Failed to read diffLength");
+        PATCH_LOGE("Failed to read control tuples");
         return ret;
     }
-    ctrlData.diffLength = ReadLE64(info.buffer);
-    ret = controlDataReader_->ReadData(info);
-    if (ret != 0) {
-        PATCH_LOGE("Failed to read extraLength");
-        return ret;
+    // Trailing bytes of a partial tuple are never used, as when tuples were read one by one.
+    size_t count = readLen / CONTROL_TUPLE_SIZE;
+    if (count == 0) {
+        PATCH_LOGE("No control tuple left %zu", readLen);
+        return PATCH_INVALID_PATCH;
     }
-    ctrlData.extraLength = ReadLE64(info.buffer);
-    ret = controlDataReader_->ReadData(info);
-    if (ret != 0) {
-        PATCH_LOGE("Failed to read offsetIncrement");
-        return ret;
+    controlTable_.resize(count);
+    const uint8_t *tuple = controlBuffer_.data();
+    for (ControlData &ctrlData : controlTable_) {
+        ctrlData.diffLength = ReadLE64(tuple);
+        ctrlData.extraLength = ReadLE64(tuple + sizeof(int64_t));
+        ctrlData.offsetIncrement = ReadLE64(tuple + sizeof(int64_t) * 2);
+        tuple += CONTROL_TUPLE_SIZE;
     }
-    ctrlData.offsetIncrement = ReadLE64(info.buffer);
+    controlIndex_ = 0;
+    controlStats_.tupleCount += count;
+    controlStats_.decodeTime += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
     return 0;
 }
 
@@ -195,6 +682,33 @@ int32_t BlocksBufferPatch::ReadHeader(int64_t &controlDataSize, int64_t &diffDat
     return 0;
 }
 
+int32_t BlocksBufferPatch::ReadWindows(std::vector<PatchWindow> &windows)
+{
+    int32_t ret = BlocksPatch::ReadWindows(windows);
+    if (ret != 0) {
+        PATCH_LOGE("Failed to read windows");
+        return ret;
+    }
+    PATCH_LOGI("ReadWindows windows: %zu %ld", windows.size(), newSize_);
+    newData_.resize(newSize_);
+    return 0;
+}
+
+bool BlocksBufferPatch::GetOldBuffer(BlockBuffer &oldInfo)
+{
+    oldInfo = oldInfo_;
+    return true;
+}
+
+int32_t BlocksBufferPatch::WriteWindow(const PatchWindow &window, const BlockBuffer &data)
+{
+    if (data.length == 0) {
+        return 0;
+    }
+    return memcpy_s(newData_.data() + window.newOffset, newData_.size() - static_cast<size_t>(window.newOffset),
+        data.buffer, data.length);
+}
+
 int32_t BlocksBufferPatch::RestoreDiffData(const ControlData &ctrlData)
 {
     if (ctrlData.diffLength <= 0) {
@@ -207,10 +721,11 @@ int32_t BlocksBufferPatch::RestoreDiffData(const ControlData &ctrlData)
         return ret;
     }
 
-    for (int64_t i = 0; i < ctrlData.diffLength; i++) {
-        if (((oldOffset_ + i) >= 0) && (static_cast<size_t>(oldOffset_ + i) < oldInfo_.length)) {
-            newData_[newOffset_ + i] += oldInfo_.buffer[oldOffset_ + i];
-        }
+    int64_t begin = 0;
+    int64_t end = 0;
+    if (GetOldRange(oldOffset_, ctrlData.diffLength, oldInfo_.length, begin, end)) {
+        AddBytes(newData_.data() + newOffset_ + begin, oldInfo_.buffer + (oldOffset_ + begin),
+            static_cast<size_t>(end - begin));
     }
     return 0;
 }
@@ -242,29 +757,31 @@ int32_t BlocksStreamPatch::RestoreDiffData(const ControlData &ctrlData)
         return ret;
     }
 
-    size_t oldOffset = static_cast<size_t>(oldOffset_);
     size_t oldLength = stream_->GetFileLength();
-    PkgBuffer buffer {};
-    if (stream_->GetStreamType() == PkgStream::PkgStreamType_MemoryMap ||
-        stream_->GetStreamType() == PkgStream::PkgStreamType_Buffer) {
-        ret = stream_->GetBuffer(buffer);
-        if (ret != 0) {
-            PATCH_LOGE("Failed to get old buffer");
-            return ret;
-        }
-    } else {
-        std::vector<uint8_t> oldData(ctrlData.diffLength);
-        size_t readLen = 0;
-        ret = stream_->Read(buffer, oldOffset_, ctrlData.diffLength, readLen);
-        if (ret != 0 || readLen != static_cast<size_t>(ctrlData.diffLength)) {
-            PATCH_LOGE("Failed to get old buffer");
-            return ret;
-        }
-        oldOffset = 0;
-    }
-    for (int64_t i = 0; i < ctrlData.diffLength; i++) {
-        if ((oldOffset_ + i >= 0) && (static_cast<size_t>(oldOffset_ + i) < oldLength)) {
-            diffData[i] += buffer.buffer[static_cast<int64_t>(oldOffset) + i];
+    int64_t begin = 0;
+    int64_t end = 0;
+    if (GetOldRange(oldOffset_, ctrlData.diffLength, oldLength, begin, end)) {
+        size_t oldOffset = static_cast<size_t>(oldOffset_ + begin);
+        size_t length = static_cast<size_t>(end - begin);
+        if (stream_->GetStreamType() == PkgStream::PkgStreamType_MemoryMap ||
+            stream_->GetStreamType() == PkgStream::PkgStreamType_Buffer) {
+            PkgBuffer buffer {};
+            ret = stream_->GetBuffer(buffer);
+            if (ret != 0) {
+                PATCH_LOGE("Failed to get old buffer");
+                return ret;
+            }
+            AddBytes(diffData.data() + begin, buffer.buffer + oldOffset, length);
+        } else {
+            // only the part inside the old data is read
+            PkgBuffer oldData(length);
+            size_t readLen = 0;
+            ret = stream_->Read(oldData, oldOffset, length, readLen);
+            if (ret != 0 || readLen != length) {
+                PATCH_LOGE("Failed to read old data");
+                return -1;
+            }
+            AddBytes(diffData.data() + begin, oldData.buffer, length);
         }
     }
     // write
@@ -286,4 +803,36 @@ int32_t BlocksStreamPatch::RestoreExtraData(const ControlData &ctrlData)
     // write
     return writer_->Write(newOffset_, extraBuffer, static_cast<size_t>(ctrlData.extraLength));
 }
+
+bool BlocksStreamPatch::GetOldBuffer(BlockBuffer &oldInfo)
+{
+    if (stream_->GetStreamType() != PkgStream::PkgStreamType_MemoryMap &&
+        stream_->GetStreamType() != PkgStream::PkgStreamType_Buffer) {
+        return false;
+    }
+    PkgBuffer buffer {};
+    if (stream_->GetBuffer(buffer) != 0) {
+        return false;
+    }
+    oldInfo = {buffer.buffer, stream_->GetFileLength()};
+    return true;
+}
+
+int32_t BlocksStreamPatch::WriteWindow(const PatchWindow &window, const BlockBuffer &data)
+{
+    return writer_->Write(static_cast<size_t>(window.newOffset), data, data.length);
+}
+
+int32_t BlocksStreamPatch::ApplyWindowInPlace(const PatchWindow &window)
+{
+    WindowWriter writer(writer_, window.newOffset);
+    BlocksStreamPatch patch(GetWindowPatch(window), stream_, &writer);
+    patch.isWindow_ = true;
+    int32_t ret = patch.ApplyPatch();
+    if (ret != 0 || patch.newSize_ != window.newSize) {
+        PATCH_LOGE("Failed to apply window at %ld", window.newOffset);
+        return ret != 0 ? ret : PATCH_INVALID_PATCH;
+    }
+    return 0;
+}
 } // namespace UpdatePatch
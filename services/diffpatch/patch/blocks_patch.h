@@ -13,17 +13,37 @@
  * limitations under the License.
  */
 
-#ifndef BLOCKS_DIFF_H
-#define BLOCKS_DIFF_H
+#ifndef BLOCKS_PATCH_H
+#define BLOCKS_PATCH_H
 
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <vector>
 #include "bzip2_adapter.h"
 #include "diffpatch.h"
+#include "lz4_adapter.h"
 #include "pkg_manager.h"
 #include "securec.h"
 
 namespace UpdatePatch {
+struct ControlStats {
+    size_t tupleCount { 0 };
+    // microseconds spent reading and decoding control tuples
+    uint64_t decodeTime { 0 };
+};
+
+// Fills the output digest of a checkpoint and keeps it
+using CheckpointSaver = std::function<int32_t(PatchCheckpoint &checkpoint)>;
+
+// Part of the new data with a patch of its own, see BSDIFF42
+struct PatchWindow {
+    size_t patchOffset { 0 };
+    size_t patchLength { 0 };
+    int64_t newOffset { 0 };
+    int64_t newSize { 0 };
+};
+
 class BlocksPatch {
 public:
     BlocksPatch() = delete;
@@ -31,12 +51,50 @@ public:
     virtual ~BlocksPatch() {}
 
     int32_t ApplyPatch();
+    // Bytes decoded ahead of the restore loop for each section of a large patch, 0 to decode inline
+    static void SetDecodeQueueLimit(size_t limit);
+    // Totals of every patch applied in this process
+    static ControlStats GetControlStats();
+    static void ResetControlStats();
+    // Save a checkpoint after every interval bytes of output, and go on from resume if it is not null
+    void SetCheckpoint(size_t interval, const PatchCheckpoint *resume, CheckpointSaver save);
+    // Threads applying the windows of a BSDIFF42 patch, 0 or 1 applies them serially, 1 by default
+    static void SetWindowWorkers(size_t count);
+    static size_t GetWindowWorkers();
 protected:
-    int32_t ReadControlData(ControlData &ctrlData);
+    // Decode the next batch of control tuples into controlTable_
+    int32_t ReadControlBatch();
+    std::unique_ptr<BZip2ReadAdapter> CreateReader(uint8_t codec, size_t offset, size_t length,
+        const BlockBuffer &patchBuffer);
 
     virtual int32_t ReadHeader(int64_t &controlDataSize, int64_t &diffDataSize, int64_t &newSize);
     virtual int32_t RestoreDiffData(const ControlData &ctrlData) = 0;
     virtual int32_t RestoreExtraData(const ControlData &ctrlData) = 0;
+    int32_t NextControlData(ControlData &ctrlData);
+    // Restore the diff or extra data of a tuple, in pieces of at most the checkpoint interval
+    int32_t RestorePieces(ControlData &ctrlData, bool isDiff);
+    // Decode the tuples before the resumed checkpoint without restoring them, the checkpoint may be inside a tuple
+    int32_t SkipToCheckpoint(ControlData &ctrlData, bool &isPartial);
+    bool IsCheckpointDue() const;
+    int32_t SaveCheckpoint();
+
+    bool IsWindowedPatch() const;
+    virtual int32_t ReadWindows(std::vector<PatchWindow> &windows);
+    int32_t ApplyWindows();
+    int32_t ApplyWindowsConcurrently(const std::vector<PatchWindow> &windows, size_t first,
+        const BlockBuffer &oldInfo, size_t workerCount);
+    int32_t ApplyBufferWindow(const PatchWindow &window, const BlockBuffer &oldInfo,
+        std::vector<uint8_t> &output, bool canPipeline) const;
+    PatchBuffer GetWindowPatch(const PatchWindow &window) const;
+    // The windows before a resumed checkpoint are skipped, checkpoints are taken between windows
+    int32_t SkipToWindow(const std::vector<PatchWindow> &windows, size_t &first);
+    int32_t FinishWindow(const PatchWindow &window);
+    // Old data as one buffer the windows can share, false if it is only read through a stream
+    virtual bool GetOldBuffer(BlockBuffer &oldInfo) = 0;
+    // Write the restored data of a window at its offset of the new data
+    virtual int32_t WriteWindow(const PatchWindow &window, const BlockBuffer &data) = 0;
+    // Apply a window straight to the output, when the old data is not a buffer
+    virtual int32_t ApplyWindowInPlace(const PatchWindow &window);
 
     PatchBuffer patchInfo_ { nullptr };
     int64_t newSize_ = { 0 };
@@ -46,6 +104,27 @@ protected:
     std::unique_ptr<BZip2ReadAdapter> controlDataReader_ { nullptr };
     std::unique_ptr<BZip2ReadAdapter> diffDataReader_ { nullptr };
     std::unique_ptr<BZip2ReadAdapter> extraDataReader_ { nullptr };
+    bool isPipelined_ { false };
+    // a window of a BSDIFF42 patch, it can not have windows itself
+    bool isWindow_ { false };
+    bool canPipeline_ { true };
+
+    std::vector<uint8_t> controlBuffer_ {};
+    std::vector<ControlData> controlTable_ {};
+    size_t controlIndex_ { 0 };
+    ControlStats controlStats_ {};
+
+    // control tuples applied
+    uint64_t position_ { 0 };
+    size_t checkpointInterval_ { 0 };
+    int64_t lastCheckpoint_ { 0 };
+    const PatchCheckpoint *resume_ { nullptr };
+    CheckpointSaver saveCheckpoint_ {};
+
+    static std::atomic<size_t> decodeQueueLimit_;
+    static std::atomic<size_t> totalTupleCount_;
+    static std::atomic<uint64_t> totalDecodeTime_;
+    static std::atomic<size_t> windowWorkers_;
 };
 
 class BlocksBufferPatch : public BlocksPatch {
@@ -58,6 +137,9 @@ private:
     int32_t ReadHeader(int64_t &controlDataSize, int64_t &diffDataSize, int64_t &newSize) override;
     int32_t RestoreDiffData(const ControlData &ctrlData) override;
     int32_t RestoreExtraData(const ControlData &ctrlData) override;
+    int32_t ReadWindows(std::vector<PatchWindow> &windows) override;
+    bool GetOldBuffer(BlockBuffer &oldInfo) override;
+    int32_t WriteWindow(const PatchWindow &window, const BlockBuffer &data) override;
 
     BlockBuffer oldInfo_ { nullptr, 0 };
     std::vector<uint8_t>  &newData_;
@@ -72,9 +154,12 @@ public:
 private:
     int32_t RestoreDiffData(const ControlData &ctrlData) override;
     int32_t RestoreExtraData(const ControlData &ctrlData) override;
+    bool GetOldBuffer(BlockBuffer &oldInfo) override;
+    int32_t WriteWindow(const PatchWindow &window, const BlockBuffer &data) override;
+    int32_t ApplyWindowInPlace(const PatchWindow &window) override;
 
     Hpackage::PkgManager::StreamPtr stream_ { nullptr };
     UpdatePatchWriterPtr writer_ { nullptr };
 };
 } // namespace UpdatePatch
-#endif // BLOCKS_DIFF_H
\ No newline at end of file
+#endif // BLOCKS_PATCH_H
\ No newline at end of file
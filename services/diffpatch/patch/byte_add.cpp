@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "byte_add.h"
+#include "securec.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+// AVX2 is chosen at runtime, the rest of the binary does not need it.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(_WIN32)
+#include <immintrin.h>
+#define BYTE_ADD_AVX2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace UpdatePatch {
+namespace {
+using AddBytesFunc = void (*)(uint8_t *dst, const uint8_t *src, size_t len);
+
+struct AddBytesKernel {
+    AddBytesFunc func;
+    const char *name;
+};
+
+constexpr uint64_t LOW_BITS = 0x7F7F7F7F7F7F7F7FULL;
+constexpr uint64_t HIGH_BITS = 0x8080808080808080ULL;
+
+// Unaligned word access for the portable loop, the sizes are constant so the copies become single moves
+inline uint64_t LoadWord(const uint8_t *src)
+{
+    uint64_t value = 0;
+    (void)memcpy_s(&value, sizeof(value), src, sizeof(value));
+    return value;
+}
+
+inline void StoreWord(uint8_t *dst, uint64_t value)
+{
+    (void)memcpy_s(dst, sizeof(value), &value, sizeof(value));
+}
+
+#if defined(__SSE2__)
+void AddBytesSse2(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    constexpr size_t width = sizeof(__m128i);
+    size_t i = 0;
+    for (; i + width <= len; i += width) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_add_epi8(a, b));
+    }
+    AddBytesPortable(dst + i, src + i, len - i);
+}
+#endif
+
+#ifdef BYTE_ADD_AVX2
+__attribute__((target("avx2"))) void AddBytesAvx2(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    constexpr size_t width = sizeof(__m256i);
+    size_t i = 0;
+    for (; i + width <= len; i += width) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_add_epi8(a, b));
+    }
+    AddBytesPortable(dst + i, src + i, len - i);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+void AddBytesNeon(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    constexpr size_t width = sizeof(uint8x16_t);
+    size_t i = 0;
+    for (; i + width <= len; i += width) {
+        vst1q_u8(dst + i, vaddq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+    }
+    AddBytesPortable(dst + i, src + i, len - i);
+}
+#endif
+
+AddBytesKernel SelectKernel()
+{
+#ifdef BYTE_ADD_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return { AddBytesAvx2, "avx2" };
+    }
+#endif
+#if defined(__SSE2__)
+    return { AddBytesSse2, "sse2" };
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    return { AddBytesNeon, "neon" };
+#else
+    return { AddBytesPortable, "portable" };
+#endif
+}
+
+const AddBytesKernel &GetKernel()
+{
+    static const AddBytesKernel kernel = SelectKernel();
+    return kernel;
+}
+} // namespace
+
+void AddBytesPortable(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+    // Eight lanes in a word, the carry out of each lane is masked off.
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t a = LoadWord(dst + i);
+        uint64_t b = LoadWord(src + i);
+        StoreWord(dst + i, ((a & LOW_BITS) + (b & LOW_BITS)) ^ ((a ^ b) & HIGH_BITS));
+    }
+    for (; i < len; i++) {
+        dst[i] += src[i];
+    }
+}
+
+void AddBytes(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    GetKernel().func(dst, src, len);
+}
+
+const char *GetAddBytesKernel()
+{
+    return GetKernel().name;
+}
+} // namespace UpdatePatch
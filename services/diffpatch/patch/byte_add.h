@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BYTE_ADD_H
+#define BYTE_ADD_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace UpdatePatch {
+// dst[i] += src[i] modulo 256, with the widest vector unit of the cpu
+void AddBytes(uint8_t *dst, const uint8_t *src, size_t len);
+// Same without vector instructions
+void AddBytesPortable(uint8_t *dst, const uint8_t *src, size_t len);
+// Name of the kernel used by AddBytes
+const char *GetAddBytesKernel();
+} // namespace UpdatePatch
+#endif // BYTE_ADD_H
@@ -14,12 +14,14 @@
  */
 
 #include "image_patch.h"
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
 #include "diffpatch.h"
 #include "lz4_adapter.h"
 #include "openssl/sha.h"
+#include "paged_image_source.h"
 #include "securec.h"
 #include "zip_adapter.h"
 #include "scope_guard.h"
@@ -28,7 +30,9 @@ using namespace Hpackage;
 using namespace Updater;
 
 namespace UpdatePatch {
-uint32_t g_tmpFileId = 0;
+std::atomic<uint32_t> g_tmpFileId { 0 };
+// image patches of the updater already run on the workers of the command scheduler
+std::atomic<size_t> CompressedImagePatch::recompressWorkers_ { 1 };
 
 int32_t NormalImagePatch::ApplyImagePatch(const PatchParam &param, size_t &startOffset)
 {
@@ -52,8 +56,14 @@ int32_t NormalImagePatch::ApplyImagePatch(const PatchParam &param, size_t &start
     }
 
     PatchBuffer patchInfo = {param.patch, patchOffset, param.patchSize};
-    BlockBuffer oldInfo = {param.oldBuff + srcStart, srcLen};
-    int32_t ret = UpdateApplyPatch::ApplyBlockPatch(patchInfo, oldInfo, writer_);
+    int32_t ret = 0;
+    if (param.oldSource != nullptr) {
+        PagedSourceStream stream(*param.oldSource, srcStart, srcLen);
+        ret = UpdateApplyPatch::ApplyBlockPatch(patchInfo, &stream, writer_);
+    } else {
+        BlockBuffer oldInfo = {param.oldBuff + srcStart, srcLen};
+        ret = UpdateApplyPatch::ApplyBlockPatch(patchInfo, oldInfo, writer_);
+    }
     if (ret != 0) {
         PATCH_LOGE("Failed to apply bsdiff patch");
         return -1;
@@ -106,14 +116,37 @@ int32_t CompressedImagePatch::StartReadHeader(const PatchParam &param, PatchHead
     return 0;
 }
 
+void CompressedImagePatch::SetRecompressWorkers(size_t count)
+{
+    recompressWorkers_ = count;
+}
+
+size_t CompressedImagePatch::GetRecompressWorkers()
+{
+    return recompressWorkers_;
+}
+
 int32_t CompressedImagePatch::ApplyImagePatch(const PatchParam &param, size_t &startOffset)
+{
+    if (ReadChunkHeader(param, startOffset) != 0) {
+        return -1;
+    }
+    return RestoreChunk(param);
+}
+
+int32_t CompressedImagePatch::ReadChunkHeader(const PatchParam &param, size_t &startOffset)
 {
     size_t offset = startOffset;
-    // read header
-    PatchHeader header {};
-    if (StartReadHeader(param, header, offset) != 0) {
+    if (StartReadHeader(param, header_, offset) != 0) {
         return -1;
     }
+    startOffset = offset;
+    return 0;
+}
+
+int32_t CompressedImagePatch::RestoreChunk(const PatchParam &param)
+{
+    const PatchHeader &header = header_;
     // decompress old data
     Hpackage::PkgManager::PkgManagerPtr pkgManager = Hpackage::PkgManager::CreatePackageInstance();
     if (pkgManager == nullptr) {
@@ -125,6 +158,16 @@ int32_t CompressedImagePatch::ApplyImagePatch(const PatchParam &param, size_t &s
     };
     Hpackage::PkgManager::StreamPtr stream = nullptr;
     BlockBuffer oldData = { param.oldBuff + header.srcStart, header.srcLength };
+    std::vector<uint8_t> pagedData {};
+    if (param.oldSource != nullptr) {
+        // only the compressed source of this chunk is read
+        pagedData.resize(header.srcLength);
+        if (param.oldSource->Read(header.srcStart, pagedData.data(), pagedData.size()) != 0) {
+            PATCH_LOGE("Failed to read old data");
+            return -1;
+        }
+        oldData = { pagedData.data(), pagedData.size() };
+    }
     if (DecompressData(pkgManager, oldData, stream, true, header.expandedLen) != 0) {
         PATCH_LOGE("Failed to decompress data");
         return -1;
@@ -157,7 +200,6 @@ int32_t CompressedImagePatch::ApplyImagePatch(const PatchParam &param, size_t &s
         PATCH_LOGE("Failed to apply bsdiff patch");
         return -1;
     }
-    startOffset = offset;
     return 0;
 }
 
@@ -364,4 +406,108 @@ int32_t CompressedFileRestore::CompressData(size_t &originalSize, size_t &compre
     PATCH_LOGI("CompressedFileRestore hash %zu %s ", dataSize_, hexDigest.c_str());
     return 0;
 }
+
+int32_t RecompressPool::ChunkBufferWriter::Write(size_t start, const BlockBuffer &buffer, size_t len)
+{
+    data_.insert(data_.end(), buffer.buffer, buffer.buffer + len);
+    return 0;
+}
+
+RecompressPool::RecompressPool(const PatchParam &param, UpdatePatchWriterPtr writer, size_t workerCount)
+    : param_(param), writer_(writer), maxPending_(workerCount * 2)
+{
+    for (size_t i = 0; i < workerCount; i++) {
+        workers_.emplace_back([this] { WorkerRun(); });
+    }
+}
+
+RecompressPool::~RecompressPool()
+{
+    {
+        // Chunks not started are dropped, only a failed patch leaves any.
+        std::lock_guard<std::mutex> lock(mutex_);
+        readyQueue_.clear();
+        stop_ = true;
+    }
+    workerCond_.notify_all();
+    for (auto &worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void RecompressPool::WorkerRun()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        workerCond_.wait(lock, [this] { return stop_ || !readyQueue_.empty(); });
+        if (readyQueue_.empty()) {
+            return;
+        }
+        RecompressTask *task = readyQueue_.front();
+        readyQueue_.pop_front();
+        lock.unlock();
+        int32_t result = task->patch->RestoreChunk(param_);
+        lock.lock();
+        task->result = result;
+        task->done = true;
+        doneCond_.notify_all();
+    }
+}
+
+int32_t RecompressPool::Submit(int32_t type, const std::vector<uint8_t> &bonusData, size_t &startOffset)
+{
+    std::unique_ptr<RecompressTask> task = std::make_unique<RecompressTask>();
+    if (type == BLOCK_DEFLATE) {
+        task->patch = std::make_unique<ZipImagePatch>(&task->output, bonusData);
+    } else if (type == BLOCK_LZ4) {
+        task->patch = std::make_unique<Lz4ImagePatch>(&task->output, bonusData);
+    }
+    if (task->patch == nullptr || task->patch->ReadChunkHeader(param_, startOffset) != 0) {
+        PATCH_LOGE("Failed to read chunk type %d", type);
+        return -1;
+    }
+    while (tasks_.size() >= maxPending_) {
+        if (CommitFront() != 0) {
+            return -1;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    readyQueue_.push_back(task.get());
+    tasks_.push_back(std::move(task));
+    workerCond_.notify_one();
+    return 0;
+}
+
+int32_t RecompressPool::CommitFront()
+{
+    std::unique_ptr<RecompressTask> task = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        doneCond_.wait(lock, [this] { return tasks_.front()->done; });
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+    }
+    if (task->result != 0) {
+        PATCH_LOGE("Failed to restore chunk");
+        return -1;
+    }
+    std::vector<uint8_t> &data = task->output.data_;
+    if (data.empty()) {
+        return 0;
+    }
+    BlockBuffer buffer = { data.data(), data.size() };
+    return writer_->Write(0, buffer, data.size());
+}
+
+int32_t RecompressPool::CommitAll()
+{
+    while (!tasks_.empty()) {
+        if (CommitFront() != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
 } // namespace UpdatePatch
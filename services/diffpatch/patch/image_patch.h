@@ -17,6 +17,11 @@
 #define IMAGE_PATCH_H
 
 #include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include "deflate_adapter.h"
 #include "diffpatch.h"
 #include "openssl/sha.h"
@@ -69,6 +74,14 @@ public:
     ~CompressedImagePatch() override {}
 
     int32_t ApplyImagePatch(const PatchParam &param, size_t &startOffset) override;
+    // ApplyImagePatch in two steps, the header is read in patch order and the chunk may be restored on any thread
+    int32_t ReadChunkHeader(const PatchParam &param, size_t &startOffset);
+    int32_t RestoreChunk(const PatchParam &param);
+
+    // Threads recompressing the deflate and lz4 chunks of an image patch, 0 or 1 restores them serially.
+    // 1 by default, each worker may buffer two whole recompressed chunks.
+    static void SetRecompressWorkers(size_t count);
+    static size_t GetRecompressWorkers();
 protected:
     virtual int32_t ReadHeader(const PatchParam &param, PatchHeader &header, size_t &offset) = 0;
     virtual std::unique_ptr<Hpackage::FileInfo> GetFileInfo() const = 0;
@@ -77,6 +90,9 @@ protected:
         Hpackage::PkgManager::StreamPtr &stream, bool memory, size_t expandedLen) const;
 
     std::vector<uint8_t> bonusData_ {};
+    PatchHeader header_ {};
+private:
+    static std::atomic<size_t> recompressWorkers_;
 };
 
 class ZipImagePatch : public CompressedImagePatch {
@@ -135,5 +151,65 @@ private:
     std::unique_ptr<DeflateAdapter> deflateAdapter_ { nullptr };
     SHA256_CTX sha256Ctx_ {};
 };
+
+/*
+ * Restores the compressed chunks of an image patch on a pool of threads. Each
+ * chunk is recompressed into its own buffer, the buffers are written in chunk
+ * order so the target is hashed as if the chunks were restored serially. At
+ * most twice as many chunks as workers are kept in memory.
+ */
+class RecompressPool {
+public:
+    RecompressPool(const PatchParam &param, UpdatePatchWriterPtr writer, size_t workerCount);
+    ~RecompressPool();
+
+    // Read the chunk header at startOffset and queue the chunk, the oldest chunks are written first if the pool is full
+    int32_t Submit(int32_t type, const std::vector<uint8_t> &bonusData, size_t &startOffset);
+    // Write every queued chunk, called before a chunk that is not recompressed
+    int32_t CommitAll();
+
+private:
+    RecompressPool(const RecompressPool&) = delete;
+    const RecompressPool& operator=(const RecompressPool&) = delete;
+
+    class ChunkBufferWriter : public UpdatePatchWriter {
+    public:
+        ChunkBufferWriter() : UpdatePatchWriter() {}
+        ~ChunkBufferWriter() override {}
+
+        int32_t Init() override
+        {
+            return 0;
+        }
+        int32_t Write(size_t start, const BlockBuffer &buffer, size_t len) override;
+        int32_t Finish() override
+        {
+            return 0;
+        }
+        std::vector<uint8_t> data_ {};
+    };
+
+    struct RecompressTask {
+        std::unique_ptr<CompressedImagePatch> patch {};
+        ChunkBufferWriter output {};
+        int32_t result {0};
+        bool done {false};
+    };
+
+    int32_t CommitFront();
+    void WorkerRun();
+
+    const PatchParam &param_;
+    UpdatePatchWriterPtr writer_ {nullptr};
+    size_t maxPending_ {0};
+    bool stop_ {false};
+    std::mutex mutex_ {};
+    std::condition_variable workerCond_ {};
+    std::condition_variable doneCond_ {};
+    // every queued chunk in patch order, and the ones no worker has started yet
+    std::deque<std::unique_ptr<RecompressTask>> tasks_ {};
+    std::deque<RecompressTask *> readyQueue_ {};
+    std::vector<std::thread> workers_ {};
+};
 } // namespace UpdatePatch
 #endif  // IMAGE_PATCH_H
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "paged_image_source.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "diffpatch.h"
+#include "securec.h"
+
+using namespace Hpackage;
+
+namespace UpdatePatch {
+// A read may span two pages, both have to fit.
+constexpr size_t MIN_CACHE_PAGES = 2;
+
+PagedImageSource::~PagedImageSource()
+{
+    if (fd_ >= 0) {
+        close(fd_);
+        PATCH_LOGI("Paged image source %zu hits, %zu misses", hits_, misses_);
+    }
+}
+
+int32_t PagedImageSource::Open()
+{
+    fd_ = open(fileName_.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        PATCH_LOGE("Failed to open file %s", fileName_.c_str());
+        return -1;
+    }
+    struct stat st {};
+    if (fstat(fd_, &st) < 0) {
+        PATCH_LOGE("Failed to fstat");
+        return -1;
+    }
+    off_t size = st.st_size;
+    if (S_ISBLK(st.st_mode)) {
+        size = lseek(fd_, 0, SEEK_END);
+    }
+    if (size < 0) {
+        PATCH_LOGE("Failed to get size of %s", fileName_.c_str());
+        return -1;
+    }
+    size_ = static_cast<size_t>(size);
+    maxPages_ = std::max(cacheSize_ / PAGE_SIZE, MIN_CACHE_PAGES);
+    PATCH_LOGI("Paged image source %s size %zu, cache %zu pages", fileName_.c_str(), size_, maxPages_);
+    return 0;
+}
+
+const std::vector<uint8_t> *PagedImageSource::GetPageLocked(size_t index)
+{
+    auto it = pageIndex_.find(index);
+    if (it != pageIndex_.end()) {
+        pages_.splice(pages_.begin(), pages_, it->second);
+        hits_++;
+        return &pages_.front().data;
+    }
+    misses_++;
+    if (pages_.size() < maxPages_) {
+        pages_.emplace_front();
+    } else {
+        // reuse the buffer of the least recently used page
+        pageIndex_.erase(pages_.back().index);
+        pages_.splice(pages_.begin(), pages_, std::prev(pages_.end()));
+    }
+    Page &page = pages_.front();
+    size_t offset = index * PAGE_SIZE;
+    page.index = index;
+    page.data.resize(std::min(PAGE_SIZE, size_ - offset));
+    size_t readLen = 0;
+    while (readLen < page.data.size()) {
+        ssize_t ret = pread(fd_, page.data.data() + readLen, page.data.size() - readLen,
+            static_cast<off_t>(offset + readLen));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            PATCH_LOGE("Failed to read page %zu of %s", index, fileName_.c_str());
+            pages_.pop_front();
+            return nullptr;
+        }
+        readLen += static_cast<size_t>(ret);
+    }
+    pageIndex_[index] = pages_.begin();
+    return &page.data;
+}
+
+int32_t PagedImageSource::Read(size_t offset, uint8_t *buffer, size_t length)
+{
+    if (offset > size_ || size_ - offset < length) {
+        PATCH_LOGE("Invalid read of %zu at %zu, size %zu", length, offset, size_);
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (length > 0) {
+        const std::vector<uint8_t> *page = GetPageLocked(offset / PAGE_SIZE);
+        if (page == nullptr) {
+            return -1;
+        }
+        size_t pageOffset = offset % PAGE_SIZE;
+        size_t count = std::min(length, page->size() - pageOffset);
+        if (memcpy_s(buffer, length, page->data() + pageOffset, count) != EOK) {
+            PATCH_LOGE("Failed to copy page");
+            return -1;
+        }
+        buffer += count;
+        offset += count;
+        length -= count;
+    }
+    return 0;
+}
+
+int32_t PagedSourceStream::Read(PkgBuffer &data, size_t start, size_t needRead, size_t &readLen)
+{
+    readLen = 0;
+    if (start > length_) {
+        PATCH_LOGE("Invalid start %zu, length %zu", start, length_);
+        return -1;
+    }
+    if (data.buffer == nullptr) {
+        data.data.resize(needRead);
+        data.buffer = data.data.data();
+        data.length = needRead;
+    }
+    if (data.length < needRead) {
+        PATCH_LOGE("Insufficient buffer capacity");
+        return -1;
+    }
+    size_t length = std::min(needRead, length_ - start);
+    if (source_.Read(start_ + start, data.buffer, length) != 0) {
+        return -1;
+    }
+    readLen = length;
+    return 0;
+}
+} // namespace UpdatePatch
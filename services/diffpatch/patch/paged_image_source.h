@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef PAGED_IMAGE_SOURCE_H
+#define PAGED_IMAGE_SOURCE_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "package/pkg_manager.h"
+
+namespace UpdatePatch {
+/*
+ * Old image of an image patch read on demand. The file is read in pages that
+ * are kept in a least recently used cache of at most cacheSize bytes, so the
+ * memory used for the old image does not depend on its size.
+ */
+class PagedImageSource {
+public:
+    static constexpr size_t PAGE_SIZE = 256 * 1024;
+
+    PagedImageSource(const std::string &fileName, size_t cacheSize) : fileName_(fileName), cacheSize_(cacheSize) {}
+    ~PagedImageSource();
+
+    int32_t Open();
+    // Copy length bytes at offset of the old image to buffer
+    int32_t Read(size_t offset, uint8_t *buffer, size_t length);
+    size_t GetSize() const
+    {
+        return size_;
+    }
+
+private:
+    PagedImageSource(const PagedImageSource&) = delete;
+    const PagedImageSource& operator=(const PagedImageSource&) = delete;
+
+    struct Page {
+        size_t index {0};
+        std::vector<uint8_t> data {};
+    };
+
+    const std::vector<uint8_t> *GetPageLocked(size_t index);
+
+    std::string fileName_ {};
+    size_t cacheSize_ {0};
+    size_t maxPages_ {0};
+    int fd_ {-1};
+    size_t size_ {0};
+    std::mutex mutex_ {};
+    // most recently used first
+    std::list<Page> pages_ {};
+    std::unordered_map<size_t, std::list<Page>::iterator> pageIndex_ {};
+    size_t hits_ {0};
+    size_t misses_ {0};
+};
+
+// Read only stream over length bytes at start of a paged image, for the bsdiff patch of a normal chunk
+class PagedSourceStream : public Hpackage::PkgStream {
+public:
+    PagedSourceStream(PagedImageSource &source, size_t start, size_t length)
+        : source_(source), start_(start), length_(length) {}
+    ~PagedSourceStream() override {}
+
+    int32_t Read(Hpackage::PkgBuffer &data, size_t start, size_t needRead, size_t &readLen) override;
+    int32_t Write(const Hpackage::PkgBuffer &data, size_t size, size_t start) override
+    {
+        return -1;
+    }
+    int32_t Flush(size_t size) override
+    {
+        return 0;
+    }
+    int32_t GetBuffer(Hpackage::PkgBuffer &buffer) const override
+    {
+        return -1;
+    }
+    size_t GetFileLength() override
+    {
+        return length_;
+    }
+    const std::string GetFileName() const override
+    {
+        return "";
+    }
+    int32_t GetStreamType() const override
+    {
+        return PkgStreamType_Read;
+    }
+    void AddRef() override {}
+    void DelRef() override {}
+    bool IsRef() const override
+    {
+        return false;
+    }
+
+private:
+    PagedImageSource &source_;
+    size_t start_ {0};
+    size_t length_ {0};
+};
+} // namespace UpdatePatch
+#endif // PAGED_IMAGE_SOURCE_H
@@ -26,6 +26,38 @@ using namespace Hpackage;
 namespace UpdatePatch {
 int32_t UpdateApplyPatch::ApplyImagePatch(const PatchParam &param, const std::vector<uint8_t> &bonusData,
     ImageProcessor writer, const std::string& expected)
+{
+    return ApplyImagePatch(param, bonusData, writer, expected, {});
+}
+
+// Resume the writer at the checkpoint if there is one, and make the saver that completes each new one
+static int32_t InitCheckpoint(ImagePatchWriter &patchWriter, const PatchCheckpointParam &checkpoint,
+    CheckpointSaver &saver)
+{
+    if (checkpoint.resume != nullptr && patchWriter.Resume(*checkpoint.resume, checkpoint.written) != 0) {
+        return -1;
+    }
+    if (checkpoint.interval > 0 && checkpoint.save != nullptr) {
+        saver = [&patchWriter, &checkpoint](PatchCheckpoint &point) -> int32_t {
+            patchWriter.FillCheckpoint(point);
+            return checkpoint.save(point);
+        };
+    }
+    return 0;
+}
+
+// Checkpoints of an image patch, they are taken between chunks
+struct ChunkCheckpoint {
+    const PatchCheckpointParam &param;
+    const ImagePatchWriter &patchWriter;
+    CheckpointSaver save;
+};
+
+static int32_t ApplyImageChunks(const PatchParam &param, UpdatePatchWriterPtr writer,
+    const std::vector<uint8_t> &bonusData, const ChunkCheckpoint *checkpoint);
+
+int32_t UpdateApplyPatch::ApplyImagePatch(const PatchParam &param, const std::vector<uint8_t> &bonusData,
+    ImageProcessor writer, const std::string& expected, const PatchCheckpointParam &checkpoint)
 {
     if (writer == nullptr) {
         PATCH_LOGE("ApplyImagePatch : processor is null");
@@ -41,7 +73,13 @@ int32_t UpdateApplyPatch::ApplyImagePatch(const PatchParam &param, const std::ve
         PATCH_LOGE("ApplyImagePatch : Failed to init patch writer");
         return -1;
     }
-    ret = ApplyImagePatch(param, patchWriter.get(), bonusData);
+    CheckpointSaver saver = nullptr;
+    if (InitCheckpoint(*patchWriter, checkpoint, saver) != 0) {
+        PATCH_LOGE("ApplyImagePatch : Failed to resume at checkpoint");
+        return -1;
+    }
+    ChunkCheckpoint chunkCheckpoint { checkpoint, *patchWriter, saver };
+    ret = ApplyImageChunks(param, patchWriter.get(), bonusData, &chunkCheckpoint);
     if (ret != 0) {
         PATCH_LOGE("ApplyImagePatch : Failed to apply image patch");
         return -1;
@@ -69,15 +107,62 @@ bool UpdateApplyPatch::PreCheck(const PatchParam &param, const UpdatePatchWriter
 int32_t UpdateApplyPatch::ApplyImagePatch(const PatchParam &param,
     UpdatePatchWriterPtr writer, const std::vector<uint8_t> &bonusData)
 {
-    if (!PreCheck(param, writer)) {
+    return ApplyImageChunks(param, writer, bonusData, nullptr);
+}
+
+static int32_t SaveChunkCheckpoint(const ChunkCheckpoint &checkpoint, RecompressPool *pool,
+    int32_t chunk, size_t offset)
+{
+    // the recompressed chunks before the checkpoint have to be written
+    if (pool != nullptr && pool->CommitAll() != 0) {
+        return -1;
+    }
+    PatchCheckpoint point {};
+    point.position = static_cast<uint64_t>(chunk);
+    point.patchOffset = offset;
+    int32_t ret = checkpoint.save(point);
+    if (ret != 0) {
+        PATCH_LOGE("Failed to save checkpoint at chunk %d", chunk);
+    }
+    return ret;
+}
+
+static int32_t ApplyImageChunks(const PatchParam &param, UpdatePatchWriterPtr writer,
+    const std::vector<uint8_t> &bonusData, const ChunkCheckpoint *checkpoint)
+{
+    if (!UpdateApplyPatch::PreCheck(param, writer)) {
         return -1;
     }
     size_t offset = std::char_traits<char>::length(PKGDIFF_MAGIC);
     int32_t numChunks = ImagePatch::ReadLE<int32_t>(param.patch + offset);
     offset += sizeof(int32_t);
+    int start = 0;
+    const PatchCheckpoint *resume = checkpoint != nullptr ? checkpoint->param.resume : nullptr;
+    if (resume != nullptr) {
+        if (resume->position > static_cast<uint64_t>(numChunks) || resume->patchOffset < offset ||
+            resume->patchOffset > param.patchSize) {
+            PATCH_LOGE("Checkpoint does not match patch, chunk %llu",
+                static_cast<unsigned long long>(resume->position));
+            return -1;
+        }
+        start = static_cast<int>(resume->position);
+        offset = static_cast<size_t>(resume->patchOffset);
+        PATCH_LOGI("Resume image patch at chunk %d offset %zu", start, offset);
+    }
+    bool hasCheckpoint = checkpoint != nullptr && checkpoint->save != nullptr;
+    size_t lastCheckpoint = hasCheckpoint ? checkpoint->patchWriter.GetWritten() : 0;
 
     std::vector<uint8_t> empty;
-    for (int i = 0; i < numChunks; ++i) {
+    size_t workerCount = CompressedImagePatch::GetRecompressWorkers();
+    std::unique_ptr<RecompressPool> pool = nullptr;
+    for (int i = start; i < numChunks; ++i) {
+        if (hasCheckpoint && i > start &&
+            checkpoint->patchWriter.GetWritten() - lastCheckpoint >= checkpoint->param.interval) {
+            if (SaveChunkCheckpoint(*checkpoint, pool.get(), i, offset) != 0) {
+                return -1;
+            }
+            lastCheckpoint = checkpoint->patchWriter.GetWritten();
+        }
         // each chunk's header record starts with 4 bytes.
         if ((offset + sizeof(int32_t)) > param.patchSize) {
             PATCH_LOGE("Failed to read chunk record ");
@@ -86,6 +171,21 @@ int32_t UpdateApplyPatch::ApplyImagePatch(const PatchParam &param,
         int32_t type = ImagePatch::ReadLE<int32_t>(param.patch + offset);
         PATCH_DEBUG("ApplyImagePatch numChunks[%d] type %d offset %d", i, type, offset);
         offset += sizeof(int32_t);
+        if (workerCount > 1 && (type == BLOCK_DEFLATE || type == BLOCK_LZ4)) {
+            if (pool == nullptr) {
+                pool = std::make_unique<RecompressPool>(param, writer, workerCount);
+            }
+            if (pool->Submit(type, ((i == 1) ? bonusData : empty), offset) != 0) {
+                PATCH_LOGE("Apply image patch fail ");
+                return -1;
+            }
+            continue;
+        }
+        // the recompressed chunks before this one are written first
+        if (pool != nullptr && pool->CommitAll() != 0) {
+            PATCH_LOGE("Apply image patch fail ");
+            return -1;
+        }
         std::unique_ptr<ImagePatch> imagePatch = nullptr;
         switch (type) {
             case BLOCK_NORMAL:
@@ -113,6 +213,10 @@ int32_t UpdateApplyPatch::ApplyImagePatch(const PatchParam &param,
             return -1;
         }
     }
+    if (pool != nullptr && pool->CommitAll() != 0) {
+        PATCH_LOGE("Apply image patch fail ");
+        return -1;
+    }
     return 0;
 }
 
@@ -160,6 +264,12 @@ int32_t UpdateApplyPatch::ApplyBlockPatch(const PatchBuffer &patchInfo,
 
 int32_t UpdateApplyPatch::ApplyBlockPatch(const PatchBuffer &patchInfo,
     const BlockBuffer &oldInfo, ImageProcessor writer, const std::string& expected)
+{
+    return ApplyBlockPatch(patchInfo, oldInfo, writer, expected, {});
+}
+
+int32_t UpdateApplyPatch::ApplyBlockPatch(const PatchBuffer &patchInfo, const BlockBuffer &oldInfo,
+    ImageProcessor writer, const std::string& expected, const PatchCheckpointParam &checkpoint)
 {
     if (writer == nullptr) {
         PATCH_LOGE("ApplyBlockPatch : processor is null");
@@ -175,6 +285,11 @@ int32_t UpdateApplyPatch::ApplyBlockPatch(const PatchBuffer &patchInfo,
         PATCH_LOGE("ApplyBlockPatch : Failed to init patch writer");
         return -1;
     }
+    CheckpointSaver saver = nullptr;
+    if (InitCheckpoint(*patchWriter, checkpoint, saver) != 0) {
+        PATCH_LOGE("ApplyBlockPatch : Failed to resume at checkpoint");
+        return -1;
+    }
 
     PkgManager* pkgManager = Hpackage::PkgManager::CreatePackageInstance();
     if (pkgManager == nullptr) {
@@ -199,6 +314,7 @@ int32_t UpdateApplyPatch::ApplyBlockPatch(const PatchBuffer &patchInfo,
         Hpackage::PkgManager::ReleasePackageInstance(pkgManager);
         return -1;
     }
+    patch->SetCheckpoint(checkpoint.interval, checkpoint.resume, saver);
     ret = patch->ApplyPatch();
     pkgManager->ClosePkgStream(stream);
     Hpackage::PkgManager::ReleasePackageInstance(pkgManager);
@@ -258,7 +374,9 @@ int32_t UpdateApplyPatch::ApplyPatch(const std::string &patchName,
             PATCH_LOGE("Failed to apply image patch file");
             return -1;
         }
-    } else if (memcmp(patchData.memory, BSDIFF_MAGIC, std::char_traits<char>::length(BSDIFF_MAGIC)) == 0) { // bsdiff
+    } else if (memcmp(patchData.memory, BSDIFF_MAGIC, std::char_traits<char>::length(BSDIFF_MAGIC)) == 0 ||
+        memcmp(patchData.memory, BSDIFF_CODEC_MAGIC, std::char_traits<char>::length(BSDIFF_CODEC_MAGIC)) == 0 ||
+        memcmp(patchData.memory, BSDIFF_WINDOW_MAGIC, std::char_traits<char>::length(BSDIFF_WINDOW_MAGIC)) == 0) {
         PatchBuffer patchInfo = {patchData.memory, 0, patchData.length};
         BlockBuffer oldInfo = {oldData.memory, oldData.length};
         if (ApplyBlockPatch(patchInfo, oldInfo, writer.get()) != 0) {
@@ -298,9 +416,43 @@ int32_t ImagePatchWriter::Write(size_t start, const BlockBuffer &buffer, size_t
         return 0;
     }
     SHA256_Update(&sha256Ctx_, buffer.buffer, len);
+    written_ += len;
     return writer_(start, buffer, len);
 }
 
+int32_t ImagePatchWriter::Resume(const PatchCheckpoint &checkpoint, const BlockBuffer &written)
+{
+    if (!init_ || written_ != 0) {
+        PATCH_LOGE("Failed to check init");
+        return -1;
+    }
+    if (written.buffer == nullptr || written.length != checkpoint.newOffset) {
+        PATCH_LOGE("Invalid written data %zu of checkpoint %llu", written.length,
+            static_cast<unsigned long long>(checkpoint.newOffset));
+        return -1;
+    }
+    SHA256_CTX ctx = sha256Ctx_;
+    SHA256_Update(&ctx, written.buffer, written.length);
+    SHA256_CTX finalCtx = ctx;
+    uint8_t digest[SHA256_DIGEST_LENGTH] = {};
+    SHA256_Final(digest, &finalCtx);
+    if (memcmp(digest, checkpoint.digest, SHA256_DIGEST_LENGTH) != 0) {
+        PATCH_LOGE("Written data does not match checkpoint");
+        return -1;
+    }
+    sha256Ctx_ = ctx;
+    written_ = written.length;
+    return 0;
+}
+
+void ImagePatchWriter::FillCheckpoint(PatchCheckpoint &checkpoint) const
+{
+    // the digest of the whole output goes on from the same context
+    SHA256_CTX ctx = sha256Ctx_;
+    SHA256_Final(checkpoint.digest, &ctx);
+    checkpoint.newOffset = written_;
+}
+
 int32_t ImagePatchWriter::Finish()
 {
     if (!init_) {
@@ -34,6 +34,8 @@ static constexpr int H_ZERO_NUMBER = 0;
 
 namespace Updater {
 class Command;
+class WriteBehindQueue;
+class ZeroEngine;
 
 class BlockSet {
 public:
@@ -84,12 +86,21 @@ public:
 
     static bool IsTwoBlocksOverlap(const BlockSet &source, BlockSet &target);
 
+    // Set queries on the sorted and coalesced ranges, the order of insertion is ignored
+    bool IsOverlap(const BlockSet &other) const;
+    bool IsContain(const BlockSet &other) const;
+    bool IsContain(size_t block) const;
+    BlockSet Intersect(const BlockSet &other) const;
+    BlockSet Subtract(const BlockSet &other) const;
+    BlockSet Union(const BlockSet &other) const;
+
     static void MoveBlock(std::vector<uint8_t> &target, const BlockSet &locations,
         const std::vector<uint8_t> &source);
 
     int32_t LoadTargetBuffer(const Command &cmd, std::vector<uint8_t> &buffer, size_t &blockSize, size_t pos,
         std::string &srcHash);
-    int32_t WriteZeroToBlock(int fd, bool isErase = true);
+    // zero or erase the blocks with the engine probed for fd, a new one is probed when it is not given
+    int32_t WriteZeroToBlock(int fd, bool isErase = true, ZeroEngine *engine = nullptr);
 
     int32_t WriteDiffToBlock(const Command &cmd, std::vector<uint8_t> &sourceBuffer, uint8_t *patchBuffer,
                              size_t patchLength, bool isImgDiff = true);
@@ -97,16 +108,22 @@ public:
     // Read data from block
     size_t ReadDataFromBlock(int fd, std::vector<uint8_t> &buffer);
 
-    // write data to block
-    size_t WriteDataToBlock(int fd, std::vector<uint8_t> &buffer);
+    // write data to block, queued and left unsynced when a write behind queue is given
+    size_t WriteDataToBlock(int fd, std::vector<uint8_t> &buffer, WriteBehindQueue *queue = nullptr);
 
 protected:
     size_t blockSize_;
     std::vector<BlockPair> blocks_;
+    // blocks_ sorted by start and with adjacent or overlapped ranges merged
+    std::vector<BlockPair> index_;
 
 private:
     void PushBack(BlockPair block_pair);
     void ClearBlocks();
+    void BuildIndex();
+    static void CoalesceIndex(std::vector<BlockPair> &index);
+    static BlockSet FromIndex(std::vector<BlockPair> &&index);
+    std::vector<BlockPair>::const_iterator FindIndex(size_t block) const;
     bool CheckReliablePair(BlockPair pair);
     int32_t LoadSourceBuffer(const Command &cmd, size_t &pos, std::vector<uint8_t> &sourceBuffer,
         bool &isOverlap, size_t &srcBlockSize);
@@ -16,30 +16,48 @@
 #ifndef UPDATER_BLOCK_WRITER_H
 #define UPDATER_BLOCK_WRITER_H
 #include <cstdio>
+#include <memory>
 #include <string>
 #include <unistd.h>
+#include <openssl/sha.h>
 #include "applypatch/block_set.h"
 #include "applypatch/data_writer.h"
 
 namespace Updater {
+class WriteBehindQueue;
+
 class BlockWriter : public DataWriter {
 public:
     bool Write(const uint8_t *addr, size_t len, const void *context) override;
     virtual ~BlockWriter() {}
     BlockWriter(int fd, BlockSet& bs) : fd_(fd), bs_(bs), totalWritten_(0), blockIndex_(0),
-        currentBlockLeft_(0) {}
+        currentBlockLeft_(0), currentOffset_(0) {}
     size_t GetTotalWritten() const;
     size_t GetBlocksSize() const;
     bool IsWriteDone() const;
+    // Hash the data as it is written, call before the first Write
+    void EnableDigest();
+    // Hex sha256 of the written blocks, empty unless digest is enabled and all blocks are written
+    std::string GetDigest();
+    // Queue the blocks behind instead of writing them in place, they are not synced
+    void SetWriteQueue(WriteBehindQueue *queue);
+    // Move past len bytes that are already on the blocks, they are neither written nor hashed
+    bool Skip(size_t len);
 private:
     BlockWriter(const BlockWriter&) = delete;
     const BlockWriter& operator=(const BlockWriter&) = delete;
+    // addr is null to skip
+    bool Advance(const uint8_t *addr, size_t len);
     int fd_;
     BlockSet bs_;
     size_t totalWritten_;
     // index of BlockPair in BlockSet
     size_t blockIndex_;
     size_t currentBlockLeft_;
+    // device offset to write the rest of the current block pair
+    off64_t currentOffset_;
+    std::unique_ptr<SHA256_CTX> shaCtx_ {};
+    WriteBehindQueue *queue_ { nullptr };
 };
 } // namespace Updater
 #endif // UPDATER_BLOCK_WRITER_H
@@ -46,7 +46,12 @@ public:
     std::string GetCommandHead() const;
     void SetIsStreamCmd(bool isStreamCmd);
     bool IsStreamCmd() const;
-    
+    void SetFreeStash(const std::string &stash) const;
+    std::string GetFreeStash() const;
+    // line of the command in transfer.list
+    void SetIndex(size_t index);
+    size_t GetIndex() const;
+
 private:
     CommandType ParseCommandType(const std::string &first_cmd);
 
@@ -58,6 +63,9 @@ private:
     std::unique_ptr<int> targetFd_ {};
     TransferParams* transferParams_;
     bool isStreamCmd_ {false};
+    // stash of overlapping source blocks, freed once this command is written
+    mutable std::string freeStash_ {};
+    size_t index_ {0};
 };
 } // namespace Updater
 #endif
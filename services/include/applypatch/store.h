@@ -22,6 +22,7 @@
 #include "applypatch/command.h"
 
 namespace Updater {
+struct TransferParams;
 class Store {
 public:
     // Create new store space
@@ -31,9 +32,19 @@ public:
     // Write data to store space by id
     static int32_t WriteDataToStore(const std::string &dirPath, const std::string &fileName,
         const std::vector<uint8_t> &buffer, int size);
-    // Load data from store by id
+    // Write lz4 compressed data, shared through a pool with the stores of other partitions
+    static int32_t WriteCompressedToStore(const std::string &dirPath, const std::string &fileName,
+        const std::vector<uint8_t> &buffer);
+    static int32_t WriteStashToStore(const std::string &dirPath, const std::string &fileName,
+        const std::vector<uint8_t> &buffer, bool isCompress);
+    // Load data from store by id, raw or compressed
     static int32_t LoadDataFromStore(const std::string &dirPath, const std::string &fileName,
         std::vector<uint8_t> &buffer);
+    // Stash access of a block update, through its stash cache when it has one
+    static int32_t SaveStash(const TransferParams &params, const std::string &id,
+        const std::vector<uint8_t> &buffer, const BlockSet &source);
+    static int32_t LoadStash(const TransferParams &params, const std::string &id, std::vector<uint8_t> &buffer);
+    static int32_t FreeStash(const TransferParams &params, const std::string &id);
 };
 } // namespace Updater
 #endif // UPDATER_STORE_H
@@ -15,7 +15,9 @@
 #ifndef USCRIPT_TRANSFERLIST_H
 #define USCRIPT_TRANSFERLIST_H
 
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -26,6 +28,10 @@
 
 
 namespace Updater {
+class AppliedBitmap;
+class StashCache;
+class WriteBehindQueue;
+class ZeroEngine;
 
 struct WriterThreadInfo {
     pthread_mutex_t mutex;
@@ -43,13 +49,12 @@ struct TransferParams {
     size_t blockCount;
     size_t maxEntries;
     size_t maxBlocks;
-    size_t written;
+    std::atomic<size_t> written;
     pthread_t thread;
     Uscript::UScriptEnv *env;
     std::unique_ptr<WriterThreadInfo> writerThreadInfo;
     int storeCreated;
     std::string storeBase;
-    std::string freeStash;
     std::string retryFile;
     std::string devPath;
     std::string patchDatFile;
@@ -57,14 +62,35 @@ struct TransferParams {
     size_t dataBufferSize;
     bool canWrite;
     bool isUpdaterMode;
+    size_t workerCount;
+    // sync the retry checkpoint after this many commands or written blocks, 0 for every command
+    size_t checkpointCommands;
+    size_t checkpointBlocks;
+    // bytes of stashes kept in memory, 0 to write every stash to the store
+    size_t stashCacheSize;
+    // write stashes lz4 compressed and shared between partitions
+    bool compressStash;
+    // verify new blocks by reading them back instead of hashing the data while it is written
+    bool isParanoidVerify;
+    // bytes of target blocks queued for a background writer, 0 to write and sync every command in place
+    size_t writeBehindSize;
+    // bytes of a diff target between checkpoints of its patch, a smaller target is applied again as a whole
+    size_t patchCheckpointSize;
+    // commands applied or started by earlier attempts, kept in the store
+    std::shared_ptr<AppliedBitmap> appliedBitmap;
+    std::shared_ptr<StashCache> stashCache;
+    std::shared_ptr<WriteBehindQueue> writeQueue;
+    std::shared_ptr<ZeroEngine> zeroEngine;
 };
 
+class CheckpointJournal;
+struct CommandNode;
 class TransferManager;
 using TransferManagerPtr = TransferManager *;
 class TransferManager {
 public:
     TransferManager();
-    virtual ~TransferManager() {};
+    virtual ~TransferManager();
 
     bool CommandsParser(int fd, const std::vector<std::string> &context);
 
@@ -77,12 +103,21 @@ public:
 
 private:
     void UpdateProgress(size_t &initBlock, size_t totalSize);
-    bool RegisterForRetry(const std::string &cmd);
+    bool RegisterForRetry(const CommandNode &node);
     bool CommandsExecute(int fd, Command &cmd);
+    CommandResult ExecuteCommand(int fd, Command &cmd);
+    CommandResult PersistStash(const CommandNode &node);
+    CommandResult WaitForWrites(const CommandNode &node);
+    void InitWriteQueue(int fd);
+    CommandResult ExecuteNode(int fd, CommandNode &node);
+    void InitAppliedBitmap(size_t count);
+    void KeepStashForRetry(std::unique_ptr<Command> cmd, std::vector<std::unique_ptr<Command>> &stashCmds);
+    bool CommandsSchedule(int fd, std::vector<std::unique_ptr<Command>> &cmds, size_t totalSize);
     bool CommandParserPreCheck(const std::vector<std::string> &context);
     std::vector<std::string>::const_iterator InitCommandParser(std::vector<std::string>::const_iterator ct,
         std::string &retryCmd);
     std::unique_ptr<TransferParams> transferParams_;
+    std::unique_ptr<CheckpointJournal> journal_;
 };
 } // namespace Updater
 #endif
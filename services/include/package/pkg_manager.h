@@ -321,6 +321,16 @@ public:
      */
     virtual const FileInfo *GetFileInfo(const std::string &fileId) = 0;
 
+    /**
+     * Get the data of a file stored without compression, in place in the mapped package.
+     * The data is checked against the crc recorded for the file, if any, once, when the view is created.
+     *
+     * @param fileId        file ID
+     * @param buffer        read only view of the file, valid while the package is loaded
+     * @return              PKG_SUCCESS; an error if the file is compressed or the package can not be mapped
+     */
+    virtual int32_t GetFileBuffer(const std::string &fileId, PkgBuffer &buffer) = 0;
+
     /**
      * Create a a package stream to output.
      *
@@ -16,16 +16,21 @@
 #ifndef UPDATE_PATCH_H
 #define UPDATE_PATCH_H
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include "package/pkg_manager.h"
 #include "openssl/sha.h"
 
 namespace UpdatePatch {
+class PagedImageSource;
+
 struct PatchParam {
     uint8_t* oldBuff;
     size_t oldSize;
     uint8_t* patch;
     size_t patchSize;
+    // old image read on demand when oldBuff is null, oldSize is its size
+    PagedImageSource *oldSource;
 };
 
 struct PatchBuffer {
@@ -36,6 +41,30 @@ struct PatchBuffer {
 
 using BlockBuffer = Hpackage::PkgBuffer;
 
+// Where a patch stopped, enough to go on with it after an interruption
+struct PatchCheckpoint {
+    // control tuples of a bsdiff patch or chunks of an image patch that are applied
+    uint64_t position;
+    // offset of the next chunk record of an image patch
+    uint64_t patchOffset;
+    int64_t oldOffset;
+    // bytes of output before the checkpoint
+    uint64_t newOffset;
+    // sha256 of the output before newOffset
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+};
+
+struct PatchCheckpointParam {
+    // bytes of output between checkpoints, 0 for none
+    size_t interval { 0 };
+    // the output before newOffset has to be synced before the checkpoint is kept
+    std::function<int32_t(const PatchCheckpoint &checkpoint)> save {};
+    // checkpoint of an interrupted attempt, null to start from the beginning
+    const PatchCheckpoint *resume { nullptr };
+    // output before resume->newOffset read back, it is hashed but not written again
+    BlockBuffer written {};
+};
+
 class UpdatePatchWriter {
 public:
     UpdatePatchWriter() = default;
@@ -54,6 +83,8 @@ public:
 
     static int32_t ApplyImagePatch(const PatchParam &param, const std::vector<uint8_t> &bonusData,
         ImageProcessor writer, const std::string& expected);
+    static int32_t ApplyImagePatch(const PatchParam &param, const std::vector<uint8_t> &bonusData,
+        ImageProcessor writer, const std::string& expected, const PatchCheckpointParam &checkpoint);
     static int32_t ApplyImagePatch(const PatchParam &param,
         UpdatePatchWriterPtr writer, const std::vector<uint8_t> &bonusData);
     static bool PreCheck(const PatchParam &param, const UpdatePatchWriterPtr writer);
@@ -61,6 +92,8 @@ public:
         const BlockBuffer &oldInfo, UpdatePatchWriterPtr writer);
     static int32_t ApplyBlockPatch(const PatchBuffer &patchInfo,
         const BlockBuffer &oldInfo, ImageProcessor writer, const std::string& expected);
+    static int32_t ApplyBlockPatch(const PatchBuffer &patchInfo, const BlockBuffer &oldInfo,
+        ImageProcessor writer, const std::string& expected, const PatchCheckpointParam &checkpoint);
     static int32_t ApplyBlockPatch(const PatchBuffer &patchInfo,
         const BlockBuffer &oldInfo, std::vector<uint8_t> &newData);
     static int32_t ApplyBlockPatch(const PatchBuffer &patchInfo,
@@ -92,8 +125,17 @@ public:
     int32_t Init() override;
     int32_t Write(size_t start, const BlockBuffer &buffer, size_t len) override;
     int32_t Finish() override;
+    // Take the output before the checkpoint as written, it must match the digest of the checkpoint
+    int32_t Resume(const PatchCheckpoint &checkpoint, const BlockBuffer &written);
+    // Fill newOffset and digest of a checkpoint with the output written so far
+    void FillCheckpoint(PatchCheckpoint &checkpoint) const;
+    size_t GetWritten() const
+    {
+        return written_;
+    }
 private:
     bool init_ { false };
+    size_t written_ { 0 };
     SHA256_CTX sha256Ctx_ {};
     UpdateApplyPatch::ImageProcessor writer_;
     std::string expected_;
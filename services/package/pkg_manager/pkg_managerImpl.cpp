@@ -105,6 +105,10 @@ void PkgManagerImpl::ClearPkgFile()
         stream = nullptr;
         iter1 = pkgStreams_.erase(iter1);
     }
+    for (auto &pkgMap : pkgMaps_) {
+        ReleaseMemory(pkgMap.second.buffer, pkgMap.second.length);
+    }
+    pkgMaps_.clear();
 }
 
 int32_t PkgManagerImpl::CreatePackage(const std::string &path, const std::string &keyName, PkgInfoPtr header,
@@ -532,6 +536,69 @@ const FileInfo *PkgManagerImpl::GetFileInfo(const std::string &path)
     return nullptr;
 }
 
+int32_t PkgManagerImpl::GetFileBuffer(const std::string &path, PkgBuffer &buffer)
+{
+    PkgEntryPtr pkgEntry = GetPkgEntry(path);
+    if (pkgEntry == nullptr || pkgEntry->GetPkgFile() == nullptr) {
+        PKG_LOGE("Can not find file %s", path.c_str());
+        return PKG_INVALID_FILE;
+    }
+    const FileInfo *info = pkgEntry->GetFileInfo();
+    if (pkgEntry->GetPkgFile()->GetPkgType() != PkgFile::PKG_TYPE_ZIP ||
+        !static_cast<ZipFileEntry *>(pkgEntry)->IsStored() || info->packedSize != info->unpackedSize) {
+        PKG_LOGI("File %s is not stored", path.c_str());
+        return PKG_INVALID_PARAM;
+    }
+    PkgBuffer package {};
+    int32_t ret = MapPkgStream(pkgEntry->GetPkgFile()->GetPkgStream(), package);
+    if (ret != PKG_SUCCESS) {
+        return ret;
+    }
+    if (info->dataOffset > package.length || package.length - info->dataOffset < info->unpackedSize) {
+        PKG_LOGE("Invalid data offset %zu of %s", info->dataOffset, path.c_str());
+        return PKG_INVALID_FILE;
+    }
+    PkgBuffer data(package.buffer + info->dataOffset, info->unpackedSize);
+    // The view is never unpacked, so its crc is checked once here.
+    if (!static_cast<ZipFileEntry *>(pkgEntry)->CheckCrc(data)) {
+        PKG_LOGE("Invalid crc of %s", path.c_str());
+        return PKG_INVALID_DIGEST;
+    }
+    buffer.buffer = data.buffer;
+    buffer.length = data.length;
+    return PKG_SUCCESS;
+}
+
+int32_t PkgManagerImpl::MapPkgStream(PkgStreamPtr stream, PkgBuffer &buffer)
+{
+    if (stream == nullptr) {
+        PKG_LOGE("Invalid stream");
+        return PKG_INVALID_STREAM;
+    }
+    if (stream->GetBuffer(buffer) == PKG_SUCCESS && buffer.buffer != nullptr) {
+        return PKG_SUCCESS;
+    }
+    if (stream->GetStreamType() != PkgStream::PkgStreamType_Read) {
+        PKG_LOGE("Can not map stream %s", stream->GetFileName().c_str());
+        return PKG_INVALID_STREAM;
+    }
+    std::lock_guard<std::mutex> lock(mapLock_);
+    auto iter = pkgMaps_.find(stream->GetFileName());
+    if (iter != pkgMaps_.end()) {
+        buffer = iter->second;
+        return PKG_SUCCESS;
+    }
+    size_t fileSize = GetFileSize(stream->GetFileName());
+    uint8_t *memoryMap = fileSize > 0 ? FileMap(stream->GetFileName()) : nullptr;
+    if (memoryMap == nullptr) {
+        PKG_LOGE("Fail to map package %s", stream->GetFileName().c_str());
+        return PKG_INVALID_FILE;
+    }
+    buffer = PkgBuffer(memoryMap, fileSize);
+    pkgMaps_[stream->GetFileName()] = buffer;
+    return PKG_SUCCESS;
+}
+
 PkgEntryPtr PkgManagerImpl::GetPkgEntry(const std::string &path)
 {
     // Find out pkgEntry by fileId.
@@ -53,6 +53,8 @@ public:
 
     const FileInfo *GetFileInfo(const std::string &path) override;
 
+    int32_t GetFileBuffer(const std::string &path, PkgBuffer &buffer) override;
+
     const PkgInfo *GetPackageInfo(const std::string &packagePath) override;
 
     PkgEntryPtr GetPkgEntry(const std::string &path);
@@ -138,12 +140,16 @@ private:
 
     const std::string GetExtraPath(const std::string &path);
 
+    int32_t MapPkgStream(PkgStreamPtr stream, PkgBuffer &buffer);
+
 private:
     bool unzipToFile_ {false};
     std::vector<PkgFilePtr> pkgFiles_ {};
     std::map<std::string, PkgFileConstructor> pkgFileCreator_ {};
     std::mutex mapLock_ {};
     std::map<std::string, PkgStreamPtr> pkgStreams_ {};
+    // packages read through a file stream, mapped for GetFileBuffer
+    std::map<std::string, PkgBuffer> pkgMaps_ {};
     std::string signVerifyKeyName_ {};
     PkgDecodeProgress decodeProgress_ { nullptr };
 };
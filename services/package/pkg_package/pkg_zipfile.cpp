@@ -13,6 +13,8 @@
  * limitations under the License.
  */
 #include "pkg_zipfile.h"
+#include <algorithm>
+#include <cstdint>
 #include <ctime>
 #include <limits>
 #include "dump.h"
@@ -734,6 +736,28 @@ int32_t ZipFileEntry::DecodeHeader(PkgBuffer &buffer, size_t headerOffset, size_
     return PKG_SUCCESS;
 }
 
+bool ZipFileEntry::IsStored() const
+{
+    return fileInfo_.method == Z_STORED;
+}
+
+bool ZipFileEntry::CheckCrc(const PkgBuffer &data) const
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    size_t offset = 0;
+    while (offset < data.length) {
+        uInt len = static_cast<uInt>(std::min(data.length - offset, static_cast<size_t>(UINT32_MAX)));
+        crc = crc32(crc, data.buffer + offset, len);
+        offset += len;
+    }
+    // Same as deflate, a zero crc means none was recorded for the entry
+    if (crc32_ != 0 && static_cast<uint32_t>(crc) != crc32_) {
+        PKG_LOGE("check crc %u %u failed", crc32_, static_cast<uint32_t>(crc));
+        return false;
+    }
+    return true;
+}
+
 int32_t ZipFileEntry::Init(const PkgManager::FileInfoPtr fileInfo, PkgStreamPtr inStream)
 {
     fileInfo_.level = Z_BEST_COMPRESSION;
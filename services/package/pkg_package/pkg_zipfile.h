@@ -154,6 +154,12 @@ public:
     int32_t DecodeCentralDirEntry(PkgStreamPtr inStream, PkgBuffer &buffer, size_t currentPos,
         size_t &decodeLen);
 
+    // True if the data is kept without compression
+    bool IsStored() const;
+
+    // True if data matches the crc recorded for the entry, or no crc was recorded
+    bool CheckCrc(const PkgBuffer &data) const;
+
 protected:
     ZipFileInfo fileInfo_ {};
     uint32_t crc32_ {0};
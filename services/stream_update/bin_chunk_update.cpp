@@ -609,6 +609,9 @@ bool BinChunkUpdate::InitTransferParams()
     updateInfo_.transferParams = std::make_unique<TransferParams>();
     updateInfo_.transferParams->storeBase = std::string("/data/updater/") + updateInfo_.curPartition + "_tmp";
     updateInfo_.transferParams->canWrite = true;
+    #ifdef UPDATER_PARANOID_VERIFY
+    updateInfo_.transferParams->isParanoidVerify = true;
+    #endif
 
     int32_t ret = Store::CreateNewSpace(updateInfo_.transferParams->storeBase, true);
     if (ret == -1) {
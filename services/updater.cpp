@@ -166,7 +166,8 @@ static bool ConvertStrToLongLong(PkgManager::StreamPtr outStream, int64_t &value
 std::vector<uint64_t> GetStashSizeList(const UpdaterParams &upParams)
 {
     UPDATER_INIT_RECORD;
-    const std::string maxStashFileName = "all_max_stash";
+    // Packages made for compressed stashes also carry the compressed footprint, which is what /data needs.
+    const std::string compressedStashFileName = "all_max_stash_compressed";
     std::vector<uint64_t> stashSizeList;
     for (unsigned int i = upParams.pkgLocation; i < upParams.updatePackage.size(); i++) {
         PkgManager::PkgManagerPtr pkgManager = Hpackage::PkgManager::CreatePackageInstance();
@@ -186,7 +187,12 @@ std::vector<uint64_t> GetStashSizeList(const UpdaterParams &upParams)
             return std::vector<uint64_t> {};
         }
 
+        std::string maxStashFileName = compressedStashFileName;
         const FileInfo *info = pkgManager->GetFileInfo(maxStashFileName);
+        if (info == nullptr) {
+            maxStashFileName = "all_max_stash";
+            info = pkgManager->GetFileInfo(maxStashFileName);
+        }
         if (info == nullptr) {
             LOG(INFO) << "all_max_stash not exist " << upParams.updatePackage[i];
             stashSizeList.push_back(0);
@@ -19,6 +19,7 @@
 #include <sstream>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <thread>
 #include <unistd.h>
 #include "applypatch/block_set.h"
 #include "applypatch/store.h"
@@ -43,6 +44,12 @@ constexpr int32_t SHA_CHECK_PARAMS = 3;
 constexpr int32_t SHA_CHECK_TARGETPAIRS_INDEX = 3;
 constexpr int32_t SHA_CHECK_TARGETSHA_INDEX = 4;
 constexpr int32_t SHA_CHECK_TARGET_PARAMS = 5;
+constexpr size_t MAX_TRANSFER_WORKERS = 4;
+constexpr size_t CHECKPOINT_COMMANDS = 64;
+constexpr size_t CHECKPOINT_BLOCKS = 16384;
+constexpr size_t STASH_CACHE_SIZE = 64 * 1024 * 1024;
+constexpr size_t WRITE_BEHIND_SIZE = 16 * 1024 * 1024;
+constexpr size_t PATCH_CHECKPOINT_SIZE = 64 * 1024 * 1024;
 
 __attribute__((weak)) void GetWriteDevPath(const std::string &path, [[maybe_unused]] const std::string &partitionName,
     std::string &devPath)
@@ -217,6 +224,14 @@ static int32_t ExecuteTransferCommand(int fd, const std::vector<std::string> &li
     transferParams->storeBase = std::string("/data/updater") + infos.partitionName + "_tmp";
     transferParams->retryFile = std::string("/data/updater") + infos.partitionName + "_retry";
     transferParams->devPath = infos.devPath;
+    transferParams->workerCount = std::min(static_cast<size_t>(std::thread::hardware_concurrency()),
+        MAX_TRANSFER_WORKERS);
+    transferParams->checkpointCommands = CHECKPOINT_COMMANDS;
+    transferParams->checkpointBlocks = CHECKPOINT_BLOCKS;
+    transferParams->stashCacheSize = STASH_CACHE_SIZE;
+    transferParams->compressStash = true;
+    transferParams->writeBehindSize = WRITE_BEHIND_SIZE;
+    transferParams->patchCheckpointSize = PATCH_CHECKPOINT_SIZE;
     LOG(INFO) << "Store base path is " << transferParams->storeBase;
     int32_t ret = Store::CreateNewSpace(transferParams->storeBase, !transferParams->env->IsRetry());
     if (ret == -1) {
@@ -357,6 +372,24 @@ static int32_t ExtractFileByName(Uscript::UScriptEnv &env, const std::string &fi
     return USCRIPT_SUCCESS;
 }
 
+static int32_t GetPatchDatInPlace(Uscript::UScriptEnv &env, const UpdateBlockInfo &infos,
+    Hpackage::PkgManager::StreamPtr &outStream, uint8_t *&outBuf, size_t &buffSize)
+{
+    if (env.GetPkgManager() == nullptr) {
+        LOG(ERROR) << "Error to get pkg manager";
+        return USCRIPT_ERROR_EXECUTE;
+    }
+    PkgBuffer patchView {};
+    if (env.GetPkgManager()->GetFileBuffer(infos.patchDataName, patchView) != PKG_SUCCESS ||
+        env.GetPkgManager()->CreatePkgStream(outStream, infos.patchDataName, patchView) != PKG_SUCCESS) {
+        return USCRIPT_ERROR_EXECUTE;
+    }
+    outBuf = patchView.buffer;
+    buffSize = patchView.length;
+    LOG(INFO) << "Read " << infos.patchDataName << " in place, size " << buffSize;
+    return USCRIPT_SUCCESS;
+}
+
 static int32_t ExtractPatchDatFile(Uscript::UScriptEnv &env, const UpdateBlockInfo &infos,
     Hpackage::PkgManager::StreamPtr &outStream, std::string &datFile)
 {
@@ -426,9 +459,13 @@ static int32_t ExecuteUpdateBlock(Uscript::UScriptEnv &env, Uscript::UScriptCont
 
     LOG(INFO) << "Start unpack new data thread done. Get patch data: " << infos.patchDataName;
     transferParams->isUpdaterMode = Utils::IsUpdaterMode();
-    int ret = transferParams->isUpdaterMode ? ExtractFileByName(env, infos.patchDataName, outStream,
-        transferParams->dataBuffer, transferParams->dataBufferSize) : ExtractPatchDatFile(env,
-        infos, outStream, transferParams->patchDatFile);
+    // A stored patch.dat is neither copied to memory nor to a file
+    int ret = GetPatchDatInPlace(env, infos, outStream, transferParams->dataBuffer, transferParams->dataBufferSize);
+    if (ret != USCRIPT_SUCCESS) {
+        ret = transferParams->isUpdaterMode ? ExtractFileByName(env, infos.patchDataName, outStream,
+            transferParams->dataBuffer, transferParams->dataBufferSize) : ExtractPatchDatFile(env,
+            infos, outStream, transferParams->patchDatFile);
+    }
     if (ret != USCRIPT_SUCCESS) {
         return USCRIPT_ERROR_EXECUTE;
     }
@@ -21,6 +21,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include "applypatch/block_set.h"
@@ -28,6 +29,7 @@
 #include "applypatch/transfer_manager.h"
 #include "applypatch/partition_record.h"
 #include "diffpatch/diffpatch.h"
+#include "diffpatch/patch/paged_image_source.h"
 #include "dump.h"
 #include "fs_manager/mount.h"
 #include "log/log.h"
@@ -44,6 +46,13 @@ using namespace Updater;
 namespace Updater {
 constexpr uint32_t IMAGE_PATCH_CMD_LEN = 6;
 constexpr uint32_t IMAGE_PATCH_CHECK_CMD_LEN = 5;
+constexpr size_t IMAGE_PATCH_CACHE_SIZE = 32 * 1024 * 1024;
+static std::atomic<size_t> g_sourceCacheSize { IMAGE_PATCH_CACHE_SIZE };
+
+void USInstrImagePatch::SetSourceCacheSize(size_t size)
+{
+    g_sourceCacheSize = size;
+}
 
 int32_t USInstrImagePatch::Execute(Uscript::UScriptEnv &env, Uscript::UScriptContext &context)
 {
@@ -100,12 +109,15 @@ std::string USInstrImagePatch::GetFileHash(const std::string &file)
 }
 
 int32_t USInstrImagePatch::ApplyPatch(const ImagePatchPara &para, const UpdatePatch::MemMapInfo &srcData,
-    const PkgBuffer &patchData)
+    UpdatePatch::PagedImageSource *pagedSource, const PkgBuffer &patchData)
 {
     std::vector<uint8_t> empty;
     UpdatePatch::PatchParam patchParam = {
-        srcData.memory, srcData.length, patchData.buffer, patchData.length
+        srcData.memory, srcData.length, patchData.buffer, patchData.length, pagedSource
     };
+    if (pagedSource != nullptr) {
+        patchParam.oldSize = pagedSource->GetSize();
+    }
     std::unique_ptr<DataWriter> writer = DataWriter::CreateDataWriter(WRITE_RAW, para.devPath);
     if (writer.get() == nullptr) {
         LOG(ERROR) << "Cannot create block writer, pkgdiff patch abort!";
@@ -144,6 +156,14 @@ int32_t USInstrImagePatch::CreatePatchStream(Uscript::UScriptEnv &env, const Ima
         }
     }
 
+    // A stored patch is read in place from the mapped package instead of being copied to memory.
+    PkgBuffer patchView {};
+    if (env.GetPkgManager()->GetFileBuffer(patchName, patchView) == PKG_SUCCESS &&
+        env.GetPkgManager()->CreatePkgStream(patchStream, patchName, patchView) == PKG_SUCCESS) {
+        LOG(INFO) << "USInstrImagePatch::CreatePatchStream in place " << para.partName;
+        return USCRIPT_SUCCESS;
+    }
+
     std::string patchFile = UPDATER_PATH + para.patchFile;
     int32_t ret = env.GetPkgManager()->CreatePkgStream(patchStream,
         patchFile, info->unpackedSize, PkgStream::PkgStreamType_MemoryMap);
@@ -206,7 +226,15 @@ int32_t USInstrImagePatch::ExecuteImagePatch(Uscript::UScriptEnv &env, Uscript::
         return USCRIPT_ERROR_EXECUTE;
     }
     UpdatePatch::MemMapInfo srcData {};
-    ret = UpdatePatch::PatchMapFile(srcFile, srcData);
+    std::unique_ptr<UpdatePatch::PagedImageSource> pagedSource = nullptr;
+    struct stat st {};
+    if (stat(srcFile.c_str(), &st) == 0 && static_cast<size_t>(st.st_size) > g_sourceCacheSize) {
+        LOG(INFO) << "Read " << srcFile << " through a page cache of " << g_sourceCacheSize;
+        pagedSource = std::make_unique<UpdatePatch::PagedImageSource>(srcFile, g_sourceCacheSize);
+        ret = pagedSource->Open();
+    } else {
+        ret = UpdatePatch::PatchMapFile(srcFile, srcData);
+    }
     if (ret != 0) {
         UPDATER_LAST_WORD(ret, "Failed to mmap src file error");
         LOG(ERROR) << "Failed to mmap src file error:" << ret;
@@ -223,7 +251,7 @@ int32_t USInstrImagePatch::ExecuteImagePatch(Uscript::UScriptEnv &env, Uscript::
     PkgBuffer patchData = {};
     patchStream->GetBuffer(patchData);
 
-    ret = ApplyPatch(para, srcData, patchData);
+    ret = ApplyPatch(para, srcData, pagedSource.get(), patchData);
     if (ret != USCRIPT_SUCCESS) {
         env.GetPkgManager()->ClosePkgStream(patchStream);
         return ret;
@@ -21,6 +21,10 @@
 #include "script_manager.h"
 #include "diffpatch/diffpatch.h"
 
+namespace UpdatePatch {
+class PagedImageSource;
+}
+
 namespace Updater {
 class USInstrImagePatch : public Uscript::UScriptInstruction {
 public:
@@ -36,6 +40,8 @@ public:
     USInstrImagePatch() {}
     virtual ~USInstrImagePatch() {}
     int32_t Execute(Uscript::UScriptEnv &env, Uscript::UScriptContext &context) override;
+    // Source images larger than size are read through a page cache of that size instead of mapped
+    static void SetSourceCacheSize(size_t size);
 private:
     int32_t GetParam(Uscript::UScriptContext &context, ImagePatchPara &para);
     int32_t CreatePatchStream(Uscript::UScriptEnv &env, const ImagePatchPara &para,
@@ -43,7 +49,7 @@ private:
     int32_t ExecuteImagePatch(Uscript::UScriptEnv &env, Uscript::UScriptContext &context);
     std::string GetSourceFile(const ImagePatchPara &para);
     int32_t ApplyPatch(const ImagePatchPara &para, const UpdatePatch::MemMapInfo &srcData,
-        const Hpackage::PkgBuffer &patchData);
+        UpdatePatch::PagedImageSource *pagedSource, const Hpackage::PkgBuffer &patchData);
     std::string GetFileHash(const std::string &file);
 };
 
@@ -0,0 +1,616 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+#include "blocks_diff.h"
+#include "blocks_patch.h"
+#include "bzip2_adapter.h"
+#include "diffpatch.h"
+#include "lz4_adapter.h"
+#include "pkg_manager.h"
+#include "update_diff.h"
+#include "update_patch.h"
+#include "utils.h"
+
+using namespace Hpackage;
+using namespace UpdatePatch;
+
+/*
+ * Heap use of the code under test, operator new is counted while a benchmark
+ * loop runs. malloc calls of the codec libraries are not seen, the process
+ * peak resident size is reported next to it.
+ */
+namespace {
+constexpr size_t ALLOC_HEADER_LEN = alignof(std::max_align_t);
+std::atomic<bool> g_isTracking { false };
+std::atomic<int64_t> g_allocCount { 0 };
+std::atomic<int64_t> g_liveBytes { 0 };
+std::atomic<int64_t> g_peakBytes { 0 };
+
+void *TrackedAlloc(size_t size)
+{
+    auto block = static_cast<uint8_t *>(malloc(size + ALLOC_HEADER_LEN));
+    if (block == nullptr) {
+        return nullptr;
+    }
+    *reinterpret_cast<size_t *>(block) = size;
+    if (g_isTracking) {
+        g_allocCount++;
+        int64_t live = g_liveBytes += static_cast<int64_t>(size);
+        int64_t peak = g_peakBytes;
+        while (live > peak && !g_peakBytes.compare_exchange_weak(peak, live)) {}
+    }
+    return block + ALLOC_HEADER_LEN;
+}
+
+void TrackedFree(void *ptr)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+    uint8_t *block = static_cast<uint8_t *>(ptr) - ALLOC_HEADER_LEN;
+    if (g_isTracking) {
+        g_liveBytes -= static_cast<int64_t>(*reinterpret_cast<size_t *>(block));
+    }
+    free(block);
+}
+} // namespace
+
+void *operator new(size_t size)
+{
+    void *ptr = TrackedAlloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return TrackedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return TrackedAlloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    TrackedFree(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    TrackedFree(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    TrackedFree(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    TrackedFree(ptr);
+}
+
+namespace Updater {
+constexpr size_t MIB = 1024 * 1024;
+constexpr size_t IMAGE_BLOCK_SIZE = 4096;
+constexpr size_t INSERT_LEN = 100;
+constexpr size_t WORD_MAX_LEN = 12;
+constexpr uint32_t LETTER_COUNT = 26;
+constexpr uint32_t WORD_COUNT = 1024;
+constexpr uint32_t VOCABULARY_SEED = 20250303;
+constexpr uint32_t PERCENT = 100;
+constexpr uint32_t OLD_SEED = 20250101;
+constexpr uint32_t NEW_SEED = 20250202;
+constexpr size_t ZIP_ENTRY_COUNT = 4;
+constexpr size_t DECODE_QUEUE_LIMIT = 1024 * 1024;
+constexpr uint8_t LZ4_BLOCK_SIZE_ID = 5; // 256K
+constexpr uint32_t SCAN_SIMILARITY = 90;
+const std::string BENCHMARK_PATH = "/data/local/tmp/updater_patch_benchmark/";
+
+enum ImageType : int64_t {
+    IMAGE_NORMAL = 0,
+    IMAGE_ZIP,
+    IMAGE_LZ4,
+    IMAGE_GZIP,
+};
+
+// Words of a fixed vocabulary, so that the images compress like text and binaries do
+const std::vector<std::string> &GetVocabulary()
+{
+    static std::vector<std::string> vocabulary = [] {
+        std::mt19937 rng(VOCABULARY_SEED);
+        std::vector<std::string> words(WORD_COUNT);
+        for (auto &word : words) {
+            size_t wordLen = 1 + rng() % WORD_MAX_LEN;
+            for (size_t j = 0; j < wordLen; j++) {
+                word.push_back(static_cast<char>('a' + rng() % LETTER_COUNT));
+            }
+        }
+        return words;
+    }();
+    return vocabulary;
+}
+
+void FillImage(std::mt19937 &rng, uint8_t *data, size_t size)
+{
+    const std::vector<std::string> &vocabulary = GetVocabulary();
+    size_t i = 0;
+    while (i < size) {
+        const std::string &word = vocabulary[rng() % vocabulary.size()];
+        for (size_t j = 0; j < word.size() && i < size; j++) {
+            data[i++] = static_cast<uint8_t>(word[j]);
+        }
+        if (i < size) {
+            data[i++] = ' ';
+        }
+    }
+}
+
+std::vector<uint8_t> MakeOldImage(size_t size)
+{
+    std::mt19937 rng(OLD_SEED);
+    std::vector<uint8_t> image(size);
+    FillImage(rng, image.data(), image.size());
+    return image;
+}
+
+// similarity percent of the blocks are kept, the others are rewritten and one insert per MiB shifts the rest
+std::vector<uint8_t> MakeNewImage(const std::vector<uint8_t> &oldImage, uint32_t similarity)
+{
+    std::mt19937 rng(NEW_SEED + similarity);
+    std::vector<uint8_t> image = oldImage;
+    for (size_t offset = 0; offset < image.size(); offset += IMAGE_BLOCK_SIZE) {
+        if (rng() % PERCENT >= similarity) {
+            FillImage(rng, image.data() + offset, std::min(IMAGE_BLOCK_SIZE, image.size() - offset));
+        }
+    }
+    for (size_t i = 0; i < image.size() / MIB; i++) {
+        std::vector<uint8_t> insert(INSERT_LEN);
+        FillImage(rng, insert.data(), insert.size());
+        size_t offset = rng() % image.size();
+        image.insert(image.begin() + static_cast<std::ptrdiff_t>(offset), insert.begin(), insert.end());
+    }
+    return image;
+}
+
+class CountingWriter : public UpdatePatchWriter {
+public:
+    CountingWriter() : UpdatePatchWriter() {}
+    ~CountingWriter() override {}
+
+    int32_t Init() override
+    {
+        return 0;
+    }
+    int32_t Write(size_t start, const BlockBuffer &buffer, size_t len) override
+    {
+        benchmark::DoNotOptimize(buffer.buffer);
+        written_ += len;
+        return 0;
+    }
+    int32_t Finish() override
+    {
+        return 0;
+    }
+    size_t written_ { 0 };
+};
+
+class VectorWriter : public UpdatePatchWriter {
+public:
+    explicit VectorWriter(std::vector<uint8_t> &data) : UpdatePatchWriter(), data_(data) {}
+    ~VectorWriter() override {}
+
+    int32_t Init() override
+    {
+        return 0;
+    }
+    int32_t Write(size_t start, const BlockBuffer &buffer, size_t len) override
+    {
+        data_.insert(data_.end(), buffer.buffer, buffer.buffer + len);
+        return 0;
+    }
+    int32_t Finish() override
+    {
+        return 0;
+    }
+private:
+    std::vector<uint8_t> &data_;
+};
+
+class HeapTracker {
+public:
+    HeapTracker()
+    {
+        g_allocCount = 0;
+        g_liveBytes = 0;
+        g_peakBytes = 0;
+        g_isTracking = true;
+    }
+    ~HeapTracker()
+    {
+        g_isTracking = false;
+    }
+
+    void Report(benchmark::State &state, size_t bytesPerIteration) const
+    {
+        g_isTracking = false;
+        struct rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(bytesPerIteration));
+        state.counters["allocs"] = benchmark::Counter(static_cast<double>(g_allocCount.load()),
+            benchmark::Counter::kAvgIterations);
+        state.counters["peak_heap"] = benchmark::Counter(static_cast<double>(g_peakBytes.load()),
+            benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+        state.counters["max_rss_kb"] = static_cast<double>(usage.ru_maxrss);
+    }
+};
+
+bool WriteFile(const std::string &path, const std::vector<uint8_t> &data)
+{
+    std::ofstream stream(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    return !stream.fail();
+}
+
+bool ReadFile(const std::string &path, std::vector<uint8_t> &data)
+{
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return !stream.bad() && !data.empty();
+}
+
+// Pack the image into a container of type, images of zip packages are cut into several entries
+bool PackImage(int64_t type, const std::vector<uint8_t> &image, const std::string &path)
+{
+    if (type == IMAGE_NORMAL) {
+        return WriteFile(path, image);
+    }
+    size_t entryCount = type == IMAGE_ZIP ? ZIP_ENTRY_COUNT : 1;
+    size_t entrySize = (image.size() + entryCount - 1) / entryCount;
+    std::vector<std::string> entries {};
+    for (size_t i = 0; i < entryCount; i++) {
+        size_t start = std::min(i * entrySize, image.size());
+        std::vector<uint8_t> entry(image.begin() + static_cast<std::ptrdiff_t>(start),
+            image.begin() + static_cast<std::ptrdiff_t>(std::min(start + entrySize, image.size())));
+        entries.push_back(path + ".entry" + std::to_string(i));
+        if (!WriteFile(entries.back(), entry)) {
+            return false;
+        }
+    }
+    PkgInfo pkgInfo {};
+    pkgInfo.signMethod = PKG_SIGN_METHOD_NONE;
+    pkgInfo.digestMethod = PKG_DIGEST_TYPE_SHA256;
+    PkgManager::PkgManagerPtr pkgManager = PkgManager::CreatePackageInstance();
+    int32_t ret = -1;
+    if (type == IMAGE_LZ4) {
+        std::vector<std::pair<std::string, Lz4FileInfo>> files {};
+        Lz4FileInfo file {};
+        file.fileInfo.identity = "image";
+        file.fileInfo.packMethod = PKG_COMPRESS_METHOD_LZ4;
+        file.fileInfo.digestMethod = PKG_DIGEST_TYPE_CRC;
+        files.emplace_back(entries[0], file);
+        pkgInfo.pkgType = PKG_PACK_TYPE_LZ4;
+        ret = pkgManager->CreatePackage(path, Utils::ON_SERVER, &pkgInfo, files);
+    } else {
+        std::vector<std::pair<std::string, ZipFileInfo>> files {};
+        for (size_t i = 0; i < entries.size(); i++) {
+            ZipFileInfo file {};
+            file.fileInfo.identity = "image" + std::to_string(i);
+            file.fileInfo.packMethod = type == IMAGE_ZIP ? PKG_COMPRESS_METHOD_ZIP : PKG_COMPRESS_METHOD_GZIP;
+            file.fileInfo.digestMethod = PKG_DIGEST_TYPE_CRC;
+            files.emplace_back(entries[i], file);
+        }
+        pkgInfo.pkgType = type == IMAGE_ZIP ? PKG_PACK_TYPE_ZIP : PKG_PACK_TYPE_GZIP;
+        ret = pkgManager->CreatePackage(path, Utils::ON_SERVER, &pkgInfo, files);
+    }
+    PkgManager::ReleasePackageInstance(pkgManager);
+    for (const auto &entry : entries) {
+        unlink(entry.c_str());
+    }
+    return ret == 0;
+}
+
+struct BlockPatchData {
+    std::vector<uint8_t> oldImage {};
+    std::vector<uint8_t> newImage {};
+    std::vector<uint8_t> patch {};
+};
+
+// Patches are made once for each argument set, the framework runs a benchmark more than once
+const BlockPatchData *GetBlockPatch(size_t size, uint32_t similarity, uint8_t codec)
+{
+    static std::map<std::tuple<size_t, uint32_t, uint8_t>, std::unique_ptr<BlockPatchData>> cache {};
+    auto &data = cache[std::make_tuple(size, similarity, codec)];
+    if (data != nullptr) {
+        return data.get();
+    }
+    data = std::make_unique<BlockPatchData>();
+    data->oldImage = MakeOldImage(size);
+    data->newImage = MakeNewImage(data->oldImage, similarity);
+    BlocksDiff::SetSectionCodec(codec);
+    size_t patchSize = 0;
+    int32_t ret = BlocksDiff::MakePatch({data->newImage.data(), data->newImage.size()},
+        {data->oldImage.data(), data->oldImage.size()}, data->patch, 0, patchSize);
+    BlocksDiff::SetSectionCodec(PATCH_CODEC_BZIP2);
+    if (ret != 0) {
+        data.reset();
+    }
+    return data.get();
+}
+
+struct ImagePatchData {
+    std::vector<uint8_t> oldImage {};
+    std::vector<uint8_t> patch {};
+};
+
+const ImagePatchData *GetImagePatch(int64_t type, size_t size, uint32_t similarity)
+{
+    static std::map<std::tuple<int64_t, size_t, uint32_t>, std::unique_ptr<ImagePatchData>> cache {};
+    auto &data = cache[std::make_tuple(type, size, similarity)];
+    if (data != nullptr) {
+        return data.get();
+    }
+    mkdir(BENCHMARK_PATH.c_str(), S_IRWXU);
+    // the package type is taken from the file extension
+    static const std::string extensions[] = {".img", ".zip", ".lz4", ".gz"};
+    std::string name = BENCHMARK_PATH + std::to_string(type) + "_" + std::to_string(size) + "_" +
+        std::to_string(similarity);
+    std::string oldName = name + "_old" + extensions[type];
+    std::string newName = name + "_new" + extensions[type];
+    std::vector<uint8_t> oldImage = MakeOldImage(size);
+    std::vector<uint8_t> newImage = MakeNewImage(oldImage, similarity);
+    data = std::make_unique<ImagePatchData>();
+    if (!PackImage(type, oldImage, oldName) || !PackImage(type, newImage, newName) ||
+        UpdateDiff::DiffImage(0, oldName, newName, name + ".patch") != 0 ||
+        !ReadFile(oldName, data->oldImage) || !ReadFile(name + ".patch", data->patch)) {
+        data.reset();
+    }
+    unlink(oldName.c_str());
+    unlink(newName.c_str());
+    unlink((name + ".patch").c_str());
+    unlink((name + ".patch.bspatch").c_str());
+    return data.get();
+}
+
+class PatchBenchmarkTest : public benchmark::Fixture {
+public:
+    PatchBenchmarkTest() = default;
+    ~PatchBenchmarkTest() override = default;
+    void SetUp(const ::benchmark::State &state) override
+    {}
+    void TearDown(const ::benchmark::State &state) override
+    {}
+};
+
+// Args: image MiB, similarity percent, section codec
+BENCHMARK_DEFINE_F(PatchBenchmarkTest, TestBlocksPatch)(benchmark::State &state)
+{
+    const BlockPatchData *data = GetBlockPatch(static_cast<size_t>(state.range(0)) * MIB,
+        static_cast<uint32_t>(state.range(1)), static_cast<uint8_t>(state.range(2)));
+    if (data == nullptr) {
+        state.SkipWithError("Failed to make patch");
+        return;
+    }
+    state.counters["patch_size"] = static_cast<double>(data->patch.size());
+    std::vector<uint8_t> newData {};
+    PatchBuffer patchInfo = {const_cast<uint8_t *>(data->patch.data()), 0, data->patch.size()};
+    BlockBuffer oldInfo = {const_cast<uint8_t *>(data->oldImage.data()), data->oldImage.size()};
+    HeapTracker tracker;
+    for (auto _ : state) {
+        BlocksBufferPatch patch(patchInfo, oldInfo, newData);
+        if (patch.ApplyPatch() != 0) {
+            state.SkipWithError("Failed to apply patch");
+            break;
+        }
+        benchmark::DoNotOptimize(newData.data());
+    }
+    tracker.Report(state, data->newImage.size());
+}
+
+// Args: image MiB, scan window MiB (0 scans the new image as a whole), scan workers
+BENCHMARK_DEFINE_F(PatchBenchmarkTest, TestBlocksDiff)(benchmark::State &state)
+{
+    std::vector<uint8_t> oldImage = MakeOldImage(static_cast<size_t>(state.range(0)) * MIB);
+    std::vector<uint8_t> newImage = MakeNewImage(oldImage, SCAN_SIMILARITY);
+    size_t scanWorkers = BlocksDiff::GetScanWorkers();
+    BlocksDiff::SetScanWindowSize(static_cast<size_t>(state.range(1)) * MIB);
+    BlocksDiff::SetScanWorkers(static_cast<size_t>(state.range(2)));
+    size_t patchSize = 0;
+    for (auto _ : state) {
+        std::vector<uint8_t> patch {};
+        if (BlocksDiff::MakePatch({newImage.data(), newImage.size()},
+            {oldImage.data(), oldImage.size()}, patch, 0, patchSize) != 0) {
+            state.SkipWithError("Failed to make patch");
+            break;
+        }
+    }
+    BlocksDiff::SetScanWindowSize(0);
+    BlocksDiff::SetScanWorkers(scanWorkers);
+    state.counters["patch_size"] = static_cast<double>(patchSize);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(newImage.size()));
+}
+
+// Args: image type, image MiB, similarity percent
+BENCHMARK_DEFINE_F(PatchBenchmarkTest, TestImagePatch)(benchmark::State &state)
+{
+    const ImagePatchData *data = GetImagePatch(state.range(0), static_cast<size_t>(state.range(1)) * MIB,
+        static_cast<uint32_t>(state.range(2)));
+    if (data == nullptr) {
+        state.SkipWithError("Failed to make image patch");
+        return;
+    }
+    state.counters["patch_size"] = static_cast<double>(data->patch.size());
+    PatchParam param = {const_cast<uint8_t *>(data->oldImage.data()), data->oldImage.size(),
+        const_cast<uint8_t *>(data->patch.data()), data->patch.size(), nullptr};
+    std::vector<uint8_t> empty {};
+    size_t written = 0;
+    HeapTracker tracker;
+    for (auto _ : state) {
+        CountingWriter writer;
+        if (UpdateApplyPatch::ApplyImagePatch(param, &writer, empty) != 0) {
+            state.SkipWithError("Failed to apply image patch");
+            break;
+        }
+        written = writer.written_;
+    }
+    tracker.Report(state, written);
+}
+
+// Free physical memory of the host
+size_t GetAvailableMemory()
+{
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return pages > 0 && pageSize > 0 ? static_cast<size_t>(pages) * static_cast<size_t>(pageSize) : 0;
+}
+
+// Args: suffix sort, old image MiB. Old images of 2 GiB and more take 64 bit indexes as in BlocksDiff.
+BENCHMARK_DEFINE_F(PatchBenchmarkTest, TestSuffixSort)(benchmark::State &state)
+{
+    size_t length = static_cast<size_t>(state.range(1)) * MIB;
+    uint8_t sortType = static_cast<uint8_t>(state.range(0));
+    bool isWide = length >= static_cast<size_t>(INT32_MAX);
+    // Init is called directly, so the memory check of BlocksDiff::CreateSuffixArray is done here
+    size_t memorySize = length + (isWide ? SuffixArray<int64_t>::GetMemorySize(length, sortType) :
+        SuffixArray<int32_t>::GetMemorySize(length, sortType));
+    if (memorySize > GetAvailableMemory()) {
+        state.SkipWithError("Not enough memory for the suffix array");
+        return;
+    }
+    std::vector<uint8_t> image = MakeOldImage(length);
+    BlockBuffer oldInfo = {image.data(), image.size()};
+    HeapTracker tracker;
+    for (auto _ : state) {
+        std::unique_ptr<SuffixArrayBase> suffixArray = nullptr;
+        if (isWide) {
+            suffixArray = std::make_unique<SuffixArray<int64_t>>();
+        } else {
+            suffixArray = std::make_unique<SuffixArray<int32_t>>();
+        }
+        suffixArray->Init(oldInfo, sortType);
+        benchmark::DoNotOptimize(suffixArray.get());
+    }
+    tracker.Report(state, image.size());
+}
+
+enum DecodeType : int64_t {
+    DECODE_BZIP2 = 0,
+    DECODE_BZIP2_PIPELINE,
+    DECODE_LZ4,
+};
+
+bool CompressImage(int64_t type, const std::vector<uint8_t> &image, std::vector<uint8_t> &compressed)
+{
+    std::unique_ptr<DeflateAdapter> adapter {};
+    VectorWriter writer(compressed);
+    Lz4FileInfo info {};
+    if (type == DECODE_LZ4) {
+        info.fileInfo.packMethod = PKG_COMPRESS_METHOD_LZ4;
+        info.blockSizeID = LZ4_BLOCK_SIZE_ID;
+        adapter = std::make_unique<Lz4FrameAdapter>(&writer, 0, &info.fileInfo);
+    } else {
+        compressed.resize(IGMDIFF_LIMIT_UNIT);
+        adapter = std::make_unique<BZipBuffer2Adapter>(compressed, 0);
+    }
+    size_t size = 0;
+    if (adapter->Open() != 0 || adapter->WriteData({const_cast<uint8_t *>(image.data()), image.size()}) != 0 ||
+        adapter->FlushData(size) != 0) {
+        return false;
+    }
+    adapter->Close();
+    compressed.resize(type == DECODE_LZ4 ? compressed.size() : size);
+    return true;
+}
+
+// Args: decoder, image MiB
+BENCHMARK_DEFINE_F(PatchBenchmarkTest, TestSectionDecode)(benchmark::State &state)
+{
+    int64_t type = state.range(0);
+    std::vector<uint8_t> image = MakeOldImage(static_cast<size_t>(state.range(1)) * MIB);
+    std::vector<uint8_t> compressed {};
+    if (!CompressImage(type, image, compressed)) {
+        state.SkipWithError("Failed to compress image");
+        return;
+    }
+    state.counters["ratio"] = static_cast<double>(image.size()) / static_cast<double>(compressed.size());
+    BlockBuffer input = {compressed.data(), compressed.size()};
+    std::vector<uint8_t> output(image.size());
+    HeapTracker tracker;
+    for (auto _ : state) {
+        std::unique_ptr<BZip2ReadAdapter> reader {};
+        if (type == DECODE_LZ4) {
+            reader = std::make_unique<Lz4FrameReadAdapter>(0, input.length, input);
+        } else if (type == DECODE_BZIP2_PIPELINE) {
+            reader = std::make_unique<BZip2PipelineReadAdapter>(0, input.length, input, DECODE_QUEUE_LIMIT);
+        } else {
+            reader = std::make_unique<BZip2BufferReadAdapter>(0, input.length, input);
+        }
+        BlockBuffer data = {output.data(), output.size()};
+        if (reader->Open() != 0 || reader->ReadData(data) != 0) {
+            state.SkipWithError("Failed to decode");
+            break;
+        }
+        reader->Close();
+        benchmark::DoNotOptimize(output.data());
+    }
+    tracker.Report(state, image.size());
+}
+
+BENCHMARK_REGISTER_F(PatchBenchmarkTest, TestBlocksPatch)->
+    ArgsProduct({{1, 4, 16}, {50, 90, 99}, {PATCH_CODEC_BZIP2}})->
+    Args({4, 90, PATCH_CODEC_LZ4})->Args({4, 90, PATCH_CODEC_STORED})->
+    Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_REGISTER_F(PatchBenchmarkTest, TestBlocksDiff)->
+    Args({64, 0, 1})->ArgsProduct({{64}, {4, 16}, {1, 4, 16}})->
+    Iterations(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_REGISTER_F(PatchBenchmarkTest, TestImagePatch)->
+    ArgsProduct({{IMAGE_NORMAL, IMAGE_ZIP, IMAGE_LZ4, IMAGE_GZIP}, {1, 4}, {50, 90, 99}})->
+    Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_REGISTER_F(PatchBenchmarkTest, TestSuffixSort)->
+    ArgsProduct({{SUFFIX_SORT_QSUFSORT, SUFFIX_SORT_SAIS}, {256, 1024}})->
+    Iterations(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_REGISTER_F(PatchBenchmarkTest, TestSectionDecode)->
+    ArgsProduct({{DECODE_BZIP2, DECODE_BZIP2_PIPELINE, DECODE_LZ4}, {1, 4, 16}})->
+    Unit(benchmark::kMillisecond)->UseRealTime();
+} // namespace Updater
+
+// Run the benchmark
+BENCHMARK_MAIN();
@@ -15,8 +15,10 @@
 
 #include <benchmark/benchmark.h>
 #include <thread>
+#include <vector>
 #include "gtest/gtest.h"
 
+#include "byte_add.h"
 #include "ring_buffer.h"
 
 using namespace testing::ext;
@@ -25,6 +27,7 @@ namespace Updater {
 
 constexpr uint32_t RING_MAX_LEN = 1024;
 constexpr uint32_t BYTE_SIZE = 255;
+constexpr size_t ADD_BYTES_LEN = 1024 * 1024;
 
 class UpdaterBenchmarkTest : public benchmark::Fixture {
 public:
@@ -76,6 +79,58 @@ BENCHMARK_F(UpdaterBenchmarkTest, TestRingBuffer)(benchmark::State &state)
 BENCHMARK_REGISTER_F(UpdaterBenchmarkTest, TestRingBuffer)->
     Iterations(5)->Repetitions(3)->ReportAggregatesOnly();
 
+// The diff data restoration of bsdiff before AddBytes, with a bounds check on every byte
+void AddBytesChecked(std::vector<uint8_t> &newData, const std::vector<uint8_t> &oldData, int64_t oldOffset)
+{
+    for (int64_t i = 0; i < static_cast<int64_t>(newData.size()); i++) {
+        if (((oldOffset + i) >= 0) && (static_cast<size_t>(oldOffset + i) < oldData.size())) {
+            newData[i] += oldData[oldOffset + i];
+        }
+    }
+}
+
+template<typename Func>
+void RunAddBytes(benchmark::State &state, Func func)
+{
+    std::vector<uint8_t> newData(ADD_BYTES_LEN, 1);
+    std::vector<uint8_t> oldData(ADD_BYTES_LEN);
+    for (size_t i = 0; i < oldData.size(); i++) {
+        oldData[i] = static_cast<uint8_t>(i % BYTE_SIZE);
+    }
+    for (auto _ : state) {
+        func(newData, oldData);
+        benchmark::DoNotOptimize(newData.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(ADD_BYTES_LEN));
+}
+
+BENCHMARK_F(UpdaterBenchmarkTest, TestAddBytesChecked)(benchmark::State &state)
+{
+    RunAddBytes(state, [](std::vector<uint8_t> &newData, const std::vector<uint8_t> &oldData) {
+        AddBytesChecked(newData, oldData, 0);
+    });
+}
+
+BENCHMARK_F(UpdaterBenchmarkTest, TestAddBytesPortable)(benchmark::State &state)
+{
+    RunAddBytes(state, [](std::vector<uint8_t> &newData, const std::vector<uint8_t> &oldData) {
+        UpdatePatch::AddBytesPortable(newData.data(), oldData.data(), newData.size());
+    });
+}
+
+BENCHMARK_F(UpdaterBenchmarkTest, TestAddBytes)(benchmark::State &state)
+{
+    state.SetLabel(UpdatePatch::GetAddBytesKernel());
+    RunAddBytes(state, [](std::vector<uint8_t> &newData, const std::vector<uint8_t> &oldData) {
+        UpdatePatch::AddBytes(newData.data(), oldData.data(), newData.size());
+    });
+}
+
+BENCHMARK_REGISTER_F(UpdaterBenchmarkTest, TestAddBytesChecked)->Repetitions(3)->ReportAggregatesOnly();
+BENCHMARK_REGISTER_F(UpdaterBenchmarkTest, TestAddBytesPortable)->Repetitions(3)->ReportAggregatesOnly();
+BENCHMARK_REGISTER_F(UpdaterBenchmarkTest, TestAddBytes)->Repetitions(3)->ReportAggregatesOnly();
+
 } // namespace Updater
 
 // Run the benchmark
@@ -18,9 +18,12 @@
 #include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
+#include <unistd.h>
 #include <vector>
 #include "applypatch/block_set.h"
+#include "applypatch/block_writer.h"
 #include "applypatch/command.h"
+#include "applypatch/zero_engine.h"
 #include "log/log.h"
 
 using namespace testing::ext;
@@ -165,4 +168,140 @@ HWTEST_F(BlockSetUnitTest, blockset_test_006, TestSize.Level1)
     EXPECT_EQ(ret, 0);
     close(fd);
 }
+
+HWTEST_F(BlockSetUnitTest, blockset_test_007, TestSize.Level1)
+{
+    BlockSet first;
+    EXPECT_TRUE(first.ParserAndInsert("6,30,40,0,10,8,12"));
+    BlockSet second;
+    EXPECT_TRUE(second.ParserAndInsert("4,12,30,40,50"));
+    EXPECT_FALSE(first.IsOverlap(second));
+    EXPECT_FALSE(BlockSet::IsTwoBlocksOverlap(first, second));
+    EXPECT_TRUE(first.IsContain(11));
+    EXPECT_FALSE(first.IsContain(12));
+
+    BlockSet third;
+    EXPECT_TRUE(third.ParserAndInsert("4,5,9,35,45"));
+    EXPECT_TRUE(first.IsOverlap(third));
+    BlockSet common = first.Intersect(third);
+    EXPECT_EQ(common.CountOfRanges(), 2);
+    EXPECT_EQ(common.TotalBlockSize(), 9);
+    EXPECT_EQ(common[0], (BlockPair { 5, 9 }));
+    EXPECT_EQ(common[1], (BlockPair { 35, 40 }));
+    BlockSet rest = first.Subtract(third);
+    EXPECT_EQ(rest.CountOfRanges(), 3);
+    EXPECT_EQ(rest.TotalBlockSize(), 13);
+    EXPECT_EQ(rest[0], (BlockPair { 0, 5 }));
+    EXPECT_EQ(rest[1], (BlockPair { 9, 12 }));
+    EXPECT_EQ(rest[2], (BlockPair { 30, 35 }));
+    EXPECT_TRUE(first.IsContain(common));
+    EXPECT_TRUE(first.IsContain(rest));
+    EXPECT_FALSE(first.IsContain(third));
+    BlockSet all = first.Union(third);
+    EXPECT_EQ(all.CountOfRanges(), 2);
+    EXPECT_EQ(all.TotalBlockSize(), 27);
+    EXPECT_EQ(all[0], (BlockPair { 0, 12 }));
+    EXPECT_EQ(all[1], (BlockPair { 30, 45 }));
+    EXPECT_TRUE(all.IsContain(first));
+    EXPECT_TRUE(all.IsContain(third));
+}
+
+HWTEST_F(BlockSetUnitTest, blockset_test_008, TestSize.Level1)
+{
+    std::string filename = "/data/updater/updater/blocksetIoTest.bin";
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0);
+    BlockSet blk;
+    EXPECT_TRUE(blk.ParserAndInsert("6,2,4,4,5,10,12"));
+    std::vector<uint8_t> buffer(blk.TotalBlockSize() * H_BLOCK_SIZE);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = static_cast<uint8_t>(i / H_BLOCK_SIZE + 1);
+    }
+    EXPECT_EQ(blk.WriteDataToBlock(fd, buffer), buffer.size());
+    std::vector<uint8_t> readBuffer(buffer.size());
+    EXPECT_EQ(blk.ReadDataFromBlock(fd, readBuffer), readBuffer.size());
+    EXPECT_EQ(readBuffer, buffer);
+
+    BlockSet zeroBlk;
+    EXPECT_TRUE(zeroBlk.ParserAndInsert("2,3,11"));
+    EXPECT_EQ(zeroBlk.WriteZeroToBlock(fd, false), 0);
+    EXPECT_EQ(blk.ReadDataFromBlock(fd, readBuffer), readBuffer.size());
+    EXPECT_EQ(readBuffer[0], 1);
+    EXPECT_EQ(readBuffer[H_BLOCK_SIZE], 0);
+    EXPECT_EQ(readBuffer[4 * H_BLOCK_SIZE], 5);
+    close(fd);
+    unlink(filename.c_str());
+}
+
+HWTEST_F(BlockSetUnitTest, blockset_test_009, TestSize.Level1)
+{
+    std::string filename = "/data/updater/updater/blockWriterDigestTest.bin";
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0);
+    BlockSet blk;
+    EXPECT_TRUE(blk.ParserAndInsert("4,6,8,1,3"));
+    std::vector<uint8_t> buffer(blk.TotalBlockSize() * H_BLOCK_SIZE);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = static_cast<uint8_t>(i % 251);
+    }
+    BlockWriter writer(fd, blk);
+    writer.EnableDigest();
+    size_t half = buffer.size() / 2 + 1;
+    EXPECT_TRUE(writer.Write(buffer.data(), half, nullptr));
+    EXPECT_EQ(writer.GetDigest(), "");
+    EXPECT_TRUE(writer.Write(buffer.data() + half, buffer.size() - half, nullptr));
+    std::string digest = writer.GetDigest();
+    EXPECT_NE(digest, "");
+
+    std::vector<uint8_t> readBuffer(buffer.size());
+    EXPECT_EQ(blk.ReadDataFromBlock(fd, readBuffer), readBuffer.size());
+    EXPECT_EQ(blk.VerifySha256(readBuffer, blk.TotalBlockSize(), digest), 0);
+    close(fd);
+    unlink(filename.c_str());
+}
+
+HWTEST_F(BlockSetUnitTest, blockset_test_010, TestSize.Level1)
+{
+    std::string filename = "/data/updater/updater/zeroEngineTest.bin";
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0);
+    // more than one zero buffer, written in several calls on a regular file
+    const size_t blocks = ZeroEngine::ZERO_BUFFER_SIZE / H_BLOCK_SIZE * 2 + 3;
+    std::vector<uint8_t> buffer(blocks * H_BLOCK_SIZE, 0xFF);
+    ASSERT_EQ(write(fd, buffer.data(), buffer.size()), static_cast<ssize_t>(buffer.size()));
+    ZeroEngine engine(fd);
+    EXPECT_EQ(engine.Zero(1, blocks - 2), 0);
+    EXPECT_EQ(engine.Discard(0, blocks), 0);
+    std::vector<uint8_t> readBuffer(buffer.size());
+    ASSERT_EQ(pread(fd, readBuffer.data(), readBuffer.size(), 0), static_cast<ssize_t>(readBuffer.size()));
+    EXPECT_EQ(readBuffer[H_BLOCK_SIZE - 1], 0xFF);
+    EXPECT_EQ(readBuffer[H_BLOCK_SIZE], 0);
+    EXPECT_EQ(readBuffer[(blocks - 1) * H_BLOCK_SIZE - 1], 0);
+    EXPECT_EQ(readBuffer[(blocks - 1) * H_BLOCK_SIZE], 0xFF);
+
+    BlockSet blk;
+    EXPECT_TRUE(blk.ParserAndInsert("2,0,1"));
+    EXPECT_EQ(blk.WriteZeroToBlock(fd, false, &engine), 0);
+    ASSERT_EQ(pread(fd, readBuffer.data(), H_BLOCK_SIZE, 0), H_BLOCK_SIZE);
+    EXPECT_EQ(readBuffer[0], 0);
+    close(fd);
+    unlink(filename.c_str());
+}
+
+HWTEST_F(BlockSetUnitTest, blockset_test_011, TestSize.Level1)
+{
+    std::string filename = "/data/updater/updater/blocksetEmptyRangeTest.bin";
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0);
+    // empty ranges before, between and after the blocks are skipped
+    BlockSet blk;
+    EXPECT_TRUE(blk.ParserAndInsert("8,2,2,3,4,6,6,7,7"));
+    std::vector<uint8_t> buffer(blk.TotalBlockSize() * H_BLOCK_SIZE, 0x5A);
+    EXPECT_EQ(blk.WriteDataToBlock(fd, buffer), buffer.size());
+    std::vector<uint8_t> readBuffer(buffer.size());
+    EXPECT_EQ(blk.ReadDataFromBlock(fd, readBuffer), readBuffer.size());
+    EXPECT_EQ(readBuffer, buffer);
+    close(fd);
+    unlink(filename.c_str());
+}
 }
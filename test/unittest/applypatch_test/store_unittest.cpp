@@ -17,8 +17,10 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <sys/stat.h>
 #include <vector>
 #include "applypatch/block_set.h"
+#include "applypatch/stash_cache.h"
 #include "applypatch/store.h"
 #include "log/log.h"
 #include "utils.h"
@@ -71,4 +73,71 @@ HWTEST_F(StoreUnitTest, store_test_003, TestSize.Level1)
     Store::CreateNewSpace(storePath, true);
     EXPECT_EQ(Store::WriteDataToStore(storePath, filename1, buffer, -1), -1);
 }
+
+HWTEST_F(StoreUnitTest, store_test_004, TestSize.Level1)
+{
+    std::string storePath = "/data/updater/ut_test";
+    Store::CreateNewSpace(storePath, true);
+    StashCache cache(storePath, 2 * H_BLOCK_SIZE);
+    Command near(nullptr);
+    near.Init("move 0 2,0,1 1 - near:2,0,1");
+    Command far(nullptr);
+    far.Init("move 0 2,1,2 1 - far:2,0,1");
+    cache.AddUses(near, 1);
+    cache.AddUses(far, 2);
+    BlockSet src1;
+    src1.ParserAndInsert("2,10,11");
+    BlockSet src2;
+    src2.ParserAndInsert("2,20,21");
+    std::vector<uint8_t> buffer(H_BLOCK_SIZE, 1);
+    EXPECT_EQ(cache.Save("far", buffer, src1), 0);
+    EXPECT_EQ(cache.Save("near", buffer, src2), 0);
+    std::vector<uint8_t> data;
+    EXPECT_NE(Store::LoadDataFromStore(storePath, "far", data), 0);
+
+    // no more room, the stash used last goes to the store
+    EXPECT_EQ(cache.Save("last", buffer, src2), 0);
+    EXPECT_EQ(Store::LoadDataFromStore(storePath, "last", data), 0);
+    EXPECT_NE(Store::LoadDataFromStore(storePath, "near", data), 0);
+
+    // the source of a cached stash is about to be overwritten
+    BlockSet target;
+    target.ParserAndInsert("2,20,30");
+    EXPECT_EQ(cache.Persist(target), 0);
+    EXPECT_EQ(Store::LoadDataFromStore(storePath, "near", data), 0);
+    EXPECT_NE(Store::LoadDataFromStore(storePath, "far", data), 0);
+    EXPECT_EQ(cache.Load("far", data), 0);
+    EXPECT_EQ(data, buffer);
+
+    EXPECT_EQ(cache.Free("far"), 0);
+    EXPECT_EQ(cache.Free("near"), 0);
+    EXPECT_NE(Store::LoadDataFromStore(storePath, "near", data), 0);
+    EXPECT_NE(cache.Load("far", data), 0);
+    Store::DoFreeSpace(storePath);
+}
+
+HWTEST_F(StoreUnitTest, store_test_005, TestSize.Level1)
+{
+    std::string storePath1 = "/data/updater/ut_test1";
+    std::string storePath2 = "/data/updater/ut_test2";
+    std::string poolFile = "/data/updater/stash_pool/test_file1";
+    Store::CreateNewSpace(storePath1, true);
+    Store::CreateNewSpace(storePath2, true);
+    std::vector<uint8_t> buffer(4 * H_BLOCK_SIZE, 0);
+    buffer[H_BLOCK_SIZE] = 1;
+    EXPECT_EQ(Store::WriteStashToStore(storePath1, "test_file1", buffer, true), 0);
+    EXPECT_EQ(Store::WriteStashToStore(storePath2, "test_file1", buffer, true), 0);
+    struct stat fileStat {};
+    EXPECT_EQ(stat(poolFile.c_str(), &fileStat), 0);
+    EXPECT_EQ(fileStat.st_nlink, 3);
+    EXPECT_LT(fileStat.st_size, static_cast<off_t>(buffer.size()));
+
+    std::vector<uint8_t> data;
+    EXPECT_EQ(Store::LoadDataFromStore(storePath2, "test_file1", data), 0);
+    EXPECT_EQ(data, buffer);
+    EXPECT_EQ(Store::FreeStore(storePath1, "test_file1"), 0);
+    EXPECT_EQ(stat(poolFile.c_str(), &fileStat), 0);
+    Store::DoFreeSpace(storePath2);
+    EXPECT_NE(stat(poolFile.c_str(), &fileStat), 0);
+}
 }
@@ -14,11 +14,19 @@
  */
 
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <iostream>
 #include <string>
 #include "applypatch/transfer_manager.h"
+#include "applypatch/applied_bitmap.h"
+#include "applypatch/block_writer.h"
+#include "applypatch/checkpoint_journal.h"
+#include "applypatch/command_scheduler.h"
+#include "applypatch/patch_checkpoint_file.h"
+#include "applypatch/write_behind_queue.h"
 #include "log/log.h"
 
 using namespace testing::ext;
@@ -62,4 +70,285 @@ HWTEST_F(TransferManagerUnitTest, transfer_manager_test_002, TestSize.Level1)
     string cmd = tm->ReloadForRetry();
     EXPECT_STREQ(cmd.c_str(), "");
 }
+
+HWTEST_F(TransferManagerUnitTest, transfer_manager_test_003, TestSize.Level1)
+{
+    CommandNode first;
+    first.isBarrier = false;
+    first.tgtBlocks.ParserAndInsert("2,0,4");
+    first.srcBlocks.ParserAndInsert("2,10,14");
+    CommandNode second;
+    second.isBarrier = false;
+    second.tgtBlocks.ParserAndInsert("2,20,24");
+    second.srcBlocks.ParserAndInsert("2,30,34");
+    EXPECT_FALSE(CommandScheduler::IsConflict(first, second));
+    second.srcBlocks.ParserAndInsert("2,2,3");
+    EXPECT_TRUE(CommandScheduler::IsConflict(first, second));
+
+    CommandNode third;
+    third.isBarrier = false;
+    third.tgtBlocks.ParserAndInsert("2,40,44");
+    third.stashReads.push_back("abcd");
+    EXPECT_FALSE(CommandScheduler::IsConflict(first, third));
+    first.stashWrites.push_back("abcd");
+    EXPECT_TRUE(CommandScheduler::IsConflict(first, third));
+    third.isBarrier = true;
+    EXPECT_TRUE(CommandScheduler::IsConflict(second, third));
+}
+
+HWTEST_F(TransferManagerUnitTest, transfer_manager_test_004, TestSize.Level1)
+{
+    std::vector<std::string> lines = {
+        "zero 2,0,4", "zero 2,4,8", "zero 2,0,2", "free abcd", "zero 2,8,12", "zero 2,12,16"
+    };
+    std::vector<std::string> committed;
+    CommandScheduler scheduler(4, [](CommandNode &node) {
+            return node.cmd->GetArgumentByPos(1) == "2,8,12" ? FAILED : SUCCESS;
+        },
+        [&committed](CommandNode &node, CommandResult result) {
+            if (result != SUCCESS) {
+                return false;
+            }
+            committed.push_back(node.cmd->GetCommandLine());
+            return true;
+        });
+    for (const auto &line : lines) {
+        std::unique_ptr<Command> cmd = std::make_unique<Command>(nullptr);
+        cmd->Init(line);
+        scheduler.AddCommand(std::move(cmd));
+    }
+    EXPECT_FALSE(scheduler.Run());
+    std::vector<std::string> expected(lines.begin(), lines.begin() + 4);
+    EXPECT_EQ(committed, expected);
+}
+
+static CommandNode MakeNode(const std::string &cmdLine)
+{
+    CommandNode node;
+    node.cmd = std::make_unique<Command>(nullptr);
+    node.cmd->Init(cmdLine);
+    CommandScheduler::CollectResources(node);
+    return node;
+}
+
+HWTEST_F(TransferManagerUnitTest, transfer_manager_test_005, TestSize.Level1)
+{
+    const std::string path = "/data/updater/updater/transfer_journal_test";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0);
+    const std::string legacyCmd = "zero 2,0,1";
+    ASSERT_EQ(write(fd, legacyCmd.data(), legacyCmd.size()), static_cast<ssize_t>(legacyCmd.size()));
+    close(fd);
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), legacyCmd);
+
+    CheckpointJournal journal(path, 2, 1024);
+    EXPECT_TRUE(journal.Open(-1, true));
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), legacyCmd);
+    CommandNode first = MakeNode("zero 2,10,20");
+    EXPECT_TRUE(journal.Append(first));
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), legacyCmd);
+    // overwriting the blocks of an unsynced command forces a sync
+    CommandNode second = MakeNode("zero 2,15,16");
+    EXPECT_TRUE(journal.Barrier(second));
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), "zero 2,10,20");
+    EXPECT_TRUE(journal.Append(second));
+    CommandNode third = MakeNode("zero 2,30,40");
+    EXPECT_TRUE(journal.Barrier(third));
+    EXPECT_TRUE(journal.Append(third));
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), "zero 2,30,40");
+    journal.Close();
+
+    // a torn record at the tail is ignored
+    fd = open(path.c_str(), O_WRONLY | O_APPEND);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, "\xC7RNL", 4), 4);
+    close(fd);
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), "zero 2,30,40");
+    unlink(path.c_str());
+}
+
+HWTEST_F(TransferManagerUnitTest, transfer_manager_test_006, TestSize.Level1)
+{
+    std::string path = "/data/updater/updater/applied_bitmap_test";
+    unlink(path.c_str());
+    const size_t count = 1000;
+    {
+        AppliedBitmap bitmap(path, count);
+        EXPECT_FALSE(bitmap.Load());
+        EXPECT_FALSE(bitmap.IsUntouched(10));
+        EXPECT_TRUE(bitmap.Start(10));
+        bitmap.SetApplied(10);
+        EXPECT_TRUE(bitmap.Start(11));
+        bitmap.Snapshot();
+        // completed after the target blocks were synced, not applied yet
+        bitmap.SetApplied(11);
+        EXPECT_TRUE(bitmap.Persist());
+    }
+    AppliedBitmap resumed(path, count);
+    EXPECT_TRUE(resumed.Load());
+    EXPECT_TRUE(resumed.IsApplied(10));
+    EXPECT_FALSE(resumed.IsApplied(11));
+    EXPECT_FALSE(resumed.IsUntouched(11));
+    EXPECT_TRUE(resumed.IsUntouched(10 + AppliedBitmap::HORIZON_STEP));
+    EXPECT_TRUE(resumed.Start(10 + AppliedBitmap::HORIZON_STEP));
+    // the horizon of this attempt only counts for the next one
+    EXPECT_TRUE(resumed.IsUntouched(10 + AppliedBitmap::HORIZON_STEP));
+
+    AppliedBitmap other(path, count + 1);
+    EXPECT_FALSE(other.Load());
+    int fd = open(path.c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(pwrite(fd, "\xFF", 1, lseek(fd, 0, SEEK_END) - 1), 1);
+    close(fd);
+    AppliedBitmap corrupted(path, count);
+    EXPECT_FALSE(corrupted.Load());
+    unlink(path.c_str());
+}
+
+HWTEST_F(TransferManagerUnitTest, transfer_manager_test_007, TestSize.Level1)
+{
+    const std::string path = "/data/updater/updater/write_behind_test";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0);
+    const size_t blocks = 16;
+    {
+        // the limit lets a single block in flight
+        WriteBehindQueue queue(fd, H_BLOCK_SIZE);
+        ASSERT_TRUE(queue.Start());
+        for (size_t i = 0; i < blocks; i++) {
+            std::vector<uint8_t> data(H_BLOCK_SIZE, static_cast<uint8_t>(i + 1));
+            EXPECT_TRUE(queue.Submit(data.data(), data.size(), static_cast<off64_t>(i) * H_BLOCK_SIZE));
+        }
+        BlockSet last(std::vector<BlockPair> { { blocks - 1, blocks } });
+        EXPECT_TRUE(queue.Wait(last));
+        uint8_t value = 0;
+        EXPECT_EQ(pread(fd, &value, 1, static_cast<off64_t>(blocks - 1) * H_BLOCK_SIZE), 1);
+        EXPECT_EQ(value, blocks);
+
+        // the checkpoint syncs through the queue
+        CheckpointJournal journal(path + "_journal", 1, 1024);
+        EXPECT_TRUE(journal.Open(fd, false));
+        size_t syncs = 0;
+        journal.SetDataSync([&queue, &syncs] {
+            syncs++;
+            return queue.Flush();
+        });
+        CommandNode node = MakeNode("zero 2,0,16");
+        EXPECT_TRUE(journal.Append(node));
+        EXPECT_EQ(syncs, 1);
+        journal.SetDataSync([] { return false; });
+        CommandNode next = MakeNode("zero 2,16,17");
+        EXPECT_FALSE(journal.Append(next));
+        EXPECT_EQ(CheckpointJournal::LoadLastCommand(path + "_journal"), "zero 2,0,16");
+        journal.Close();
+        unlink((path + "_journal").c_str());
+    }
+    close(fd);
+
+    // a failed write fails every later call
+    fd = open(path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    WriteBehindQueue failed(fd, H_BLOCK_SIZE);
+    ASSERT_TRUE(failed.Start());
+    std::vector<uint8_t> data(H_BLOCK_SIZE, 0);
+    EXPECT_TRUE(failed.Submit(data.data(), data.size(), 0));
+    EXPECT_FALSE(failed.Drain());
+    EXPECT_FALSE(failed.Submit(data.data(), data.size(), 0));
+    EXPECT_FALSE(failed.Flush());
+    close(fd);
+    unlink(path.c_str());
+}
+
+HWTEST_F(TransferManagerUnitTest, transfer_manager_test_008, TestSize.Level1)
+{
+    const std::string path = "/data/updater/updater/patch_checkpoint_test";
+    unlink(path.c_str());
+    const std::string tgtHash(SHA256_DIGEST_LENGTH * 2, 'a');
+    UpdatePatch::PatchCheckpoint checkpoint {};
+    checkpoint.position = 3;
+    checkpoint.oldOffset = -5;
+    checkpoint.newOffset = H_BLOCK_SIZE + 10;
+    checkpoint.digest[0] = 0x5A;
+    PatchCheckpointFile file(path, tgtHash, 1000);
+    UpdatePatch::PatchCheckpoint loaded {};
+    EXPECT_FALSE(file.Load(loaded));
+    EXPECT_TRUE(file.Save(checkpoint));
+    EXPECT_TRUE(file.Load(loaded));
+    EXPECT_EQ(loaded.position, checkpoint.position);
+    EXPECT_EQ(loaded.oldOffset, checkpoint.oldOffset);
+    EXPECT_EQ(loaded.newOffset, checkpoint.newOffset);
+    EXPECT_EQ(loaded.digest[0], checkpoint.digest[0]);
+    // another patch or target does not resume at it
+    EXPECT_FALSE(PatchCheckpointFile(path, tgtHash, 1001).Load(loaded));
+    EXPECT_FALSE(PatchCheckpointFile(path, std::string(SHA256_DIGEST_LENGTH * 2, 'b'), 1000).Load(loaded));
+    file.Remove();
+    EXPECT_FALSE(file.Load(loaded));
+
+    // the written part of the target is skipped
+    const std::string target = "/data/updater/updater/patch_checkpoint_target";
+    int fd = open(target.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0);
+    BlockSet blocks(std::vector<BlockPair> { { 2, 3 }, { 0, 1 } });
+    BlockWriter writer(fd, blocks);
+    EXPECT_FALSE(writer.Skip(H_BLOCK_SIZE * 2 + 1));
+    EXPECT_TRUE(writer.Skip(H_BLOCK_SIZE + 10));
+    std::vector<uint8_t> data(H_BLOCK_SIZE - 10, 0x11);
+    EXPECT_TRUE(writer.Write(data.data(), data.size(), nullptr));
+    EXPECT_TRUE(writer.IsWriteDone());
+    uint8_t value = 0;
+    EXPECT_EQ(pread(fd, &value, 1, 10), 1);
+    EXPECT_EQ(value, 0x11);
+    EXPECT_EQ(pread(fd, &value, 1, H_BLOCK_SIZE * 2), 0);
+    close(fd);
+    unlink(target.c_str());
+}
+
+HWTEST_F(TransferManagerUnitTest, transfer_manager_test_009, TestSize.Level1)
+{
+    const std::string path = "/data/updater/updater/transfer_journal_sync_test";
+    CheckpointJournal journal(path, 1000, 1024);
+    EXPECT_TRUE(journal.Open(-1, false));
+    CommandNode first = MakeNode("zero 2,10,20");
+    EXPECT_TRUE(journal.Append(first));
+    // a command overwriting unsynced blocks is not run when the sync fails
+    journal.SetDataSync([] { return false; });
+    CommandNode second = MakeNode("zero 2,19,21");
+    EXPECT_FALSE(journal.Barrier(second));
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), "");
+    journal.SetDataSync(nullptr);
+    EXPECT_TRUE(journal.Barrier(second));
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), "zero 2,10,20");
+    journal.Close();
+    unlink(path.c_str());
+}
+
+HWTEST_F(TransferManagerUnitTest, transfer_manager_test_010, TestSize.Level1)
+{
+    const std::string path = "/data/updater/updater/transfer_journal_compact_test";
+    CheckpointJournal journal(path, 1, 1024);
+    EXPECT_TRUE(journal.Open(-1, false));
+    const size_t count = 5000;
+    std::string cmdLine = "";
+    for (size_t i = 0; i < count; i++) {
+        cmdLine = "zero 2," + std::to_string(i) + "," + std::to_string(i + 1);
+        CommandNode node = MakeNode(cmdLine);
+        EXPECT_TRUE(journal.Append(node));
+    }
+    journal.Close();
+    // the journal is rewritten to its last record once it is large
+    struct stat st {};
+    ASSERT_EQ(stat(path.c_str(), &st), 0);
+    EXPECT_LT(st.st_size, static_cast<off_t>(count * cmdLine.size()));
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), cmdLine);
+
+    // a retry appends to the compacted journal
+    CheckpointJournal resumed(path, 1, 1024);
+    EXPECT_TRUE(resumed.Open(-1, true));
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), cmdLine);
+    CommandNode next = MakeNode("zero 2,9000,9001");
+    EXPECT_TRUE(resumed.Append(next));
+    resumed.Close();
+    EXPECT_EQ(CheckpointJournal::LoadLastCommand(path), "zero 2,9000,9001");
+    unlink(path.c_str());
+}
 } // updater_ut
@@ -177,6 +177,54 @@ public:
         return 0;
     }
 
+    int BZip2AdapterPipelineTest() const
+    {
+        MemMapInfo data {};
+        std::string fileName = TEST_PATH_FROM;
+        fileName += "test_script.us";
+        int32_t ret = PatchMapFile(fileName, data);
+        EXPECT_EQ(0, ret);
+
+        std::vector<uint8_t> compressedData;
+        BZipBuffer2Adapter adapter(compressedData, 0);
+        adapter.Open();
+        BlockBuffer srcData = {data.memory, data.length};
+        for (int i = 0; i < 3; i++) { // compress data 3 times
+            ret = adapter.WriteData(srcData);
+            EXPECT_EQ(0, ret);
+        }
+        size_t compressedSize = 0;
+        ret = adapter.FlushData(compressedSize);
+        EXPECT_EQ(0, ret);
+        adapter.Close();
+
+        // a small queue limit keeps the decoder waiting for the reader
+        BlockBuffer compressedInfo = {compressedData.data(), compressedData.size()};
+        BZip2PipelineReadAdapter readAdapter(0, compressedSize, compressedInfo, 1);
+        EXPECT_EQ(0, readAdapter.Open());
+        std::vector<uint8_t> dataArray(data.length);
+        BlockBuffer data1 = {dataArray.data(), data.length};
+        for (int i = 0; i < 3; i++) {
+            ret = readAdapter.ReadData(data1);
+            EXPECT_EQ(0, ret);
+            EXPECT_EQ(0, memcmp(data1.buffer, data.memory, data1.length));
+        }
+        // nothing left after the end of stream
+        EXPECT_NE(0, readAdapter.ReadData(data1));
+        readAdapter.Close();
+
+        // a truncated stream fails only where the reader gets to it
+        BZip2PipelineReadAdapter truncAdapter(0, compressedSize / 2, compressedInfo, 1);
+        EXPECT_EQ(0, truncAdapter.Open());
+        int32_t failed = 0;
+        for (int i = 0; i < 3; i++) {
+            failed += (truncAdapter.ReadData(data1) != 0) ? 1 : 0;
+        }
+        EXPECT_NE(0, failed);
+        truncAdapter.Close();
+        return 0;
+    }
+
     int32_t CompressData(Hpackage::PkgManager::FileInfoPtr info,
         const BlockBuffer &buffer, std::vector<uint8_t> &outData, size_t &bufferSize)
     {
@@ -279,6 +327,12 @@ HWTEST_F(BZip2AdapterUnitTest, BZip2AdapterAddMoreTest, TestSize.Level1)
     EXPECT_EQ(0, test.BZip2AdapterAddMoreTest());
 }
 
+HWTEST_F(BZip2AdapterUnitTest, BZip2AdapterPipelineTest, TestSize.Level1)
+{
+    BZip2AdapterUnitTest test;
+    EXPECT_EQ(0, test.BZip2AdapterPipelineTest());
+}
+
 HWTEST_F(BZip2AdapterUnitTest, DeflateAdapterTestForZip, TestSize.Level1)
 {
     ZipFileInfo zipInfo {};
@@ -14,7 +14,14 @@
  */
 
 #include <gtest/gtest.h>
+#include <thread>
 #include "applypatch/data_writer.h"
+#include "blocks_diff.h"
+#include "blocks_patch.h"
+#include "byte_add.h"
+#include "image_diff.h"
+#include "image_patch.h"
+#include "paged_image_source.h"
 #include "unittest_comm.h"
 #include "update_diff.h"
 #include "update_patch.h"
@@ -139,6 +146,105 @@ public:
         return 0;
     }
 
+    int ImgageDiffPatchPagedTest(size_t cacheSize, const std::string &oldFile,
+        const std::string &newFile, const std::string &patchFile, const std::string &restoreFile) const
+    {
+        int32_t ret = UpdatePatch::UpdateDiff::DiffImage(0, TEST_PATH_FROM + oldFile,
+            TEST_PATH_FROM + newFile, TEST_PATH_FROM + patchFile);
+        EXPECT_EQ(0, ret);
+        UpdatePatch::MemMapInfo patchData {};
+        if (PatchMapFile(TEST_PATH_FROM + patchFile, patchData) != 0) {
+            return -1;
+        }
+        UpdatePatch::PagedImageSource source(TEST_PATH_FROM + oldFile, cacheSize);
+        if (source.Open() != 0) {
+            return -1;
+        }
+        UpdatePatch::FilePatchWriter writer(TEST_PATH_FROM + restoreFile);
+        writer.Init();
+        std::vector<uint8_t> empty;
+        std::string expected = GeneraterHash(TEST_PATH_FROM + newFile);
+        UpdatePatch::PatchParam param = { nullptr, source.GetSize(), patchData.memory, patchData.length, &source };
+        ret = UpdatePatch::UpdateApplyPatch::ApplyImagePatch(param, empty,
+            [&](size_t start, const UpdatePatch::BlockBuffer &data, size_t size) -> int {
+                return writer.Write(start, data, size);
+            }, expected);
+        EXPECT_EQ(0, ret);
+        writer.Finish();
+        std::string restoreHash = GeneraterHash(TEST_PATH_FROM + restoreFile);
+        EXPECT_EQ(0, restoreHash.compare(expected));
+        return 0;
+    }
+
+    int32_t ApplyWithCheckpoint(bool isImage, const UpdatePatch::MemMapInfo &patchData,
+        const UpdatePatch::MemMapInfo &oldData, const UpdatePatch::PatchCheckpointParam &checkpoint,
+        std::vector<uint8_t> &output) const
+    {
+        auto writer = [&](size_t start, const UpdatePatch::BlockBuffer &data, size_t size) -> int {
+            output.insert(output.end(), data.buffer, data.buffer + size);
+            return 0;
+        };
+        std::vector<uint8_t> empty;
+        if (isImage) {
+            UpdatePatch::PatchParam param = { oldData.memory, oldData.length, patchData.memory, patchData.length,
+                nullptr };
+            return UpdatePatch::UpdateApplyPatch::ApplyImagePatch(param, empty, writer, expected_, checkpoint);
+        }
+        UpdatePatch::PatchBuffer patchInfo = {patchData.memory, 0, patchData.length};
+        return UpdatePatch::UpdateApplyPatch::ApplyBlockPatch(patchInfo, {oldData.memory, oldData.length},
+            writer, expected_, checkpoint);
+    }
+
+    int PatchCheckpointTest(bool isImage, size_t interval, const std::string &oldFile,
+        const std::string &newFile, const std::string &patchFile)
+    {
+        int32_t ret = isImage ? UpdatePatch::UpdateDiff::DiffImage(0, TEST_PATH_FROM + oldFile,
+            TEST_PATH_FROM + newFile, TEST_PATH_FROM + patchFile) :
+            UpdatePatch::UpdateDiff::DiffBlock(TEST_PATH_FROM + oldFile,
+            TEST_PATH_FROM + newFile, TEST_PATH_FROM + patchFile);
+        EXPECT_EQ(0, ret);
+        UpdatePatch::MemMapInfo patchData {};
+        UpdatePatch::MemMapInfo oldData {};
+        UpdatePatch::MemMapInfo newData {};
+        if (PatchMapFile(TEST_PATH_FROM + patchFile, patchData) != 0 ||
+            PatchMapFile(TEST_PATH_FROM + oldFile, oldData) != 0 ||
+            PatchMapFile(TEST_PATH_FROM + newFile, newData) != 0) {
+            return -1;
+        }
+        expected_ = UpdatePatch::GeneraterBufferHash({newData.memory, newData.length});
+        std::vector<uint8_t> output;
+        std::vector<UpdatePatch::PatchCheckpoint> checkpoints;
+        UpdatePatch::PatchCheckpointParam checkpoint {};
+        checkpoint.interval = interval;
+        checkpoint.save = [&](const UpdatePatch::PatchCheckpoint &point) -> int32_t {
+            EXPECT_EQ(point.newOffset, output.size());
+            checkpoints.push_back(point);
+            return 0;
+        };
+        EXPECT_EQ(0, ApplyWithCheckpoint(isImage, patchData, oldData, checkpoint, output));
+        EXPECT_GT(checkpoints.size(), 0U);
+        checkpoint.save = [](const UpdatePatch::PatchCheckpoint &point) -> int32_t {
+            return 0;
+        };
+
+        // resume from every checkpoint with the output before it already written
+        for (const auto &point : checkpoints) {
+            std::vector<uint8_t> written(newData.memory, newData.memory + point.newOffset);
+            std::vector<uint8_t> resumed = written;
+            checkpoint.resume = &point;
+            checkpoint.written = {written.data(), written.size()};
+            EXPECT_EQ(0, ApplyWithCheckpoint(isImage, patchData, oldData, checkpoint, resumed));
+            EXPECT_TRUE(resumed == output);
+
+            // the written output has to match the checkpoint
+            written[written.size() / 2] ^= 1;
+            resumed.clear();
+            EXPECT_NE(0, ApplyWithCheckpoint(isImage, patchData, oldData, checkpoint, resumed));
+            EXPECT_TRUE(resumed.empty());
+        }
+        return 0;
+    }
+
     int32_t TestApplyBlockPatch(const std::string &patchName,
         const std::string &oldName, const std::string &newName, bool isBuffer) const
     {
@@ -205,6 +311,9 @@ public:
         EXPECT_EQ(0, memcmp(expected.c_str(), restoreHash.c_str(), restoreHash.size()));
         return 0;
     }
+
+private:
+    std::string expected_ {};
 };
 
 HWTEST_F(DiffPatchUnitTest, BlockDiffPatchTest, TestSize.Level1)
@@ -217,6 +326,174 @@ HWTEST_F(DiffPatchUnitTest, BlockDiffPatchTest, TestSize.Level1)
         "../diffpatch/patchtest.new_1"));
 }
 
+HWTEST_F(DiffPatchUnitTest, BlockPatchControlStatsTest, TestSize.Level1)
+{
+    UpdatePatch::BlocksPatch::ResetControlStats();
+    DiffPatchUnitTest test;
+    EXPECT_EQ(0, test.BlockDiffPatchTest(
+        "../diffpatch/patchtest.old",
+        "../diffpatch/patchtest.new",
+        "../diffpatch/patchtest.patch",
+        "../diffpatch/patchtest.new_1"));
+    UpdatePatch::ControlStats stats = UpdatePatch::BlocksPatch::GetControlStats();
+    PATCH_LOGI("Control tuples %zu decoded in %llu us", stats.tupleCount,
+        static_cast<unsigned long long>(stats.decodeTime));
+    EXPECT_GT(stats.tupleCount, 0U);
+}
+
+HWTEST_F(DiffPatchUnitTest, BlockDiffPatchLz4SectionTest, TestSize.Level1)
+{
+    UpdatePatch::BlocksDiff::SetSectionCodec(PATCH_CODEC_LZ4);
+    DiffPatchUnitTest test;
+    EXPECT_EQ(0, test.BlockDiffPatchTest(
+        "../diffpatch/patchtest.old",
+        "../diffpatch/patchtest.new",
+        "../diffpatch/patchtest.lz4_patch",
+        "../diffpatch/patchtest.new_lz4"));
+    UpdatePatch::BlocksDiff::SetSectionCodec(PATCH_CODEC_BZIP2);
+}
+
+HWTEST_F(DiffPatchUnitTest, BlockDiffPatchStoredSectionTest, TestSize.Level1)
+{
+    UpdatePatch::BlocksDiff::SetSectionCodec(PATCH_CODEC_STORED);
+    DiffPatchUnitTest test;
+    EXPECT_EQ(0, test.BlockDiffPatchTest(
+        "../diffpatch/patchtest.old",
+        "../diffpatch/patchtest.new",
+        "../diffpatch/patchtest.stored_patch",
+        "../diffpatch/patchtest.new_stored"));
+    UpdatePatch::BlocksDiff::SetSectionCodec(PATCH_CODEC_BZIP2);
+}
+
+HWTEST_F(DiffPatchUnitTest, BlockDiffPatchWindowTest, TestSize.Level1)
+{
+    size_t workers = UpdatePatch::BlocksPatch::GetWindowWorkers();
+    UpdatePatch::BlocksDiff::SetWindowSize(1024);
+    DiffPatchUnitTest test;
+    for (size_t count : { 1, 4 }) {
+        UpdatePatch::BlocksPatch::SetWindowWorkers(count);
+        EXPECT_EQ(0, test.BlockDiffPatchTest2(
+            "../diffpatch/patchtest.old",
+            "../diffpatch/patchtest.new",
+            "../diffpatch/patchtest.window_patch",
+            "../diffpatch/patchtest.new_window", true));
+        EXPECT_EQ(0, test.BlockDiffPatchTest2(
+            "../diffpatch/patchtest.old",
+            "../diffpatch/patchtest.new",
+            "../diffpatch/patchtest.window_patch",
+            "../diffpatch/patchtest.new_window", false));
+    }
+    UpdatePatch::MemMapInfo patchData {};
+    EXPECT_EQ(0, PatchMapFile(TEST_PATH_FROM + "../diffpatch/patchtest.window_patch", patchData));
+    EXPECT_EQ(0, memcmp(patchData.memory, UpdatePatch::BSDIFF_WINDOW_MAGIC,
+        std::char_traits<char>::length(UpdatePatch::BSDIFF_WINDOW_MAGIC)));
+    // 按页读取老镜像时窗口逐个原地恢复
+    EXPECT_EQ(0, test.ImgageDiffPatchPagedTest(0,
+        "../diffpatch/patchtest.old",
+        "../diffpatch/patchtest.new",
+        "../diffpatch/patchtest.window_img_patch",
+        "../diffpatch/patchtest.new_window_paged"));
+    UpdatePatch::BlocksDiff::SetWindowSize(0);
+    UpdatePatch::BlocksPatch::SetWindowWorkers(workers);
+}
+
+HWTEST_F(DiffPatchUnitTest, BlockDiffSuffixSortTest, TestSize.Level1)
+{
+    DiffPatchUnitTest test;
+    UpdatePatch::BlocksDiff::SetSuffixSort(SUFFIX_SORT_QSUFSORT);
+    EXPECT_EQ(0, test.BlockDiffPatchTest(
+        "../diffpatch/patchtest.old",
+        "../diffpatch/patchtest.new",
+        "../diffpatch/patchtest.qsufsort_patch",
+        "../diffpatch/patchtest.new_qsufsort"));
+    UpdatePatch::BlocksDiff::SetSuffixSort(SUFFIX_SORT_SAIS);
+    EXPECT_EQ(0, test.BlockDiffPatchTest(
+        "../diffpatch/patchtest.old",
+        "../diffpatch/patchtest.new",
+        "../diffpatch/patchtest.sais_patch",
+        "../diffpatch/patchtest.new_sais"));
+    EXPECT_EQ(test.GeneraterHash(TEST_PATH_FROM + "../diffpatch/patchtest.qsufsort_patch"),
+        test.GeneraterHash(TEST_PATH_FROM + "../diffpatch/patchtest.sais_patch"));
+
+    // 重复数据下两种后缀排序生成的补丁也相同
+    std::vector<uint8_t> oldData(64 * 1024);
+    for (size_t i = 0; i < oldData.size(); i++) {
+        oldData[i] = static_cast<uint8_t>("abracadabra"[i % 11] + (i % 4093 == 0 ? 1 : 0));
+    }
+    std::vector<uint8_t> newData(oldData.begin() + 100, oldData.end());
+    newData.insert(newData.end(), oldData.begin(), oldData.begin() + 1000);
+    std::vector<uint8_t> patches[2];
+    uint8_t sortTypes[] = { SUFFIX_SORT_QSUFSORT, SUFFIX_SORT_SAIS };
+    for (size_t i = 0; i < sizeof(sortTypes); i++) {
+        UpdatePatch::BlocksDiff::SetSuffixSort(sortTypes[i]);
+        size_t patchSize = 0;
+        EXPECT_EQ(0, UpdatePatch::BlocksDiff::MakePatch({newData.data(), newData.size()},
+            {oldData.data(), oldData.size()}, patches[i], 0, patchSize));
+    }
+    EXPECT_EQ(patches[0], patches[1]);
+    UpdatePatch::BlocksDiff::SetSuffixSort(SUFFIX_SORT_SAIS);
+}
+
+HWTEST_F(DiffPatchUnitTest, BlockDiffSuffixArray64Test, TestSize.Level1)
+{
+    UpdatePatch::MemMapInfo oldData {};
+    UpdatePatch::MemMapInfo newData {};
+    EXPECT_EQ(0, PatchMapFile(TEST_PATH_FROM + "../diffpatch/patchtest.old", oldData));
+    EXPECT_EQ(0, PatchMapFile(TEST_PATH_FROM + "../diffpatch/patchtest.new", newData));
+    UpdatePatch::BlockBuffer oldInfo = {oldData.memory, oldData.length};
+    for (uint8_t sortType : { SUFFIX_SORT_QSUFSORT, SUFFIX_SORT_SAIS }) {
+        UpdatePatch::SuffixArray<int32_t> suffixArray;
+        UpdatePatch::SuffixArray<int64_t> suffixArray64;
+        suffixArray.Init(oldInfo, sortType);
+        suffixArray64.Init(oldInfo, sortType);
+        for (size_t offset = 0; offset < newData.length; offset += 7) {
+            UpdatePatch::BlockBuffer newInfo = {newData.memory + offset, newData.length - offset};
+            int64_t pos = 0;
+            int64_t pos64 = 0;
+            int64_t length = oldInfo.length;
+            EXPECT_EQ(suffixArray.Search(newInfo, oldInfo, 0, length, pos),
+                suffixArray64.Search(newInfo, oldInfo, 0, length, pos64));
+            EXPECT_EQ(pos, pos64);
+        }
+    }
+
+    // 后缀数组超出内存上限时直接失败
+    UpdatePatch::BlocksDiff::SetMemoryLimit(1);
+    std::vector<uint8_t> patchData;
+    size_t patchSize = 0;
+    EXPECT_EQ(UpdatePatch::PATCH_EXCEED_LIMIT, UpdatePatch::BlocksDiff::MakePatch({newData.memory, newData.length},
+        oldInfo, patchData, 0, patchSize));
+    UpdatePatch::BlocksDiff::SetMemoryLimit(0);
+    EXPECT_EQ(0, UpdatePatch::BlocksDiff::MakePatch({newData.memory, newData.length},
+        oldInfo, patchData, 0, patchSize));
+}
+
+HWTEST_F(DiffPatchUnitTest, BlockDiffScanWindowTest, TestSize.Level1)
+{
+    UpdatePatch::BlocksDiff::SetScanWindowSize(1024);
+    DiffPatchUnitTest test;
+    std::string hashes[2];
+    size_t workers[] = { 1, 4 };
+    for (size_t i = 0; i < sizeof(workers) / sizeof(workers[0]); i++) {
+        UpdatePatch::BlocksDiff::SetScanWorkers(workers[i]);
+        EXPECT_EQ(0, test.BlockDiffPatchTest2(
+            "../diffpatch/patchtest.old",
+            "../diffpatch/patchtest.new",
+            "../diffpatch/patchtest.scan_patch",
+            "../diffpatch/patchtest.new_scan", true));
+        EXPECT_EQ(0, test.BlockDiffPatchTest(
+            "../diffpatch/patchtest.old",
+            "../diffpatch/patchtest.new",
+            "../diffpatch/patchtest.scan_patch",
+            "../diffpatch/patchtest.new_scan"));
+        hashes[i] = test.GeneraterHash(TEST_PATH_FROM + "../diffpatch/patchtest.scan_patch");
+    }
+    // 补丁与并发数无关
+    EXPECT_EQ(hashes[0], hashes[1]);
+    UpdatePatch::BlocksDiff::SetScanWindowSize(0);
+    UpdatePatch::BlocksDiff::SetScanWorkers(std::thread::hardware_concurrency());
+}
+
 HWTEST_F(DiffPatchUnitTest, ImgageDiffPatchFileTest, TestSize.Level1)
 {
     DiffPatchUnitTest test;
@@ -342,6 +619,112 @@ HWTEST_F(DiffPatchUnitTest, ImgageDiffPatchZipFile_4, TestSize.Level1)
         "../diffpatch/ImgageDiffPatchZipFile_4_zip_new.zip"));
 }
 
+// 多线程重新压缩，输出与串行一致
+HWTEST_F(DiffPatchUnitTest, ImgageDiffPatchRecompressWorkersTest, TestSize.Level1)
+{
+    DiffPatchUnitTest test;
+    size_t workers = UpdatePatch::CompressedImagePatch::GetRecompressWorkers();
+    for (size_t count : { 1, 2, 4 }) {
+        UpdatePatch::CompressedImagePatch::SetRecompressWorkers(count);
+        EXPECT_EQ(0, test.ImgageDiffPatchFileTest2(0,
+            "../diffpatch/ImgageDiffPatchZipFile_4_old.zip",
+            "../diffpatch/ImgageDiffPatchZipFile_4_new.zip",
+            "../diffpatch/ImgageDiffPatchZipFile_4_zip.img_patch",
+            "../diffpatch/ImgageDiffPatchZipFile_4_zip_new.zip"));
+        EXPECT_EQ(0, test.ImgageDiffPatchFileTest2(0,
+            "../diffpatch/ImgageDiffPatchLz4File_3_old.lz4",
+            "../diffpatch/ImgageDiffPatchLz4File_3_new.lz4",
+            "../diffpatch/ImgageDiffPatchLz4File_3_lz4.img_patch",
+            "../diffpatch/ImgageDiffPatchLz4File_3_lz4_new.lz"));
+    }
+    UpdatePatch::CompressedImagePatch::SetRecompressWorkers(workers);
+}
+
+// 多线程探测压缩级别，补丁与串行一致
+HWTEST_F(DiffPatchUnitTest, ImgageDiffPatchProbeWorkersTest, TestSize.Level1)
+{
+    DiffPatchUnitTest test;
+    size_t workers = UpdatePatch::ZipImageDiff::GetProbeWorkers();
+    std::string expected = "";
+    for (size_t count : { 1, 2, 4 }) {
+        UpdatePatch::ZipImageDiff::SetProbeWorkers(count);
+        EXPECT_EQ(0, test.ImgageDiffPatchFileTest2(0,
+            "../diffpatch/ImgageDiffPatchZipFile_3_old.zip",
+            "../diffpatch/ImgageDiffPatchZipFile_3_new.zip",
+            "../diffpatch/ImgageDiffPatchZipFile_3_zip.img_patch",
+            "../diffpatch/ImgageDiffPatchZipFile_3_zip_new.zip"));
+        std::string patchHash =
+            test.GeneraterHash(TEST_PATH_FROM + "../diffpatch/ImgageDiffPatchZipFile_3_zip.img_patch");
+        if (expected.empty()) {
+            expected = patchHash;
+        }
+        EXPECT_EQ(expected, patchHash);
+    }
+    UpdatePatch::ZipImageDiff::SetProbeWorkers(workers);
+}
+
+// 多线程生成分块补丁，补丁与串行一致
+HWTEST_F(DiffPatchUnitTest, ImgageDiffPatchDiffWorkersTest, TestSize.Level1)
+{
+    DiffPatchUnitTest test;
+    size_t workers = UpdatePatch::ImageDiff::GetDiffWorkers();
+    // 按400K切分，补丁在内存中拼接；按1.2M切分，分块大于1M，补丁经由bspatch临时文件串行生成
+    for (size_t limit : { 40, 120 }) {
+        std::string expected = "";
+        for (size_t count : { 1, 2, 4 }) {
+            UpdatePatch::ImageDiff::SetDiffWorkers(count);
+            EXPECT_EQ(0, test.ImgageDiffPatchFileTest2(limit,
+                "../diffpatch/ImgageDiffPatchLz4File_3_old.lz4",
+                "../diffpatch/ImgageDiffPatchLz4File_3_new.lz4",
+                "../diffpatch/ImgageDiffPatchLz4File_3_workers.img_patch",
+                "../diffpatch/ImgageDiffPatchLz4File_3_workers_new.lz4"));
+            std::string patchHash =
+                test.GeneraterHash(TEST_PATH_FROM + "../diffpatch/ImgageDiffPatchLz4File_3_workers.img_patch");
+            if (expected.empty()) {
+                expected = patchHash;
+            }
+            EXPECT_EQ(expected, patchHash);
+        }
+    }
+    UpdatePatch::ImageDiff::SetDiffWorkers(workers);
+}
+
+// 按页读取老镜像，缓存小于镜像
+HWTEST_F(DiffPatchUnitTest, ImgageDiffPatchPagedSourceTest, TestSize.Level1)
+{
+    DiffPatchUnitTest test;
+    for (size_t cacheSize : { 0, 1024 * 1024 }) {
+        EXPECT_EQ(0, test.ImgageDiffPatchPagedTest(cacheSize,
+            "../diffpatch/patchtest.old",
+            "../diffpatch/patchtest.new",
+            "../diffpatch/patchtest.img_patch",
+            "../diffpatch/patchtest.new_paged"));
+        EXPECT_EQ(0, test.ImgageDiffPatchPagedTest(cacheSize,
+            "../diffpatch/ImgageDiffPatchZipFile_4_old.zip",
+            "../diffpatch/ImgageDiffPatchZipFile_4_new.zip",
+            "../diffpatch/ImgageDiffPatchZipFile_4_zip.img_patch",
+            "../diffpatch/ImgageDiffPatchZipFile_4_zip_new.zip"));
+    }
+}
+
+HWTEST_F(DiffPatchUnitTest, BlockPatchCheckpointTest, TestSize.Level1)
+{
+    DiffPatchUnitTest test;
+    EXPECT_EQ(0, test.PatchCheckpointTest(false, 256,
+        "../diffpatch/patchtest.old",
+        "../diffpatch/patchtest.new",
+        "../diffpatch/patchtest.checkpoint_patch"));
+}
+
+HWTEST_F(DiffPatchUnitTest, ImgagePatchCheckpointTest, TestSize.Level1)
+{
+    DiffPatchUnitTest test;
+    EXPECT_EQ(0, test.PatchCheckpointTest(true, 1,
+        "../diffpatch/ImgageDiffPatchZipFile_4_old.zip",
+        "../diffpatch/ImgageDiffPatchZipFile_4_new.zip",
+        "../diffpatch/ImgageDiffPatchZipFile_4_zip.img_patch"));
+}
+
 HWTEST_F(DiffPatchUnitTest, ImgageDiffPatchGzFile2, TestSize.Level1)
 {
     DiffPatchUnitTest test;
@@ -419,10 +802,53 @@ HWTEST_F(DiffPatchUnitTest, BlockDiffPatchTest_2, TestSize.Level1)
     EXPECT_EQ(0, UpdatePatch::WriteDataToFile("BlockDiffPatchTest_2.txt", testDate, testDate.size()));
 }
 
+// 补丁位于缓冲区中间时，段长度超出补丁末尾应报错
+HWTEST_F(DiffPatchUnitTest, BlockPatchCorruptHeaderTest, TestSize.Level1)
+{
+    const size_t prefix = 64;
+    const int64_t sectionSize = 40;
+    std::vector<uint8_t> buffer(prefix, 0);
+    const std::string magic = "BSDIFF40";
+    buffer.insert(buffer.end(), magic.begin(), magic.end());
+    for (int64_t value : { sectionSize, sectionSize, static_cast<int64_t>(0) }) {
+        for (size_t i = 0; i < sizeof(value); i++) {
+            buffer.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8)));
+        }
+    }
+    buffer.resize(buffer.size() + sectionSize, 0);
+    UpdatePatch::PatchBuffer patchInfo = {buffer.data(), prefix, buffer.size()};
+    std::vector<uint8_t> oldData(sectionSize, 0);
+    UpdatePatch::BlockBuffer oldInfo = {oldData.data(), oldData.size()};
+    std::vector<uint8_t> newData;
+    EXPECT_NE(0, UpdatePatch::UpdateApplyPatch::ApplyBlockPatch(patchInfo, oldInfo, newData));
+}
+
 HWTEST_F(DiffPatchUnitTest, PatchMapFileTest, TestSize.Level1)
 {
     UpdatePatch::MemMapInfo data{};
     string filePath = TEST_PATH_FROM + "diffpatch/non_exist.file";
     EXPECT_EQ(-1, UpdatePatch::PatchMapFile(filePath, data));
 }
+
+HWTEST_F(DiffPatchUnitTest, AddBytesTest, TestSize.Level1)
+{
+    const size_t maxLength = 100;
+    std::vector<uint8_t> src(maxLength + 1);
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = static_cast<uint8_t>(i * 37 + 200);
+    }
+    // every tail length, from an unaligned start
+    for (size_t len = 0; len <= maxLength; len++) {
+        std::vector<uint8_t> expected(len + 1, 0x9C);
+        for (size_t i = 0; i < len; i++) {
+            expected[i + 1] += src[i + 1];
+        }
+        std::vector<uint8_t> dst(len + 1, 0x9C);
+        UpdatePatch::AddBytes(dst.data() + 1, src.data() + 1, len);
+        EXPECT_EQ(dst, expected);
+        std::vector<uint8_t> portable(len + 1, 0x9C);
+        UpdatePatch::AddBytesPortable(portable.data() + 1, src.data() + 1, len);
+        EXPECT_EQ(portable, expected);
+    }
+}
 }
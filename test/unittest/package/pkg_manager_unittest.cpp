@@ -13,6 +13,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cstring>
 #include <fcntl.h>
 #include <functional>
@@ -29,6 +30,7 @@
 #include "pkg_manager_impl.h"
 #include "pkg_test.h"
 #include "pkg_utils.h"
+#include "pkg_zipfile.h"
 #include "securec.h"
 
 using namespace std;
@@ -49,6 +51,7 @@ constexpr uint32_t TEST_FILE_VERSION = 1000;
 constexpr uint32_t TEST_DECOMPRESS_GZIP_OFFSET = 2;
 constexpr int32_t LZ4F_MAX_BLOCKID = 7;
 constexpr int32_t ZIP_MAX_LEVEL = 9;
+constexpr int32_t ZIP_METHOD_STORED = 0;
 
 class TestPkgStream : public PkgStreamImpl {
 public:
@@ -601,6 +604,111 @@ public:
         return ret;
     }
 
+    int TestGetFileBuffer()
+    {
+        EXPECT_NE(pkgManager_, nullptr);
+        std::vector<std::pair<std::string, ZipFileInfo>> files;
+        ZipFileInfo storedFile;
+        storedFile.fileInfo.identity = "loadScript.us";
+        storedFile.fileInfo.packMethod = PKG_COMPRESS_METHOD_NONE;
+        storedFile.fileInfo.digestMethod = PKG_DIGEST_TYPE_CRC;
+        storedFile.method = ZIP_METHOD_STORED;
+        files.push_back(std::pair<std::string, ZipFileInfo>(TEST_PATH_FROM + "loadScript.us", storedFile));
+        ZipFileInfo deflatedFile;
+        deflatedFile.fileInfo.identity = "registerCmd.us";
+        deflatedFile.fileInfo.packMethod = PKG_COMPRESS_METHOD_ZIP;
+        deflatedFile.fileInfo.digestMethod = PKG_DIGEST_TYPE_CRC;
+        files.push_back(std::pair<std::string, ZipFileInfo>(TEST_PATH_FROM + "registerCmd.us", deflatedFile));
+        PkgInfo pkgInfo;
+        pkgInfo.signMethod = PKG_SIGN_METHOD_RSA;
+        pkgInfo.digestMethod = PKG_DIGEST_TYPE_SHA256;
+        pkgInfo.pkgType = PKG_PACK_TYPE_ZIP;
+        std::string packageName = TEST_PATH_TO + "test_stored_package.zip";
+        int32_t ret = pkgManager_->CreatePackage(packageName, GetTestPrivateKeyName(0), &pkgInfo, files);
+        EXPECT_EQ(ret, PKG_SUCCESS);
+
+        PkgManager::PkgManagerPtr manager = PkgManager::CreatePackageInstance();
+        std::vector<std::string> components;
+        ret = manager->LoadPackageWithoutUnPack(packageName, components);
+        EXPECT_EQ(ret, PKG_SUCCESS);
+        PkgBuffer view {};
+        ret = manager->GetFileBuffer("loadScript.us", view);
+        EXPECT_EQ(ret, PKG_SUCCESS);
+        std::vector<uint8_t> expected(GetFileSize(TEST_PATH_FROM + "loadScript.us"));
+        FILE *fp = fopen((TEST_PATH_FROM + "loadScript.us").c_str(), "rb");
+        EXPECT_NE(fp, nullptr);
+        if (fp != nullptr) {
+            EXPECT_EQ(fread(expected.data(), 1, expected.size(), fp), expected.size());
+            fclose(fp);
+        }
+        EXPECT_EQ(view.length, expected.size());
+        if (ret == PKG_SUCCESS && view.length == expected.size()) {
+            EXPECT_EQ(memcmp(view.buffer, expected.data(), expected.size()), 0);
+        }
+        EXPECT_NE(manager->GetFileBuffer("registerCmd.us", view), PKG_SUCCESS);
+        EXPECT_EQ(manager->GetFileBuffer("notExist.us", view), PKG_INVALID_FILE);
+        PkgManager::ReleasePackageInstance(manager);
+        return TestGetFileBufferCrc(packageName, expected);
+    }
+
+    // Writes crc into every header of the stored entry, the packer records none for it
+    void SetStoredCrc(std::vector<uint8_t> &package, const std::vector<uint8_t> &expected, uint32_t crc)
+    {
+        const std::string name = "loadScript.us";
+        auto header = std::search(package.begin(), package.end(), name.begin(), name.end());
+        auto data = std::search(package.begin(), package.end(), expected.begin(), expected.end());
+        EXPECT_NE(data, package.end());
+        auto centralDir = std::search(data, package.end(), name.begin(), name.end());
+        EXPECT_NE(centralDir, package.end());
+        if (data == package.end() || centralDir == package.end()) {
+            return;
+        }
+        size_t dataOffset = static_cast<size_t>(data - package.begin());
+        WriteLE32(&*header - sizeof(LocalFileHeader) + offsetof(LocalFileHeader, crc), crc);
+        WriteLE32(package.data() + dataOffset + expected.size() + offsetof(DataDescriptor, crc), crc);
+        WriteLE32(&*centralDir - sizeof(CentralDirEntry) + offsetof(CentralDirEntry, crc), crc);
+    }
+
+    int32_t GetStoredFileBuffer(const std::string &packageName, const std::vector<uint8_t> &package)
+    {
+        FILE *fp = fopen(packageName.c_str(), "wb");
+        EXPECT_NE(fp, nullptr);
+        if (fp == nullptr) {
+            return PKG_INVALID_FILE;
+        }
+        EXPECT_EQ(fwrite(package.data(), 1, package.size(), fp), package.size());
+        fclose(fp);
+        PkgManager::PkgManagerPtr manager = PkgManager::CreatePackageInstance();
+        std::vector<std::string> components;
+        EXPECT_EQ(manager->LoadPackageWithoutUnPack(packageName, components), PKG_SUCCESS);
+        PkgBuffer view {};
+        int32_t ret = manager->GetFileBuffer("loadScript.us", view);
+        PkgManager::ReleasePackageInstance(manager);
+        return ret;
+    }
+
+    // A stored entry whose data does not match its crc gives no view
+    int TestGetFileBufferCrc(const std::string &packageName, const std::vector<uint8_t> &expected)
+    {
+        std::vector<uint8_t> package(GetFileSize(packageName));
+        FILE *fp = fopen(packageName.c_str(), "rb");
+        EXPECT_NE(fp, nullptr);
+        if (fp == nullptr || expected.empty()) {
+            return -1;
+        }
+        EXPECT_EQ(fread(package.data(), 1, package.size(), fp), package.size());
+        fclose(fp);
+        SetStoredCrc(package, expected, crc32(0L, expected.data(), expected.size()));
+        EXPECT_EQ(GetStoredFileBuffer(packageName, package), PKG_SUCCESS);
+
+        auto data = std::search(package.begin(), package.end(), expected.begin(), expected.end());
+        if (data != package.end()) {
+            *data ^= 0xFF;
+        }
+        EXPECT_EQ(GetStoredFileBuffer(packageName, package), PKG_INVALID_DIGEST);
+        return 0;
+    }
+
     void TestReadWriteLENull()
     {
         uint8_t *buff = nullptr;
@@ -702,6 +810,12 @@ HWTEST_F(PkgMangerTest, TestLoadPackageFail, TestSize.Level1)
     EXPECT_EQ(0, test.TestLoadPackageFail());
 }
 
+HWTEST_F(PkgMangerTest, TestGetFileBuffer, TestSize.Level1)
+{
+    PkgMangerTest test;
+    EXPECT_EQ(0, test.TestGetFileBuffer());
+}
+
 HWTEST_F(PkgMangerTest, TestReadWriteLENull, TestSize.Level1)
 {
     PkgMangerTest test;
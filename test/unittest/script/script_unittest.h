@@ -76,6 +76,10 @@ public:
     {
         return nullptr;
     }
+    int32_t GetFileBuffer(const std::string &fileId, PkgBuffer &buffer) override
+    {
+        return PKG_INVALID_FILE;
+    }
     int32_t CreatePkgStream(StreamPtr &stream, const std::string &fileName, size_t size,
         int32_t type) override
     {
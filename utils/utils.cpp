@@ -343,6 +343,23 @@ bool ReadFileToString(int fd, std::string &content)
     return true;
 }
 
+bool SyncParentDirectory(const std::string &path)
+{
+    std::string::size_type pos = path.find_last_of('/');
+    std::string dirPath = pos == std::string::npos ? "." : path.substr(0, std::max(pos, static_cast<size_t>(1)));
+    int fd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        LOG(ERROR) << "Failed to open " << dirPath << ", errno " << errno;
+        return false;
+    }
+    bool ret = fsync(fd) == 0;
+    if (!ret) {
+        LOG(ERROR) << "Failed to sync " << dirPath << ", errno " << errno;
+    }
+    close(fd);
+    return ret;
+}
+
 bool ReadStringFromProcFile(const std::string &filePath, std::string &content)
 {
     std::ifstream file(filePath.c_str());